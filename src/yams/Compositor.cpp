@@ -1,12 +1,17 @@
 #include "Compositor.hpp"
+#include "PixelMapper.hpp"
 #include "yams/MediaPipeline.hpp"
 #include "yams/MediaPlayInfo.hpp"
 #include "yams/gstreamer/Memory.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <memory>
+#include <numbers>
 #include <optional>
 
+#include <QFile>
 #include <QMetaObject>
 #include <QTimer>
 
@@ -22,6 +27,8 @@
 #include <gst/gl/gstglcontext.h>
 #include <gst/gl/gstgldisplay.h>
 #include <gst/gl/gstglsyncmeta.h>
+#include <gst/controller/gstdirectcontrolbinding.h>
+#include <gst/controller/gstinterpolationcontrolsource.h>
 #include <gst/gstbin.h>
 #include <gst/gstbus.h>
 #include <gst/gstcaps.h>
@@ -31,32 +38,93 @@
 #include <gst/gstelementfactory.h>
 #include <gst/gstevent.h>
 #include <gst/gstformat.h>
+#include <gst/gstghostpad.h>
 #include <gst/gstmessage.h>
 #include <gst/gstobject.h>
 #include <gst/gstpad.h>
 #include <gst/gstpipeline.h>
 #include <gst/gstutils.h>
 #include <gst/gstvalue.h>
+#include <gst/video/video-info.h>
 
 #include <yams/gstreamer/Factory.hpp>
+#include <yams/gstreamer/QOpenGL.hpp>
 #include <yams/gstreamer/Thread.hpp>
+#include <yams/utils/Trace.hpp>
 #include <yams/utils/defer.hpp>
 #include <yams/utils/fractional.hpp>
 #include <yams/utils/slogQt.hpp>
 
 namespace yams {
 
+namespace {
+void setEffectUniforms(GstElement *shader, const LayerEffects &effects) {
+	double angle = effects.Rotation * std::numbers::pi / 180.0;
+	// clang-format off
+	auto uniforms = gst_structure_new(
+	    "uniforms",
+	    "crop_left", G_TYPE_FLOAT, float(effects.CropLeft),
+	    "crop_top", G_TYPE_FLOAT, float(effects.CropTop),
+	    "crop_right", G_TYPE_FLOAT, float(1.0 - effects.CropRight),
+	    "crop_bottom", G_TYPE_FLOAT, float(1.0 - effects.CropBottom),
+	    "offset_x", G_TYPE_FLOAT, float(effects.X),
+	    "offset_y", G_TYPE_FLOAT, float(effects.Y),
+	    "scale", G_TYPE_FLOAT, float(std::max(effects.Scale, 1e-3)),
+	    "rotation_cos", G_TYPE_FLOAT, float(std::cos(angle)),
+	    "rotation_sin", G_TYPE_FLOAT, float(std::sin(angle)),
+	    nullptr
+	);
+	// clang-format on
+	auto color = effects.colorMatrix();
+	for (size_t i = 0; i < color.size(); ++i) {
+		gst_structure_set(
+		    uniforms,
+		    ("color_" + std::to_string(i)).c_str(),
+		    G_TYPE_FLOAT,
+		    color[i],
+		    nullptr
+		);
+	}
+	// glshader updates its uniforms before drawing the next frame.
+	g_object_set(shader, "uniforms", uniforms, nullptr);
+	gst_structure_free(uniforms);
+}
+} // namespace
+
 struct Compositor::InputData {
 	size_t                   ID;
+	size_t                   layerID;
 	LayerData               &layer;
 	slog::Logger<3>          logger;
 	MediaPipeline           *pipeline;
-	GstElementPtr            proxysrc;
+	// proxysrc ! glupload ! glcolorconvert ! glshader, src is the shader
+	// output linked to the mixer.
+	GstElementPtr            proxysrc, upload, convert, effect;
+	// only with Options::Preview or Options::Grab, src is then one of its
+	// pads.
+	GstElementPtr            tapTee;
 	GstPadPtr                src, sink;
 	std::chrono::nanoseconds offset;
 
-	InputData &next() const;
+	// replaced by a transaction, never looped again.
+	bool                     retired{false};
+	GstClockID               stopID{nullptr};
+	std::chrono::nanoseconds requested{0};
+	MediaPlayInfo::Type      type{MediaPlayInfo::Type::VIDEO};
+	GstControlSourcePtr      alpha;
+
+	// written by the streaming thread of the mixer sink pad.
+	GstSegment           segment;
+	std::atomic<int64_t> lastEnd{0};
+
+	// media decoded up to its first frame, waiting for playMedia().
+	std::optional<MediaPlayInfo> prerolled;
+
+	// a free input of the layer for the next loop, nullptr if none.
+	InputData *nextFree() const;
 	bool       scheduled() const;
+	bool       still() const;
+	void       setAlpha(std::chrono::nanoseconds at, qreal value);
 
 	void
 	playMedia(const MediaPlayInfo &, std::chrono::nanoseconds atRunningTime);
@@ -69,19 +137,55 @@ struct Compositor::InputData {
 struct Compositor::LayerData {
 	Compositor     &compositor;
 	slog::Logger<2> logger;
-	InputData       inputs[2];
-	size_t          next{0};
+	// loops alternate between two inputs. A media cut in just after a loop
+	// boundary starts on the third one, while the outgoing inputs run out.
+	InputData inputs[3];
+	size_t    next{0};
 
 	std::optional<MediaPlayInfo> media;
+	// start of a transaction media waiting for an input to be released.
+	std::optional<std::chrono::nanoseconds> pendingStart;
+	// opacity keyframes in running time, linearly interpolated. The first
+	// one is in effect.
+	std::map<std::chrono::nanoseconds, qreal> opacity{{0ns, 1.0}};
+
+	qreal opacityAt(std::chrono::nanoseconds at) const {
+		auto it = opacity.upper_bound(at);
+		if (it == opacity.begin()) {
+			return it->second;
+		}
+		auto prev = std::prev(it);
+		if (it == opacity.end()) {
+			return prev->second;
+		}
+		return prev->second + (it->second - prev->second) *
+		                          (at - prev->first).count() /
+		                          (it->first - prev->first).count();
+	}
 
 	InputData &nextSink() {
-		return inputs[next % 2];
+		return inputs[next % std::size(inputs)];
+	}
+
+	// the scheduled inputs playing media, none of them retired.
+	size_t playing() const {
+		return std::count_if(
+		    std::begin(inputs),
+		    std::end(inputs),
+		    [](const InputData &input) {
+			    return input.scheduled() == true && input.retired == false;
+		    }
+		);
 	}
 
 	LayerData(Compositor &parent, size_t layerID, const Options &opts)
 	    : compositor{parent}
 	    , logger{parent.d_logger.With(slog::Int("layer", layerID))}
-	    , inputs{{*this, layerID, 0, opts}, {*this, layerID, 1, opts}} {}
+	    , inputs{
+	          {*this, layerID, 0, opts},
+	          {*this, layerID, 1, opts},
+	          {*this, layerID, 2, opts},
+	      } {}
 };
 
 Compositor::InputData::InputData(
@@ -89,6 +193,7 @@ Compositor::InputData::InputData(
 )
     : layer{parent}
     , ID{inputID}
+    , layerID{layerID}
     , logger{parent.logger.With(slog::Int("input", inputID))} {
 	proxysrc = GstElementFactoryMakeFull(
 	    "proxysrc",
@@ -103,18 +208,111 @@ Compositor::InputData::InputData(
 	);
 
 	pipeline = new MediaPipeline{
-	    {.LayerID = layerID,
-	     .SinkID  = inputID,
-	     .Size    = opts.Size,
-	     .FPS     = opts.FPS},
+	    {.LayerID      = layerID,
+	     .SinkID       = inputID,
+	     .Size         = opts.Size,
+	     .FPS          = opts.FPS,
+	     .LatencyStamp = opts.MeasureLatency,
+	     .Display      = compositor->d_display,
+	     .Context      = compositor->d_context,
+	     .Clock        = compositor->d_clock.get()},
 	    compositor
 	};
 
 	g_object_set(proxysrc.get(), "proxysink", pipeline->proxySink(), nullptr);
-	src.reset(gst_element_get_static_pad(proxysrc.get(), "src"));
+	QObject::connect(
+	    pipeline,
+	    &MediaPipeline::Late,
+	    compositor,
+	    &Compositor::reportLate
+	);
+
+	// the effect shader stays linked between medias, only its output is
+	// linked to the mixer.
+	QFile shader{":shaders/layereffects.fragment"};
+	if (shader.open(QIODevice::ReadOnly) == false) {
+		delete pipeline;
+		throw cpptrace::runtime_error{"could not read layer effects shader"};
+	}
+	auto fragment = shader.readAll().toStdString();
+	auto suffix   = std::to_string(layerID) + "_" + std::to_string(inputID);
+
+	upload = GstElementFactoryMakeFull(
+	    "glupload",
+	    "name",
+	    ("upload" + suffix).c_str()
+	);
+	convert = GstElementFactoryMakeFull(
+	    "glcolorconvert",
+	    "name",
+	    ("convert" + suffix).c_str()
+	);
+	effect = GstElementFactoryMakeFull(
+	    "glshader",
+	    "name",
+	    ("effect" + suffix).c_str(),
+	    "fragment",
+	    fragment.c_str()
+	);
+	setEffectUniforms(effect.get(), LayerEffects{});
+	gst_bin_add_many(
+	    GST_BIN(compositor->d_pipeline.get()),
+	    g_object_ref(upload.get()),
+	    g_object_ref(convert.get()),
+	    g_object_ref(effect.get()),
+	    nullptr
+	);
+	if (gst_element_link_many(
+	        proxysrc.get(),
+	        upload.get(),
+	        convert.get(),
+	        effect.get(),
+	        nullptr
+	    ) == false) {
+		delete pipeline;
+		throw cpptrace::runtime_error{"could not link layer effects"};
+	}
+
+	if (compositor->d_taps->tapsLayers()) {
+		// previews and grabs show the effects, only the other tee pad is
+		// linked to the mixer.
+		tapTee = GstElementFactoryMakeFull(
+		    "tee",
+		    "name",
+		    ("taptee" + suffix).c_str(),
+		    "allow-not-linked",
+		    true
+		);
+		gst_bin_add(
+		    GST_BIN(compositor->d_pipeline.get()),
+		    g_object_ref(tapTee.get())
+		);
+		if (gst_element_link(effect.get(), tapTee.get()) == false) {
+			delete pipeline;
+			throw cpptrace::runtime_error{"could not link layer taps"};
+		}
+		compositor->d_taps->addLayerBranches(
+		    tapTee.get(),
+		    int(layerID),
+		    suffix
+		);
+		src.reset(gst_element_request_pad_simple(tapTee.get(), "src_%u"));
+	} else {
+		src.reset(gst_element_get_static_pad(effect.get(), "src"));
+	}
 	if (src == nullptr) {
 		delete pipeline;
-		throw cpptrace::runtime_error{"could not found src pad on sink"};
+		throw cpptrace::runtime_error{"could not found src pad on effect"};
+	}
+
+	if (trace::enabled()) {
+		gst_pad_add_probe(
+		    src.get(),
+		    GST_PAD_PROBE_TYPE_BUFFER,
+		    (GstPadProbeCallback)&Compositor::onProxyPushProbe,
+		    this,
+		    nullptr
+		);
 	}
 }
 
@@ -124,12 +322,13 @@ void Compositor::InputData::playMedia(
 	// offset all time going from that pad, before doing anything
 	gst_pad_set_offset(src.get(), atRunningTime.count());
 
-	if (gst_element_link_many(
-	        proxysrc.get(),
+	if (gst_element_link_pads(
+	        GST_PAD_PARENT(src.get()),
+	        GST_OBJECT_NAME(src.get()),
 	        layer.compositor.d_videoMixer.get(),
 	        nullptr
 	    ) == false) {
-		logger.Error("could not link proxysink to videomixer");
+		logger.Error("could not link layer effects to videomixer");
 		return;
 	}
 
@@ -141,18 +340,47 @@ void Compositor::InputData::playMedia(
 	// clang-format off
 	g_object_set(
 	    sink.get(),
-	    "width", layer.compositor.d_size.width(),
-	    "height", layer.compositor.d_size.height(),
+	    "width", layer.compositor.d_mixSize.width(),
+	    "height", layer.compositor.d_mixSize.height(),
 	    "sizing-policy", 1,
 		"repeat-after-eos", false,
+	    "zorder", guint(layerID),
 	    nullptr
 	);
 	// clang-format on
-	offset = atRunningTime;
+	offset    = atRunningTime;
+	requested = layer.compositor.outputTime();
+	type      = infos.MediaType;
+	lastEnd.store(0);
+	gst_segment_init(&segment, GST_FORMAT_TIME);
+
+	// opacity changes are keyframes on the mixer pad, applied by the mixer
+	// on the frame they are set for, see Compositor::commit().
+	auto target = GstPadPtr{
+	    GST_IS_GHOST_PAD(sink.get())
+	        ? gst_ghost_pad_get_target(GST_GHOST_PAD(sink.get()))
+	        : GST_PAD(gst_object_ref(sink.get()))
+	};
+	alpha.reset(gst_interpolation_control_source_new());
+	g_object_set(alpha.get(), "mode", GST_INTERPOLATION_MODE_LINEAR, nullptr);
+	for (const auto &[at, value] : layer.opacity) {
+		setAlpha(at, value);
+	}
+	gst_object_add_control_binding(
+	    GST_OBJECT(target.get()),
+	    gst_direct_control_binding_new_absolute(
+	        GST_OBJECT(target.get()),
+	        "alpha",
+	        alpha.get()
+	    )
+	);
+
 	gst_pad_add_probe(
 	    sink.get(),
-	    GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
-	    (GstPadProbeCallback)&Compositor::onSinkEventProbe,
+	    GstPadProbeType(
+	        GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_BUFFER
+	    ),
+	    (GstPadProbeCallback)&Compositor::onSinkProbe,
 	    this,
 	    nullptr
 	);
@@ -171,23 +399,51 @@ void Compositor::InputData::playMedia(
 	    slog::Duration("offset", atRunningTime)
 	);
 
+	// a prerolled pipeline resumes if it holds the same media, or drops it.
+	prerolled.reset();
 	pipeline->play(infos);
-	if (infos.Loop == false || next().scheduled() == true) {
+	if (infos.Loop == false || layer.playing() > 1) {
 		return;
 	}
-
-	next().playMedia(infos, atRunningTime + infos.Duration);
+	// without a free input, looped once a retired one is released, see
+	// removeMedia().
+	if (auto next = nextFree(); next != nullptr) {
+		next->playMedia(infos, atRunningTime + infos.Duration);
+	}
 }
 
-Compositor::InputData &Compositor::InputData::next() const {
-	return layer.inputs[(ID + 1) % 2];
+Compositor::InputData *Compositor::InputData::nextFree() const {
+	for (auto &input : layer.inputs) {
+		if (&input != this && input.scheduled() == false) {
+			return &input;
+		}
+	}
+	return nullptr;
 }
 
 bool Compositor::InputData::scheduled() const {
 	return sink != nullptr;
 }
 
+bool Compositor::InputData::still() const {
+	// an image is a single buffer, once the output has shown it the mixer
+	// has nothing new to composite.
+	auto end = lastEnd.load();
+	return type == MediaPlayInfo::Type::IMAGE && end > 0 &&
+	       layer.compositor.outputTime().count() >= end;
+}
+
+void Compositor::InputData::setAlpha(std::chrono::nanoseconds at, qreal value) {
+	gst_timed_value_control_source_set(
+	    GST_TIMED_VALUE_CONTROL_SOURCE(alpha.get()),
+	    std::max(at, 0ns).count(),
+	    value
+	);
+}
+
 void Compositor::stop() {
+	d_taps->finishRecording();
+	d_taps->waitRecording();
 	gst_element_set_state(d_pipeline.get(), GST_STATE_NULL);
 }
 
@@ -199,19 +455,77 @@ Compositor::Compositor(Options options, Args args)
     , d_display{args.Display}
     , d_context{args.Context}
     , d_pool{FramePool::Create()}
-    , d_size{options.Size} {
-
-	if (options.Layers > 3) {
+    , d_size{options.Size}
+    , d_mixSize{options.Size}
+    , d_framesTotal{metrics::Registry::Global().counter(
+          "yams_compositor_frames_total", "Frames output by the compositor."
+      )}
+    , d_framesAllocated{metrics::Registry::Global().gauge(
+          "yams_frame_pool_allocated", "Output frames allocated in the pool."
+      )}
+    , d_timeToFirstBuffer{metrics::Registry::Global().histogram(
+          "yams_time_to_first_buffer_seconds",
+          "Delay between a play request and its first mixed buffer."
+      )}
+    , d_qos{{}}
+    , d_qosLate{metrics::Registry::Global().counter(
+          "yams_qos_late_total",
+          "Late buffers reported by QoS messages and the renderer."
+      )}
+    , d_qosDegraded{metrics::Registry::Global().counter(
+          "yams_qos_transitions_total",
+          "Graceful degradation level changes.",
+          {{"direction", "degrade"}}
+      )}
+    , d_qosRecovered{metrics::Registry::Global().counter(
+          "yams_qos_transitions_total",
+          "Graceful degradation level changes.",
+          {{"direction", "recover"}}
+      )}
+    , d_qosLevel{metrics::Registry::Global().gauge(
+          "yams_qos_level", "Current graceful degradation level."
+      )}
+    , d_idlePause{options.IdlePause}
+    , d_idleGauge{metrics::Registry::Global().gauge(
+          "yams_compositor_idle", "1 while compositing is paused."
+      )}
+    , d_pendingReleasesGauge{metrics::Registry::Global().gauge(
+          "yams_mixer_pads_pending_release",
+          "Mixer sink pads unlinked, waiting for their last buffer output."
+      )}
+    , d_releaseTime{metrics::Registry::Global().histogram(
+          "yams_mixer_pad_release_seconds",
+          "Delay between the end of an input and the release of its mixer "
+          "pad."
+      )}
+    , d_prerollHits{metrics::Registry::Global().counter(
+          "yams_preroll_requests_total",
+          "Medias started on a layer, by whether they were prerolled.",
+          {{"result", "hit"}}
+      )}
+    , d_prerollMisses{metrics::Registry::Global().counter(
+          "yams_preroll_requests_total",
+          "Medias started on a layer, by whether they were prerolled.",
+          {{"result", "miss"}}
+      )} {
+
+	if (options.Layers > CompositorState::MaxLayers) {
 		throw cpptrace::invalid_argument{
 		    "unsupported number of layers (" + std::to_string(options.Layers) +
-		    ") max:3"
+		    ") max:" + std::to_string(CompositorState::MaxLayers)
 		};
 	}
-	d_clock = GstClockPtr{gst_system_clock_obtain()};
+	d_clock = GstClockPtr{
+	    args.Clock != nullptr ? GST_CLOCK(gst_object_ref(args.Clock))
+	                          : gst_system_clock_obtain()
+	};
 	gst_pipeline_use_clock(GST_PIPELINE(d_pipeline.get()), d_clock.get());
 
 	auto [num, denum] = yams::build_fraction(options.FPS);
 
+	d_fpsNum   = num;
+	d_fpsDenum = denum;
+
 	d_logger.Info(
 	    "output settings",
 	    slog::String(
@@ -222,15 +536,6 @@ Compositor::Compositor(Options options, Args args)
 	);
 
 	// clang-format off
-	auto blacksourceCaps = gst_caps_new_simple(
-	    "video/x-raw",
-	    "framerate", GST_TYPE_FRACTION, num, denum,
-	    "width", G_TYPE_INT, 16,
-	    "height", G_TYPE_INT, 16,
-	    nullptr
-	);
-
-
 	auto compositorCaps = gst_caps_new_simple(
 	    "video/x-raw",
 	    "framerate",GST_TYPE_FRACTION, num,denum,
@@ -239,9 +544,6 @@ Compositor::Compositor(Options options, Args args)
 	    nullptr
 	);
 	// clang-format on
-	if (blacksourceCaps == nullptr) {
-		throw cpptrace::runtime_error{"could not build black caps"};
-	}
 	if (compositorCaps == nullptr) {
 		throw cpptrace::runtime_error{"could not build compositor caps"};
 	}
@@ -250,44 +552,44 @@ Compositor::Compositor(Options options, Args args)
 	gst_caps_set_features(compositorCaps, 0, feature);
 
 	defer {
-		gst_caps_unref(blacksourceCaps);
 		gst_caps_unref(compositorCaps);
 	};
 
 	// clang-format off
-	d_blacksrc = GstElementFactoryMakeFull(
-	    "videotestsrc",
-	    "name", "blacksrc0",
-		"is-live", true,
-		"do-timestamp", true,
-	    "pattern", 2
-	);
-	auto blackSourceCapsfilter = GstElementFactoryMakeFull(
-	    "capsfilter",
-	    "name", "blacksrcfilter0",
-	    "caps", blacksourceCaps
-	);
-
 	d_playAdditionnalLatency = 800ms;
+	// When throttled, the live mixer times its output on the clock and
+	// fills it with its background, no input is needed to drive it.
 	d_videoMixer = GstElementFactoryMakeFull(
 	    "glvideomixer",
 	    "name", "vmix",
-	    "force-live", true,
+	    "force-live", options.Throttled,
 	    "background", 1,
 	    "min-upstream-latency", std::chrono::nanoseconds{0ms}.count(),
 	    "latency", std::chrono::nanoseconds{800ms}.count()
 	);
 
-	auto compositorCapsfilter = GstElementFactoryMakeFull(
+	d_mixCaps = GstElementFactoryMakeFull(
 	    "capsfilter",
 	    "name", "vmixcaps",
 	    "caps", compositorCaps
 	);
+	// Under QoS the mix may run at a reduced size, it is scaled back so that
+	// the output caps never change. A passthrough at full size.
+	auto outputScale = GstElementFactoryMakeFull(
+	    "glcolorscale",
+	    "name", "outputscale"
+	);
+	auto outputCaps = GstElementFactoryMakeFull(
+	    "capsfilter",
+	    "name", "outputcaps",
+	    "caps", compositorCaps
+	);
 	auto appsink = GstElementFactoryMakeFull(
 	    "appsink",
 	    "name", "sink0",
 	    "emit-signals", true,
-	    "sync", true
+	    "sync", options.Throttled,
+	    "qos", options.Throttled
 	);
 	// clang-format on
 
@@ -300,51 +602,709 @@ Compositor::Compositor(Options options, Args args)
 
 	gst_bin_add_many(
 	    GST_BIN_CAST(d_pipeline.get()),
-	    g_object_ref(d_blacksrc.get()),
-	    g_object_ref(blackSourceCapsfilter.get()),
 	    g_object_ref(d_videoMixer.get()),
-	    g_object_ref(compositorCapsfilter.get()),
+	    g_object_ref(d_mixCaps.get()),
+	    g_object_ref(outputScale.get()),
+	    g_object_ref(outputCaps.get()),
 	    g_object_ref(appsink.get()),
 	    nullptr
 	);
 
 	if (gst_element_link_many(
-	        d_blacksrc.get(),
-	        blackSourceCapsfilter.get(),
 	        d_videoMixer.get(),
-	        compositorCapsfilter.get(),
-	        appsink.get(),
+	        d_mixCaps.get(),
+	        outputScale.get(),
+	        outputCaps.get(),
 	        nullptr
 	    ) == false) {
 		throw cpptrace::runtime_error{"could not link pipeline elements"};
 	}
+	d_taps = std::make_unique<OutputTaps>(
+	    OutputTaps::Options{
+	        .ChecksumEvery = options.ChecksumEvery,
+	        .Preview       = options.Preview,
+	        .Record        = options.Record,
+	        .Grab          = options.Grab,
+	    },
+	    OutputTaps::Args{
+	        .Bin      = GST_BIN_CAST(d_pipeline.get()),
+	        .FPSNum   = num,
+	        .FPSDenum = denum,
+	        .Layers   = options.Layers,
+	    }
+	);
+	connect(
+	    d_taps.get(),
+	    &OutputTaps::frameChecksum,
+	    this,
+	    &Compositor::frameChecksum,
+	    Qt::DirectConnection
+	);
+	connect(
+	    d_taps.get(),
+	    &OutputTaps::previewFrame,
+	    this,
+	    &Compositor::previewFrame,
+	    Qt::DirectConnection
+	);
+
+	GstElement *output = outputCaps.get();
+	if (d_taps->tapsOutput() || options.PixelMapping.has_value()) {
+		output = addOutputTee(output);
+	}
+	if (options.PixelMapping.has_value()) {
+		addPixelMapBranch(options.PixelMapping.value(), options.Throttled);
+	}
+	if (d_taps->tapsOutput()) {
+		d_taps->addOutputBranches(d_outputTee.get());
+	}
+	if (gst_element_link(output, appsink.get()) == false) {
+		throw cpptrace::runtime_error{"could not link pipeline elements"};
+	}
+
+	if (options.Throttled == false) {
+		addHeartbeat(num, denum);
+	}
 
 	d_videoMixerSrc =
 	    GstPadPtr{gst_element_get_static_pad(d_videoMixer.get(), "src")};
 
+	if (options.MeasureLatency == true) {
+		d_latency = std::make_unique<LatencyProbe>();
+		// after outputscale, a reduced mix would halve the code region.
+		auto outputSrc =
+		    GstPadPtr{gst_element_get_static_pad(outputCaps.get(), "src")};
+		gst_pad_add_probe(
+		    outputSrc.get(),
+		    GST_PAD_PROBE_TYPE_BUFFER,
+		    (GstPadProbeCallback)&Compositor::onLatencyProbe,
+		    this,
+		    nullptr
+		);
+	}
+
+	gst_pad_add_probe(
+	    d_videoMixerSrc.get(),
+	    GST_PAD_PROBE_TYPE_BUFFER,
+	    (GstPadProbeCallback)&Compositor::onMixerOutputProbe,
+	    this,
+	    nullptr
+	);
+
 	buildLayers(options);
+	publishState();
+
+	// started before the compositor is moved to its thread, Qt restarts it
+	// there.
+	auto timer = new QTimer{this};
+	connect(timer, &QTimer::timeout, this, &Compositor::updateQoS);
+	connect(timer, &QTimer::timeout, this, &Compositor::updateIdle);
+	if (d_taps->recording()) {
+		connect(timer, &QTimer::timeout, this, [this] {
+			d_taps->updateRecording(timeline().PTS);
+		});
+	}
+	timer->start(250);
+}
+
+void Compositor::addHeartbeat(int num, int denum) {
+	// A non-live mixer only aggregates when all its inputs have data, a tiny
+	// GL source keeps it running as fast as possible without any upload.
+	// clang-format off
+	auto caps = gst_caps_new_simple(
+	    "video/x-raw",
+	    "framerate", GST_TYPE_FRACTION, num, denum,
+	    "width", G_TYPE_INT, 16,
+	    "height", G_TYPE_INT, 16,
+	    nullptr
+	);
+	// clang-format on
+	if (caps == nullptr) {
+		throw cpptrace::runtime_error{"could not build heartbeat caps"};
+	}
+	gst_caps_set_features(
+	    caps,
+	    0,
+	    gst_caps_features_new("memory:GLMemory", nullptr)
+	);
+	defer {
+		gst_caps_unref(caps);
+	};
+
+	// clang-format off
+	d_heartbeat = GstElementFactoryMakeFull(
+	    "gltestsrc",
+	    "name", "heartbeat0",
+	    "pattern", 2
+	);
+	auto heartbeatCapsfilter = GstElementFactoryMakeFull(
+	    "capsfilter",
+	    "name", "heartbeatfilter0",
+	    "caps", caps
+	);
+	// clang-format on
+
+	gst_bin_add_many(
+	    GST_BIN_CAST(d_pipeline.get()),
+	    g_object_ref(d_heartbeat.get()),
+	    g_object_ref(heartbeatCapsfilter.get()),
+	    nullptr
+	);
+
+	if (gst_element_link_many(
+	        d_heartbeat.get(),
+	        heartbeatCapsfilter.get(),
+	        d_videoMixer.get(),
+	        nullptr
+	    ) == false) {
+		throw cpptrace::runtime_error{"could not link heartbeat"};
+	}
+}
+
+GstElement *Compositor::addOutputTee(GstElement *upstream) {
+	// the output appsink is linked straight to the tee, only the taps run
+	// behind their own queues.
+	d_outputTee = GstElementFactoryMakeFull("tee", "name", "outputtee");
+	gst_bin_add(
+	    GST_BIN_CAST(d_pipeline.get()),
+	    g_object_ref(d_outputTee.get())
+	);
+
+	if (gst_element_link(upstream, d_outputTee.get()) == false) {
+		throw cpptrace::runtime_error{"could not link output tee"};
+	}
+	return d_outputTee.get();
+}
+
+void Compositor::addPixelMapBranch(const PixelMap &map, bool throttled) {
+	// All slices are drawn from a vertex buffer by a single glfilterapp
+	// pass into an atlas of the outputs, behind a leaky queue so a slow
+	// output never holds the compositor.
+	d_pixelMapper  = std::make_unique<PixelMapper>(map, d_size);
+	d_pixelMapPool = FramePool::Create();
+	auto atlas     = d_pixelMapper->atlasSize();
+	auto caps      = GLMemoryCaps(atlas.width(), atlas.height());
+	defer {
+		gst_caps_unref(caps);
+	};
+
+	// clang-format off
+	auto queue = GstElementFactoryMakeFull(
+	    "queue",
+	    "name", "pixelmapqueue",
+	    "max-size-buffers", 2,
+	    "leaky", 2
+	);
+	auto mapper = GstElementFactoryMakeFull(
+	    "glfilterapp",
+	    "name", "pixelmap"
+	);
+	auto mapperCaps = GstElementFactoryMakeFull(
+	    "capsfilter",
+	    "name", "pixelmapcaps",
+	    "caps", caps
+	);
+	d_pixelMapTee = GstElementFactoryMakeFull(
+	    "tee",
+	    "name", "pixelmaptee",
+	    "allow-not-linked", true
+	);
+	// clang-format on
+
+	g_signal_connect(
+	    mapper.get(),
+	    "client-draw",
+	    G_CALLBACK(&Compositor::onPixelMapDraw),
+	    this
+	);
+
+	gst_bin_add_many(
+	    GST_BIN_CAST(d_pipeline.get()),
+	    g_object_ref(queue.get()),
+	    g_object_ref(mapper.get()),
+	    g_object_ref(mapperCaps.get()),
+	    g_object_ref(d_pixelMapTee.get()),
+	    nullptr
+	);
+	if (gst_element_link_many(
+	        d_outputTee.get(),
+	        queue.get(),
+	        mapper.get(),
+	        mapperCaps.get(),
+	        d_pixelMapTee.get(),
+	        nullptr
+	    ) == false) {
+		throw cpptrace::runtime_error{"could not link pixel map branch"};
+	}
+
+	bool onScreen = false;
+	for (size_t i = 0; i < map.Outputs.size(); ++i) {
+		if (map.Outputs[i].SharedMemory.empty() == false) {
+			addSharedMemoryOutput(map, i);
+		}
+		onScreen = onScreen || map.Outputs[i].Screen.empty() == false;
+	}
+	if (onScreen == false) {
+		return;
+	}
+
+	// clang-format off
+	auto screenQueue = GstElementFactoryMakeFull(
+	    "queue",
+	    "name", "pixelmapscreenqueue",
+	    "max-size-buffers", 2
+	);
+	auto appsink = GstElementFactoryMakeFull(
+	    "appsink",
+	    "name", "pixelmapsink",
+	    "emit-signals", true,
+	    "sync", throttled
+	);
+	// clang-format on
+	g_signal_connect(
+	    appsink.get(),
+	    "new-sample",
+	    G_CALLBACK(&Compositor::onPixelMapSampleCb),
+	    this
+	);
+	gst_bin_add_many(
+	    GST_BIN_CAST(d_pipeline.get()),
+	    g_object_ref(screenQueue.get()),
+	    g_object_ref(appsink.get()),
+	    nullptr
+	);
+	if (gst_element_link_many(
+	        d_pixelMapTee.get(),
+	        screenQueue.get(),
+	        appsink.get(),
+	        nullptr
+	    ) == false) {
+		throw cpptrace::runtime_error{"could not link pixel map screens"};
+	}
+}
+
+void Compositor::addSharedMemoryOutput(const PixelMap &map, size_t output) {
+	const auto &infos  = map.Outputs[output];
+	auto        suffix = std::to_string(output);
+	auto        caps   = GLMemoryCaps(infos.Width, infos.Height);
+	defer {
+		gst_caps_unref(caps);
+	};
+
+	// clang-format off
+	auto queue = GstElementFactoryMakeFull(
+	    "queue",
+	    "name", ("pixelmapshmqueue" + suffix).c_str(),
+	    "max-size-buffers", 2,
+	    "leaky", 2
+	);
+	auto download = GstElementFactoryMakeFull(
+	    "gldownload",
+	    "name", ("pixelmapdownload" + suffix).c_str()
+	);
+	auto sink = GstElementFactoryMakeFull(
+	    "shmsink",
+	    "name", ("pixelmapshm" + suffix).c_str(),
+	    "socket-path", infos.SharedMemory.c_str(),
+	    "shm-size", guint(4 * 4 * infos.Width * infos.Height),
+	    "wait-for-connection", false,
+	    "sync", false
+	);
+	// clang-format on
+	std::vector<GstElement *> chain{queue.get()};
+
+	// the output is cut from the atlas on the GPU, only its pixels are
+	// downloaded.
+	GstElementPtr crop, cropCaps;
+	auto          region = map.region(output);
+	if (QSize{region.Width, region.Height} != map.atlasSize()) {
+		QFile shader{":shaders/region.fragment"};
+		if (shader.open(QIODevice::ReadOnly) == false) {
+			throw cpptrace::runtime_error{"could not read region shader"};
+		}
+		auto  fragment = shader.readAll().toStdString();
+		auto  atlas    = map.atlasSize();
+		// clang-format off
+		auto uniforms = gst_structure_new(
+		    "uniforms",
+		    "region_x", G_TYPE_FLOAT, float(region.X) / atlas.width(),
+		    "region_y", G_TYPE_FLOAT, float(region.Y) / atlas.height(),
+		    "region_width", G_TYPE_FLOAT, float(region.Width) / atlas.width(),
+		    "region_height", G_TYPE_FLOAT,
+		        float(region.Height) / atlas.height(),
+		    nullptr
+		);
+		crop = GstElementFactoryMakeFull(
+		    "glshader",
+		    "name", ("pixelmapcrop" + suffix).c_str(),
+		    "fragment", fragment.c_str(),
+		    "uniforms", uniforms
+		);
+		cropCaps = GstElementFactoryMakeFull(
+		    "capsfilter",
+		    "name", ("pixelmapcropcaps" + suffix).c_str(),
+		    "caps", caps
+		);
+		// clang-format on
+		gst_structure_free(uniforms);
+		chain.push_back(crop.get());
+		chain.push_back(cropCaps.get());
+	}
+	chain.push_back(download.get());
+	chain.push_back(sink.get());
+
+	GstElement *previous = d_pixelMapTee.get();
+	for (auto element : chain) {
+		gst_bin_add(GST_BIN_CAST(d_pipeline.get()), g_object_ref(element));
+		if (gst_element_link(previous, element) == false) {
+			throw cpptrace::runtime_error{
+			    "could not link shared memory output " + infos.Name
+			};
+		}
+		previous = element;
+	}
+}
+
+gboolean Compositor::onPixelMapDraw(
+    GstElement *filter,
+    guint       texture,
+    guint       width,
+    guint       height,
+    Compositor *self
+) {
+	return self->d_pixelMapper->draw(texture);
+}
+
+GstFlowReturn
+Compositor::onPixelMapSampleCb(GstElement *appsink, Compositor *self) {
+	auto sample = gst_app_sink_pull_sample(GST_APP_SINK_CAST(appsink));
+	if (sample == nullptr) {
+		return GST_FLOW_FLUSHING;
+	}
+	auto buffer = gst_buffer_ref(gst_sample_get_buffer(sample));
+	if (self->d_pixelMapInfos.has_value() == false) {
+		self->d_pixelMapInfos = GstVideoInfo{};
+		gst_video_info_from_caps(
+		    &self->d_pixelMapInfos.value(),
+		    gst_sample_get_caps(sample)
+		);
+	}
+	gst_sample_unref(sample);
+
+	// as for the output, outputs wait on this sync point before drawing.
+	auto memory =
+	    reinterpret_cast<GstGLBaseMemory *>(gst_buffer_peek_memory(buffer, 0));
+	auto context  = memory->context;
+	auto syncMeta = gst_buffer_get_gl_sync_meta(buffer);
+	if (syncMeta == nullptr) {
+		buffer   = gst_buffer_make_writable(buffer);
+		syncMeta = gst_buffer_add_gl_sync_meta(context, buffer);
+	}
+	gst_gl_sync_meta_set_sync_point(syncMeta, context);
+
+	auto frame = Frame::Ptr{
+	    self->d_pixelMapPool->Get([](Frame *frame) { frame->unmap(); })
+	};
+	if (frame->map(
+	        &self->d_pixelMapInfos.value(),
+	        buffer,
+	        GstMapFlags(GST_MAP_READ | GST_MAP_GL)
+	    ) == false) {
+		self->d_logger.Error("failed to map pixel map buffer");
+		gst_buffer_unref(buffer);
+		return GST_FLOW_ERROR;
+	}
+	gst_buffer_unref(buffer);
+
+	emit self->pixelMapFrame(frame);
+	return GST_FLOW_OK;
+}
+
+void Compositor::setPixelMap(PixelMap map) {
+	if (d_pixelMapper == nullptr) {
+		throw cpptrace::logic_error{"compositor has no pixel mapping"};
+	}
+	d_pixelMapper->setMap(std::move(map));
+}
+
+std::future<QImage> Compositor::grab(int source, QSize size, quint64 frame) {
+	auto res = d_taps->grab(source, size, frame);
+	// an idle compositor produces no frame to grab.
+	QMetaObject::invokeMethod(this, &Compositor::wakeUp, Qt::QueuedConnection);
+	return res;
+}
+
+quint64 Compositor::frameNumber(GstClockTime PTS) const {
+	return gst_util_uint64_scale_round(PTS, d_fpsNum, d_fpsDenum * GST_SECOND);
 }
 
 Compositor::~Compositor() {
+	d_taps->finishRecording();
+	d_taps->waitRecording();
 	gst_element_set_state(d_pipeline.get(), GST_STATE_NULL);
+	for (const auto &pending : d_pendingReleases) {
+		gst_object_unref(pending.Sink);
+	}
+	for (auto &layer : d_layers) {
+		for (auto &input : layer->inputs) {
+			if (input.stopID != nullptr) {
+				gst_clock_id_unschedule(input.stopID);
+				gst_clock_id_unref(input.stopID);
+			}
+		}
+	}
+	if (d_latency == nullptr) {
+		return;
+	}
+	auto stats = d_latency->stats();
+	d_logger.Info(
+	    "play latency",
+	    slog::Int("triggers", stats.Triggers),
+	    slog::Int("samples", stats.Samples),
+	    slog::Int("misses", stats.Misses),
+	    slog::Duration("min", stats.Min),
+	    slog::Duration("mean", stats.Mean),
+	    slog::Duration("p50", stats.P50),
+	    slog::Duration("p95", stats.P95),
+	    slog::Duration("p99", stats.P99),
+	    slog::Duration("max", stats.Max)
+	);
+}
+
+LatencyProbe *Compositor::latencyProbe() {
+	return d_latency.get();
+}
+
+void Compositor::reportLate() {
+	d_qosLate.inc();
+	d_qos.reportLate();
+}
+
+QoSGovernor::Level Compositor::qosLevel() const {
+	return d_qos.level();
+}
+
+QSize Compositor::outputSize() const {
+	return d_size;
+}
+
+std::vector<Compositor::InputState> Compositor::inputStates(size_t layer
+) const {
+	std::vector<InputState> res;
+	for (const auto &input : d_layers.at(layer)->inputs) {
+		res.push_back({
+		    .Scheduled = input.scheduled(),
+		    .Offset =
+		        std::chrono::nanoseconds{gst_pad_get_offset(input.src.get())},
+		    .Prerolled = input.prerolled.has_value(),
+		});
+	}
+	return res;
+}
+
+size_t Compositor::framesAllocated() const {
+	return d_pool->PoolSize();
+}
+
+size_t Compositor::pendingReleases() const {
+	return d_pendingReleases.size();
+}
+
+void Compositor::updateQoS() {
+	auto previous = d_qos.level();
+	auto level    = d_qos.update();
+	if (level.has_value() == false) {
+		return;
+	}
+	if (level.value() > previous) {
+		d_qosDegraded.inc();
+		d_logger.Warn(
+		    "overloaded, degrading output",
+		    slog::String("from", QoSGovernor::LevelName(previous)),
+		    slog::String("to", QoSGovernor::LevelName(level.value()))
+		);
+	} else {
+		d_qosRecovered.inc();
+		d_logger.Info(
+		    "headroom back, restoring output",
+		    slog::String("from", QoSGovernor::LevelName(previous)),
+		    slog::String("to", QoSGovernor::LevelName(level.value()))
+		);
+	}
+	d_qosLevel.set(int(level.value()));
+	applyQoS(level.value());
+	emit qosLevelChanged(level.value());
+}
+
+void Compositor::updateIdle() {
+	if (d_idlePause == false || d_idle == true ||
+	    d_pendingReleases.empty() == false || d_framePushed.load() == false) {
+		return;
+	}
+	for (const auto &layer : d_layers) {
+		for (const auto &input : layer->inputs) {
+			if (input.scheduled() == true && input.still() == false) {
+				return;
+			}
+		}
+	}
+	// a paused live pipeline stops its sources and the mixer, nothing is
+	// composited nor handed to the outputs until wakeUp().
+	d_logger.Info("no moving input scheduled, pausing compositing");
+	gst_element_set_state(d_pipeline.get(), GST_STATE_PAUSED);
+	d_idle = true;
+	d_idleGauge.set(1);
+}
+
+void Compositor::wakeUp() {
+	if (d_idle == false) {
+		return;
+	}
+	d_logger.Info("resuming compositing");
+	d_outputBaseTime.store(GST_CLOCK_TIME_NONE);
+	gst_element_set_state(d_pipeline.get(), GST_STATE_PLAYING);
+	d_idle = false;
+	d_idleGauge.set(0);
+	d_framePushed.store(false);
+}
+
+void Compositor::applyQoS(QoSGovernor::Level level) {
+	using Level = QoSGovernor::Level;
+	// background layers are the ones below the top-most playing layer.
+	size_t top = 0;
+	for (size_t i = 0; i < d_layers.size(); ++i) {
+		if (d_layers[i]->media.has_value()) {
+			top = i;
+		}
+	}
+	for (size_t i = 0; i < d_layers.size(); ++i) {
+		MediaPipeline::Degradation degradation{
+		    .SkipNonReference =
+		        i < top && level >= Level::SKIP_BACKGROUND_FRAMES,
+		    .ReducedResolution = level >= Level::REDUCED_DECODE,
+		};
+		for (auto &input : d_layers[i]->inputs) {
+			input.pipeline->setDegradation(degradation);
+		}
+	}
+
+	setMixSize(level >= Level::REDUCED_MIX ? d_size / 2 : d_size);
+	d_taps->setPreviewEnabled(level < Level::NO_PREVIEW);
+}
+
+void Compositor::setMixSize(QSize size) {
+	if (size == d_mixSize) {
+		return;
+	}
+	d_mixSize = size;
+
+	GstCaps *caps{nullptr};
+	g_object_get(d_mixCaps.get(), "caps", &caps, nullptr);
+	caps = gst_caps_make_writable(caps);
+	gst_caps_set_simple(
+	    caps,
+	    "width",
+	    G_TYPE_INT,
+	    size.width(),
+	    "height",
+	    G_TYPE_INT,
+	    size.height(),
+	    nullptr
+	);
+	// the capsfilter asks the mixer to renegotiate.
+	g_object_set(d_mixCaps.get(), "caps", caps, nullptr);
+	gst_caps_unref(caps);
+
+	for (auto &layer : d_layers) {
+		for (auto &input : layer->inputs) {
+			if (input.scheduled() == false) {
+				continue;
+			}
+			g_object_set(
+			    input.sink.get(),
+			    "width",
+			    size.width(),
+			    "height",
+			    size.height(),
+			    nullptr
+			);
+		}
+	}
 }
 
 void Compositor::start() {
+	d_outputBaseTime.store(GST_CLOCK_TIME_NONE);
 	gst_element_set_state(d_pipeline.get(), GST_STATE_PLAYING);
 }
 
 void Compositor::play(const MediaPlayInfo &media, int layer) {
+	schedule(media, layer, earliestStart());
+}
+
+void Compositor::playAt(
+    const MediaPlayInfo &media, int layer, std::chrono::nanoseconds at
+) {
+	auto earliest = earliestStart();
+	auto start    = nextFrameTime(at);
+	if (start < earliest) {
+		d_logger.Warn(
+		    "requested start has passed, starting as soon as possible",
+		    slog::Duration("requested", at),
+		    slog::Duration("earliest", earliest)
+		);
+		start = earliest;
+	}
+	schedule(media, layer, start);
+}
+
+void Compositor::playAtFrame(
+    const MediaPlayInfo &media, int layer, quint64 frame
+) {
+	playAt(media, layer, frameTime(frame));
+}
+
+std::chrono::nanoseconds Compositor::earliestStart() {
+	return nextFrameTime(outputTime() + d_playAdditionnalLatency);
+}
+
+quint64 Compositor::frameAt(std::chrono::nanoseconds runningTime) const {
+	return gst_util_uint64_scale(
+	    std::max(runningTime, 0ns).count(),
+	    d_fpsNum,
+	    d_fpsDenum * GST_SECOND
+	);
+}
+
+std::chrono::nanoseconds Compositor::frameTime(quint64 frame) const {
+	// rounded up, so frameAt(frameTime(n)) == n at any framerate.
+	return std::chrono::nanoseconds{
+	    gst_util_uint64_scale_ceil(frame, d_fpsDenum * GST_SECOND, d_fpsNum)
+	};
+}
+
+std::chrono::nanoseconds
+Compositor::nextFrameTime(std::chrono::nanoseconds runningTime) const {
+	auto frame = frameAt(runningTime);
+	if (frameTime(frame) < runningTime) {
+		++frame;
+	}
+	return frameTime(frame);
+}
+
+void Compositor::schedule(
+    const MediaPlayInfo &media, int layer, std::chrono::nanoseconds at
+) {
 	auto runningTime = this->runningTime();
-	auto offset      = outputTime();
 	d_logger.Info(
 	    "playing new media",
 	    slog::Duration("running_time", runningTime),
-	    slog::Duration("output_time", offset),
-	    slog::Duration("diff", runningTime - offset)
+	    slog::Duration("start", at),
+	    slog::Duration("diff", at - runningTime)
 	);
-	offset += d_playAdditionnalLatency;
+	// the trigger time is when the command is received.
+	quint32 latencyCode = d_latency != nullptr ? d_latency->trigger() : 0;
 	if (QThread::currentThread() == this->thread()) {
-		this->playUnsafe(media, layer, offset);
+		this->playUnsafe(media, layer, at, latencyCode);
 		return;
 	}
 	QMetaObject::invokeMethod(
@@ -353,8 +1313,325 @@ void Compositor::play(const MediaPlayInfo &media, int layer) {
 	    Qt::QueuedConnection,
 	    media,
 	    layer,
-	    offset
+	    at,
+	    latencyCode
+	);
+}
+
+void Compositor::setEffects(int layer, const LayerEffects &effects) {
+	if (layer < 0 || layer >= d_layers.size()) {
+		d_logger.Error(
+		    "invalid layer",
+		    slog::Int("layer", layer),
+		    slog::Int("layers", d_layers.size())
+		);
+		return;
+	}
+	for (auto &input : d_layers[layer]->inputs) {
+		setEffectUniforms(input.effect.get(), effects);
+	}
+}
+
+Compositor::InputData *
+Compositor::pickInput(LayerData &layer, const MediaPlayInfo &media) {
+	InputData *res = nullptr;
+	for (auto &input : layer.inputs) {
+		if (input.scheduled() == true) {
+			continue;
+		}
+		if (input.prerolled == media) {
+			d_prerollHits.inc();
+			return &input;
+		}
+		// keeps an input prerolled with another media for later.
+		if (res == nullptr || res->prerolled.has_value()) {
+			res = &input;
+		}
+	}
+	if (res != nullptr) {
+		d_prerollMisses.inc();
+	}
+	return res;
+}
+
+void Compositor::preroll(const MediaPlayInfo &media, int layer) {
+	if (QThread::currentThread() == this->thread()) {
+		prerollUnsafe(media, layer);
+		return;
+	}
+	QMetaObject::invokeMethod(
+	    this,
+	    &Compositor::prerollUnsafe,
+	    Qt::QueuedConnection,
+	    media,
+	    layer
+	);
+}
+
+void Compositor::cancelPreroll(int layer) {
+	if (QThread::currentThread() == this->thread()) {
+		cancelPrerollUnsafe(layer);
+		return;
+	}
+	QMetaObject::invokeMethod(
+	    this,
+	    &Compositor::cancelPrerollUnsafe,
+	    Qt::QueuedConnection,
+	    layer
+	);
+}
+
+void Compositor::prerollUnsafe(const MediaPlayInfo &media, int layerIndex) {
+	if (layerIndex < 0 || layerIndex >= d_layers.size()) {
+		d_logger.Error(
+		    "invalid layer",
+		    slog::Int("layer", layerIndex),
+		    slog::Int("layers", d_layers.size())
+		);
+		return;
+	}
+	auto &layer = *d_layers[layerIndex];
+	for (auto &input : layer.inputs) {
+		if (input.prerolled == media) {
+			return;
+		}
+	}
+	cancelPrerollUnsafe(layerIndex);
+
+	auto free = std::find_if(
+	    std::begin(layer.inputs),
+	    std::end(layer.inputs),
+	    [](const InputData &input) { return input.scheduled() == false; }
+	);
+	if (free == std::end(layer.inputs)) {
+		layer.logger.Debug(
+		    "no free input to preroll",
+		    slog::String("media", media.Location.toStdString())
+		);
+		return;
+	}
+	free->logger.Info(
+	    "prerolling media",
+	    slog::String("media", media.Location.toStdString())
+	);
+	free->prerolled = media;
+	free->pipeline->preroll(media);
+}
+
+void Compositor::cancelPrerollUnsafe(int layerIndex) {
+	if (layerIndex < 0 || layerIndex >= d_layers.size()) {
+		return;
+	}
+	for (auto &input : d_layers[layerIndex]->inputs) {
+		if (input.prerolled.has_value() == false) {
+			continue;
+		}
+		input.prerolled.reset();
+		input.pipeline->cancel();
+	}
+}
+
+Compositor::Transaction &
+Compositor::Transaction::play(int layer, const MediaPlayInfo &media) {
+	d_changes.push_back({.Layer = layer, .Media = media});
+	return *this;
+}
+
+Compositor::Transaction &Compositor::Transaction::stop(int layer) {
+	d_changes.push_back({.Layer = layer, .Stop = true});
+	return *this;
+}
+
+Compositor::Transaction &Compositor::Transaction::setOpacity(
+    int layer, qreal opacity, std::chrono::nanoseconds fade
+) {
+	d_changes.push_back({
+	    .Layer   = layer,
+	    .Opacity = std::clamp(opacity, 0.0, 1.0),
+	    .Fade    = std::max(fade, 0ns),
+	});
+	return *this;
+}
+
+const std::vector<Compositor::Transaction::Change> &
+Compositor::Transaction::changes() const {
+	return d_changes;
+}
+
+Compositor::Transaction &
+Compositor::Transaction::at(std::chrono::nanoseconds runningTime) {
+	d_at = runningTime;
+	return *this;
+}
+
+std::chrono::nanoseconds
+Compositor::preroll(const Transaction &transaction) const {
+	std::chrono::nanoseconds res{0};
+	for (const auto &change : transaction.d_changes) {
+		if (change.Media.has_value() == false) {
+			continue;
+		}
+		res = std::max(
+		    res,
+		    std::chrono::nanoseconds{
+		        d_preroll[size_t(change.Media->MediaType)].load()
+		    }
+		);
+	}
+	return res;
+}
+
+std::chrono::nanoseconds Compositor::commit(Transaction transaction) {
+	// the slowest incoming media sets the pace, with two frames of margin.
+	auto earliest = std::max(
+	    earliestStart(),
+	    nextFrameTime(outputTime() + preroll(transaction) + frameTime(2))
+	);
+	auto at = earliest;
+	if (transaction.d_at.has_value()) {
+		at = nextFrameTime(transaction.d_at.value());
+	}
+	if (at < earliest) {
+		d_logger.Warn(
+		    "requested transaction time has passed, committing as soon as "
+		    "possible",
+		    slog::Duration("requested", transaction.d_at.value()),
+		    slog::Duration("earliest", earliest)
+		);
+		at = earliest;
+	}
+
+	if (QThread::currentThread() == this->thread()) {
+		commitUnsafe(std::move(transaction), at);
+		return at;
+	}
+	QMetaObject::invokeMethod(
+	    this,
+	    [this, transaction = std::move(transaction), at]() {
+		    commitUnsafe(transaction, at);
+	    },
+	    Qt::QueuedConnection
 	);
+	return at;
+}
+
+void Compositor::commitUnsafe(
+    Transaction transaction, std::chrono::nanoseconds at
+) {
+	d_logger.Info(
+	    "committing transaction",
+	    slog::Int("changes", transaction.d_changes.size()),
+	    slog::Duration("at", at)
+	);
+	wakeUp();
+	for (const auto &change : transaction.d_changes) {
+		if (change.Layer < 0 || change.Layer >= d_layers.size()) {
+			d_logger.Error(
+			    "invalid layer",
+			    slog::Int("layer", change.Layer),
+			    slog::Int("layers", d_layers.size())
+			);
+			continue;
+		}
+		auto &layer = *d_layers[change.Layer];
+
+		if (change.Opacity.has_value()) {
+			setOpacity(layer, change.Opacity.value(), at, change.Fade);
+		}
+		if (change.Stop == false && change.Media.has_value() == false) {
+			continue;
+		}
+
+		for (auto &input : layer.inputs) {
+			if (input.scheduled() == true && input.retired == false) {
+				retire(input, at);
+			}
+		}
+		layer.media = change.Media;
+		layer.pendingStart.reset();
+		if (change.Media.has_value() == false) {
+			continue;
+		}
+
+		auto free = pickInput(layer, change.Media.value());
+		if (free == nullptr) {
+			// started once a retired input is released.
+			layer.pendingStart = at;
+			continue;
+		}
+		free->playMedia(change.Media.value(), at);
+	}
+	publishState();
+	// the top-most layer may have changed.
+	applyQoS(d_qos.level());
+}
+
+void Compositor::retire(InputData &input, std::chrono::nanoseconds at) {
+	input.retired = true;
+	if (input.offset >= at) {
+		input.logger.Info("cancelling input before it starts");
+		input.pipeline->stop();
+		return;
+	}
+
+	input.logger.Info("retiring input", slog::Duration("at", at));
+	input.setAlpha(at - 1ns, input.layer.opacityAt(at - 1ns));
+	input.setAlpha(at, 0.0);
+	// its frames after at are hidden, it is stopped once the mixer has
+	// output them.
+	auto deadline = gst_element_get_base_time(d_pipeline.get()) +
+	                (at + d_playAdditionnalLatency).count();
+	input.stopID  = gst_clock_new_single_shot_id(d_clock.get(), deadline);
+	gst_clock_id_wait_async(
+	    input.stopID,
+	    GstClockCallback(&Compositor::onRetireTimeout),
+	    &input,
+	    nullptr
+	);
+}
+
+gboolean Compositor::onRetireTimeout(
+    GstClock *clock, GstClockTime time, GstClockID id, InputData *input
+) {
+	QMetaObject::invokeMethod(
+	    &input->layer.compositor,
+	    [input]() {
+		    if (input->retired == true && input->scheduled() == true) {
+			    // a still input may have paused the output.
+			    input->layer.compositor.wakeUp();
+			    input->pipeline->stop();
+		    }
+	    },
+	    Qt::QueuedConnection
+	);
+	return TRUE;
+}
+
+void Compositor::setOpacity(
+    LayerData               &layer,
+    qreal                    opacity,
+    std::chrono::nanoseconds at,
+    std::chrono::nanoseconds fade
+) {
+	// keeps the keyframe in effect at the output for pads linked later.
+	auto current = layer.opacity.upper_bound(outputTime());
+	if (current != layer.opacity.begin()) {
+		layer.opacity.erase(layer.opacity.begin(), std::prev(current));
+	}
+	// keyframes are interpolated, a cut holds the previous value until the
+	// frame just before at.
+	auto from  = fade > 0ns ? at : at - 1ns;
+	auto until = at + fade;
+	auto value = layer.opacityAt(from);
+
+	layer.opacity[from]  = value;
+	layer.opacity[until] = opacity;
+	for (auto &input : layer.inputs) {
+		if (input.alpha != nullptr && input.retired == false) {
+			input.setAlpha(from, value);
+			input.setAlpha(until, opacity);
+		}
+	}
 }
 
 slog::Attribute slogGstSegment(const char *name, const GstSegment &segment) {
@@ -376,11 +1653,38 @@ slog::Attribute slogGstSegment(const char *name, const GstSegment &segment) {
 	);
 }
 
-GstPadProbeReturn Compositor::onSinkEventProbe(
+GstPadProbeReturn Compositor::onSinkProbe(
     GstPad *pad, GstPadProbeInfo *info, InputData *input
 ) {
+	if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) {
+		// the pad can be released once the output has passed the end of
+		// its last buffer.
+		auto buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+		auto end    = GST_BUFFER_PTS(buffer);
+		if (end == GST_CLOCK_TIME_NONE) {
+			return GST_PAD_PROBE_OK;
+		}
+		end += GST_BUFFER_DURATION_IS_VALID(buffer)
+		           ? GST_BUFFER_DURATION(buffer)
+		           : input->layer.compositor.frameTime(1).count();
+		auto runningTime =
+		    gst_segment_to_running_time(&input->segment, GST_FORMAT_TIME, end);
+		if (runningTime != GST_CLOCK_TIME_NONE) {
+			input->lastEnd.store(runningTime);
+		}
+		return GST_PAD_PROBE_OK;
+	}
+
 	auto event = GST_PAD_PROBE_INFO_EVENT(info);
-	if (event == nullptr || GST_EVENT_TYPE(event) != GST_EVENT_EOS) {
+	if (event == nullptr) {
+		return GST_PAD_PROBE_OK;
+	}
+	if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT) {
+		// includes the pad offset of the input.
+		gst_event_copy_segment(event, &input->segment);
+		return GST_PAD_PROBE_OK;
+	}
+	if (GST_EVENT_TYPE(event) != GST_EVENT_EOS) {
 		return GST_PAD_PROBE_OK;
 	}
 
@@ -399,6 +1703,10 @@ GstPadProbeReturn Compositor::onBufferProbe(
 ) {
 	gst_pad_remove_probe(pad, GST_PAD_PROBE_INFO_ID(info));
 	auto &compositor = input->layer.compositor;
+
+	auto &preroll = compositor.d_preroll[size_t(input->type)];
+	auto  sample  = (compositor.outputTime() - input->requested).count();
+	preroll.store(std::max(sample, preroll.load() * 15 / 16));
 	QMetaObject::invokeMethod(
 	    &compositor,
 	    &Compositor::reportTimeToFirstBuffer,
@@ -410,21 +1718,109 @@ GstPadProbeReturn Compositor::onBufferProbe(
 	return GST_PAD_PROBE_OK;
 }
 
+GstPadProbeReturn Compositor::onProxyPushProbe(
+    GstPad *pad, GstPadProbeInfo *info, InputData *input
+) {
+	auto PTS = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+	// the segment is the one seen by the mixer, it precedes any buffer.
+	auto runningTime =
+	    gst_segment_to_running_time(&input->segment, GST_FORMAT_TIME, PTS);
+	trace::mark(
+	    trace::Stage::ProxyPush,
+	    input->layerID,
+	    PTS,
+	    runningTime != GST_CLOCK_TIME_NONE ? int64_t(runningTime) : -1
+	);
+	return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn Compositor::onLatencyProbe(
+    GstPad *pad, GstPadProbeInfo *info, Compositor *self
+) {
+	self->d_latency->onOutputBuffer(GST_PAD_PROBE_INFO_BUFFER(info));
+	return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn Compositor::onMixerOutputProbe(
+    GstPad *pad, GstPadProbeInfo *info, Compositor *self
+) {
+	auto buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+	auto PTS    = GST_BUFFER_PTS(buffer);
+	trace::mark(trace::Stage::MixerAggregate, -1, PTS);
+	if (PTS == GST_CLOCK_TIME_NONE) {
+		return GST_PAD_PROBE_OK;
+	}
+
+	// the mixer segment starts at 0, PTS are running times.
+	auto duration = GST_BUFFER_DURATION_IS_VALID(buffer)
+	                    ? std::chrono::nanoseconds{GST_BUFFER_DURATION(buffer)}
+	                    : self->frameTime(1);
+	self->d_timeline.store({
+	    .Frame    = self->frameNumber(PTS),
+	    .PTS      = std::chrono::nanoseconds{PTS},
+	    .Position = std::chrono::nanoseconds{PTS} + duration,
+	});
+
+	// once aggregated, the frame starting after the last buffer of a pad
+	// no longer needs it.
+	auto next = self->d_nextRelease.load();
+	if (int64_t(PTS) >= next &&
+	    self->d_nextRelease.compare_exchange_strong(
+	        next,
+	        std::numeric_limits<int64_t>::max()
+	    )) {
+		QMetaObject::invokeMethod(
+		    self,
+		    &Compositor::releaseMixerPads,
+		    Qt::QueuedConnection
+		);
+	}
+	return GST_PAD_PROBE_OK;
+}
+
 void Compositor::playUnsafe(
-    const MediaPlayInfo &media, int layerIndex, std::chrono::nanoseconds from
+    const MediaPlayInfo     &media,
+    int                      layerIndex,
+    std::chrono::nanoseconds from,
+    quint32                  latencyCode
 ) {
-	if (layerIndex != 0) {
-		d_logger.Error("only single layer supported");
+	// a rejected play is not a trigger, its code never shows.
+	auto reject = [this, latencyCode]() {
+		if (d_latency != nullptr && latencyCode != 0) {
+			d_latency->cancel(latencyCode);
+		}
+	};
+	if (layerIndex < 0 || layerIndex >= d_layers.size()) {
+		d_logger.Error(
+		    "invalid layer",
+		    slog::Int("layer", layerIndex),
+		    slog::Int("layers", d_layers.size())
+		);
+		reject();
 		return;
 	}
 
 	auto layer = d_layers[layerIndex].get();
 	if (layer->media.has_value()) {
 		d_logger.Error("Error cannot replace playing media");
+		reject();
 		return;
 	}
+	wakeUp();
 	layer->media = media;
-	layer->inputs[0].playMedia(media, from);
+	for (auto &input : layer->inputs) {
+		input.pipeline->setLatencyStamp(latencyCode);
+	}
+	auto input = pickInput(*layer, media);
+	if (input == nullptr) {
+		// inputs retired by a transaction are still running out.
+		layer->pendingStart = from;
+	} else {
+		input->playMedia(media, from);
+	}
+	publishState();
+	// the top-most layer may have changed.
+	applyQoS(d_qos.level());
 }
 
 std::chrono::nanoseconds Compositor::runningTime() {
@@ -433,14 +1829,73 @@ std::chrono::nanoseconds Compositor::runningTime() {
 	};
 }
 
-std::chrono::nanoseconds Compositor::outputTime() {
-	gint64 pos;
-	gst_pad_query_position(d_videoMixerSrc.get(), GST_FORMAT_TIME, &pos);
-	return std::chrono::nanoseconds{pos};
+std::chrono::nanoseconds Compositor::outputTime() const {
+	return d_timeline.load().Position;
+}
+
+CompositorState Compositor::state() const {
+	auto res      = d_state.load();
+	auto timeline = d_timeline.load();
+	res.Frame     = timeline.Frame;
+	res.Position  = timeline.Position;
+	return res;
+}
+
+void Compositor::publishState() {
+	auto state = d_state.load();
+	++state.Version;
+	state.LayerCount = d_layers.size();
+	for (size_t i = 0; i < d_layers.size(); ++i) {
+		const auto &layer  = *d_layers[i];
+		auto       &status = state.Layers[i];
+		status             = {};
+
+		size_t keyframes = 0;
+		for (const auto &[at, value] : layer.opacity) {
+			if (keyframes == CompositorState::MaxKeyframes) {
+				break;
+			}
+			status.Opacity[keyframes++] = {.At = at, .Value = value};
+		}
+		status.Keyframes = keyframes;
+
+		if (layer.media.has_value() == false) {
+			continue;
+		}
+		const auto &media = layer.media.value();
+		auto location     = media.Location.toStdString();
+		location.resize(
+		    std::min(location.size(), status.Location.size() - 1)
+		);
+		std::copy(location.begin(), location.end(), status.Location.begin());
+		// a media waiting for a retired input starts at pendingStart.
+		auto start =
+		    layer.pendingStart.value_or(std::chrono::nanoseconds::max());
+		for (const auto &input : layer.inputs) {
+			if (input.scheduled() == true && input.retired == false) {
+				start = std::min(start, input.offset);
+			}
+		}
+		status.Playing   = true;
+		status.MediaType = media.MediaType;
+		status.Start     = start;
+		status.Duration  = media.Duration;
+		status.Loop      = media.Loop;
+	}
+	d_state.store(state);
+}
+
+Compositor::Timeline Compositor::timeline() const {
+	auto res    = d_timeline.load();
+	res.Latency = std::chrono::nanoseconds{d_outputLatency.load()};
+	return res;
 }
 
 void Compositor::removeMedia(InputData *input) {
 	input->logger.Info("removing input");
+	defer {
+		publishState();
+	};
 	if (gst_pad_unlink(input->src.get(), input->sink.get()) == false) {
 		d_logger.Error(
 		    "could not unlink pads",
@@ -456,22 +1911,54 @@ void Compositor::removeMedia(InputData *input) {
 		return;
 	}
 
-	QTimer::singleShot(
-	    2 * std::chrono::duration_cast<std::chrono::milliseconds>(
-	            runningTime() - outputTime()
-	        )
-	            .count(),
-	    [this, sink = input->sink.release()]() {
-		    d_logger.Info(
-		        "removing videomixer sink",
-		        slog::String("name", (const char *)GST_OBJECT_NAME(sink))
-		    );
-		    gst_element_release_request_pad(d_videoMixer.get(), sink);
-	    }
-	);
+	// the mixer may still hold buffers queued on the pad, it is released
+	// by onMixerOutputProbe() once they have all been output.
+	auto until = std::chrono::nanoseconds{input->lastEnd.load()};
+	d_pendingReleases.push_back({
+	    .Sink  = input->sink.release(),
+	    .Until = until,
+	    .Since = std::chrono::steady_clock::now(),
+	});
+	d_pendingReleasesGauge.set(d_pendingReleases.size());
+	int64_t next = d_nextRelease.load();
+	while (until.count() < next &&
+	       d_nextRelease.compare_exchange_weak(next, until.count()) == false) {
+	}
+
+	input->alpha.reset();
+	if (input->stopID != nullptr) {
+		gst_clock_id_unschedule(input->stopID);
+		gst_clock_id_unref(input->stopID);
+		input->stopID = nullptr;
+	}
 
-	input->sink.reset();
 	auto &media = input->layer.media;
+	if (input->retired == true) {
+		input->retired = false;
+		auto &layer    = input->layer;
+		if (layer.pendingStart.has_value()) {
+			auto start = layer.pendingStart.value();
+			layer.pendingStart.reset();
+			input->playMedia(media.value(), start);
+			return;
+		}
+		if (media.has_value() == false || media.value().Loop == false ||
+		    layer.playing() != 1) {
+			return;
+		}
+		// the layer media could not loop while all inputs were busy.
+		for (const auto &current : layer.inputs) {
+			if (current.scheduled() == true && current.retired == false) {
+				input->playMedia(
+				    media.value(),
+				    current.offset + media->Duration
+				);
+				break;
+			}
+		}
+		return;
+	}
+
 	if (media.value().Loop == false) {
 		media = std::nullopt;
 		return;
@@ -482,11 +1969,51 @@ void Compositor::removeMedia(InputData *input) {
 	input->playMedia(media.value(), loopStart + 2 * media.value().Duration);
 }
 
+void Compositor::releaseMixerPads() {
+	auto output = outputTime();
+	auto now    = std::chrono::steady_clock::now();
+	auto next   = std::numeric_limits<int64_t>::max();
+	std::erase_if(d_pendingReleases, [&](const PendingRelease &pending) {
+		if (pending.Until > output) {
+			next = std::min(next, int64_t(pending.Until.count()));
+			return false;
+		}
+		d_logger.Info(
+		    "removing videomixer sink",
+		    slog::String("name", (const char *)GST_OBJECT_NAME(pending.Sink)),
+		    slog::Duration("waited", now - pending.Since)
+		);
+		d_releaseTime.record(now - pending.Since);
+		gst_element_release_request_pad(d_videoMixer.get(), pending.Sink);
+		gst_object_unref(pending.Sink);
+		return true;
+	});
+	d_pendingReleasesGauge.set(d_pendingReleases.size());
+	// a pad could have been added meanwhile.
+	auto current = d_nextRelease.load();
+	while (next < current &&
+	       d_nextRelease.compare_exchange_weak(current, next) == false) {
+	}
+	// the output must show the removal before going idle.
+	d_framePushed.store(false);
+}
+
 void Compositor::onMessage(GstMessage *msg) noexcept {
 	switch (GST_MESSAGE_TYPE(msg)) {
 	case GST_MESSAGE_EOS:
 		d_logger.Info("EOS", slog::String("src", (const char *)msg->src->name));
 		return;
+	case GST_MESSAGE_ELEMENT:
+		d_taps->handleMessage(msg);
+		return;
+	case GST_MESSAGE_QOS: {
+		gint64 jitter{0};
+		gst_message_parse_qos_values(msg, &jitter, nullptr, nullptr);
+		if (jitter > 0) {
+			reportLate();
+		}
+		return;
+	}
 	case GST_MESSAGE_ERROR: {
 		gchar  *debug{nullptr};
 		GError *err{nullptr};
@@ -526,40 +2053,7 @@ GstBusSyncReply Compositor::onSyncMessage(GstMessage *msg) noexcept {
 	    slog::String("type", contextType),
 	    slog::String("source", (const char *)msg->src->name)
 	);
-	if (g_strcmp0(contextType, GST_GL_DISPLAY_CONTEXT_TYPE) == 0) {
-		GstContext *displayContext =
-		    gst_context_new(GST_GL_DISPLAY_CONTEXT_TYPE, TRUE);
-		gst_context_set_gl_display(displayContext, d_display);
-		gst_element_set_context(GST_ELEMENT(msg->src), displayContext);
-		slog::Debug(
-		    "handled",
-		    slog::String("type", contextType),
-		    slog::String("source", (const char *)msg->src->name),
-		    slog::Pointer("display", d_display)
-		);
-		return GST_BUS_DROP;
-	}
-	if (g_strcmp0(contextType, "gst.gl.app_context") == 0) {
-		d_logger.Debug(
-		    "GstGL Objects",
-		    slog::Pointer("display", d_display),
-		    slog::Pointer("context", d_context)
-		);
-		GstContext   *appContext = gst_context_new("gst.gl.app_context", TRUE);
-		GstStructure *s          = gst_context_writable_structure(appContext);
-		gst_structure_set(
-		    s,
-		    "context",
-		    GST_TYPE_GL_CONTEXT,
-		    d_context,
-		    nullptr
-		);
-		gst_element_set_context(GST_ELEMENT(msg->src), appContext);
-		slog::Debug(
-		    "handled",
-		    slog::String("type", contextType),
-		    slog::String("source", (const char *)msg->src->name)
-		);
+	if (setGLContext(msg, d_display, d_context) == true) {
 		return GST_BUS_DROP;
 	}
 
@@ -567,7 +2061,8 @@ GstBusSyncReply Compositor::onSyncMessage(GstMessage *msg) noexcept {
 }
 
 GstFlowReturn Compositor::onNewSampleCb(GstElement *appsink, Compositor *self) {
-	GstSample *sample = gst_app_sink_pull_sample(GST_APP_SINK_CAST(appsink));
+	trace::Span span{trace::Stage::SampleOut};
+	GstSample  *sample = gst_app_sink_pull_sample(GST_APP_SINK_CAST(appsink));
 
 	if (sample == nullptr) {
 		return GST_FLOW_FLUSHING;
@@ -575,6 +2070,7 @@ GstFlowReturn Compositor::onNewSampleCb(GstElement *appsink, Compositor *self) {
 
 	auto buffer = gst_buffer_ref(gst_sample_get_buffer(sample));
 	gst_sample_unref(sample);
+	span.setPTS(GST_BUFFER_PTS(buffer));
 
 	if (self->d_gstContext == nullptr) {
 		auto mem = gst_buffer_peek_memory(buffer, 0);
@@ -584,9 +2080,11 @@ GstFlowReturn Compositor::onNewSampleCb(GstElement *appsink, Compositor *self) {
 		gst_object_ref(self->d_gstContext.get());
 	}
 
-	if (self->d_infos.has_value() == false) {
+	auto meta = gst_buffer_get_video_meta(buffer);
+	if (self->d_infos.has_value() == false ||
+	    self->d_infos.value().width != meta->width ||
+	    self->d_infos.value().height != meta->height) {
 		self->d_infos = GstVideoInfo{};
-		auto meta     = gst_buffer_get_video_meta(buffer);
 		gst_video_info_set_format(
 		    &(self->d_infos.value()),
 		    meta->format,
@@ -612,6 +2110,7 @@ GstFlowReturn Compositor::onNewSampleCb(GstElement *appsink, Compositor *self) {
 	auto frame =
 	    Frame::Ptr{self->d_pool->Get([](Frame *frame) { frame->unmap(); })};
 	auto allocated = self->d_pool->PoolSize();
+	self->d_framesAllocated.set(allocated);
 	if (allocated < 10) {
 		self->d_logger.DTrace(
 		    "GstVideoFrame allocation",
@@ -641,6 +2140,21 @@ GstFlowReturn Compositor::onNewSampleCb(GstElement *appsink, Compositor *self) {
 	}
 	gst_buffer_unref(buffer); // frame holds a ref from here
 
+	trace::mark(trace::Stage::Handoff, -1, frame->PTS().count());
+	// the clock and a cached base time, querying the running time of the
+	// pipeline locks it on every frame.
+	auto baseTime = self->d_outputBaseTime.load();
+	if (baseTime == GST_CLOCK_TIME_NONE) {
+		baseTime = gst_element_get_base_time(appsink);
+		self->d_outputBaseTime.store(baseTime);
+	}
+	auto now = gst_clock_get_time(self->d_clock.get());
+	self->d_outputLatency.store(
+	    int64_t(now - baseTime) - frame->PTS().count()
+	);
+	self->d_framesTotal.inc();
+	self->d_qos.reportFrame();
+	self->d_framePushed.store(true);
 	emit self->newFrame(frame);
 
 	return GST_FLOW_OK;
@@ -662,6 +2176,7 @@ void Compositor::reportTimeToFirstBuffer(
 	    slog::Duration("running_time", std::chrono::nanoseconds{runningTime}),
 	    slog::Duration("delay", std::chrono::nanoseconds{runningTime - start})
 	);
+	d_timeToFirstBuffer.record(std::chrono::nanoseconds{runningTime - start});
 }
 
 } // namespace yams
@@ -1,7 +1,16 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <future>
+#include <limits>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
 
+#include <QImage>
 #include <QObject>
 #include <QSize>
 
@@ -14,59 +23,246 @@
 #include <qtypes.h>
 #include <slog++/Logger.hpp>
 
+#include "CompositorState.hpp"
 #include "Frame.hpp"
+#include "LatencyProbe.hpp"
+#include "LayerEffects.hpp"
 #include "MediaPlayInfo.hpp"
+#include "OutputTaps.hpp"
+#include "PixelMap.hpp"
+#include "QoSGovernor.hpp"
 #include <yams/gstreamer/Memory.hpp>
 #include <yams/gstreamer/Pipeline.hpp>
+#include <yams/utils/Metrics.hpp>
 #include <yams/utils/ObjectPool.hpp>
+#include <yams/utils/SeqLock.hpp>
 
 namespace yams {
 using namespace std::chrono_literals;
 
+class PixelMapper;
+
 class Compositor : public yams::Pipeline {
 	struct LayerData;
 	struct InputData;
 	Q_OBJECT
 public:
+	using PreviewOptions = OutputTaps::PreviewOptions;
+	using RecordOptions  = OutputTaps::RecordOptions;
+
+	// previewFrame() and grab() source of the program output, layers use
+	// their index.
+	constexpr static int Program = OutputTaps::Program;
+
 	struct Options {
 
 		QSize                    Size    = {1920, 1080};
 		size_t                   Layers  = 1;
 		qreal                    FPS     = 60;
 		std::chrono::nanoseconds Latency = 100ms;
+		// When false, frames are produced as fast as the pipeline allows
+		// instead of being paced by the clock at FPS. Only meaningful
+		// without a display, e.g. for benchmarks.
+		bool Throttled = true;
+		// Stamps test sources and decodes the output to measure the
+		// latency of play(), see LatencyProbe.
+		bool MeasureLatency = false;
+		// Pauses the pipeline while no input is scheduled, or only images
+		// already shown, outputs keep presenting the last frame. play()
+		// and grab() resume it.
+		bool IdlePause = true;
+		// Reads back one output frame every ChecksumEvery and emits its
+		// CRC-32, for regression tests. Checksums are dropped rather than
+		// delaying the output. 0 disables it.
+		size_t ChecksumEvery = 0;
+		// Remaps the output for LED processors, see PixelMap. Mapped
+		// frames are emitted by pixelMapFrame() for screen outputs.
+		std::optional<yams::PixelMap> PixelMapping;
+		// Taps the program output and each layer for previews. Their
+		// branches drop frames rather than wait, and stop at the NO_PREVIEW
+		// QoS level.
+		std::optional<PreviewOptions> Preview;
+		// Records the output behind a leaky queue: an encoder falling
+		// behind drops frames from the recording, never from the output.
+		std::optional<RecordOptions> Record;
+		// Enables grab(), with a readback branch on the output and on each
+		// layer that drops every frame while no grab is pending.
+		bool Grab = false;
 	};
 
 	struct Args {
 		GstGLDisplay *Display;
 		GstGLContext *Context;
 		QObject      *Parent;
+		// Pipeline clock, the system clock if nullptr. Tests use a
+		// GstTestClock.
+		GstClock *Clock = nullptr;
 	};
 
 	Compositor(Options options, Args args);
 	virtual ~Compositor();
 
+	std::chrono::nanoseconds runningTime();
+
+	struct Timeline {
+		// last frame aggregated by the mixer.
+		quint64                  Frame = 0;
+		std::chrono::nanoseconds PTS{0};
+		// end of that frame, where the next one starts.
+		std::chrono::nanoseconds Position{0};
+		// running time at which the last frame reached the outputs, minus
+		// its PTS.
+		std::chrono::nanoseconds Latency{0};
+	};
+
+	/// Output progress, updated for each frame. Lock-free, callable from
+	/// any thread.
+	Timeline timeline() const;
+
+	/// Layers and output position. Lock-free, callable from any thread at
+	/// any rate.
+	CompositorState state() const;
+
+	/// Earliest running time a play request made now can start at, on an
+	/// output frame boundary. Thread safe.
+	std::chrono::nanoseconds earliestStart();
+
+	/// Output frame displayed at a running time.
+	quint64 frameAt(std::chrono::nanoseconds runningTime) const;
+	/// Running time at which an output frame starts.
+	std::chrono::nanoseconds frameTime(quint64 frame) const;
+
+	/// nullptr unless Options::MeasureLatency is set.
+	LatencyProbe *latencyProbe();
+
+	/// Reports a buffer or frame that missed its deadline. Thread safe.
+	void reportLate();
+
+	QoSGovernor::Level qosLevel() const;
+
+	QSize outputSize() const;
+
+	struct InputState {
+		bool                     Scheduled = false;
+		std::chrono::nanoseconds Offset{0};
+		// a media is decoded up to its first frame, waiting to be played.
+		bool Prerolled = false;
+	};
+
+	/// Scheduling state of the inputs of a layer. Must be called from the
+	/// compositor thread.
+	std::vector<InputState> inputStates(size_t layer) const;
+
+	/// Output frames allocated by the pool, in use or not.
+	size_t framesAllocated() const;
+
+	/// Mixer sink pads unlinked but not released yet. Must be called from
+	/// the compositor thread.
+	size_t pendingReleases() const;
+
+	/// Layer changes applied together on the same output frame.
+	class Transaction {
+	public:
+		/// Starts a media, replacing the current one of the layer.
+		Transaction &play(int layer, const MediaPlayInfo &media);
+		/// Cuts the current media of the layer.
+		Transaction &stop(int layer);
+		/// Opacity of the layer, in [0,1], reached linearly over fade.
+		Transaction &setOpacity(
+		    int layer, qreal opacity, std::chrono::nanoseconds fade = 0ns
+		);
+		/// Output running time to apply the changes at. By default, the
+		/// earliest time every incoming media can preroll for.
+		Transaction &at(std::chrono::nanoseconds runningTime);
+
+		struct Change {
+			int                          Layer;
+			std::optional<MediaPlayInfo> Media;
+			bool                         Stop = false;
+			std::optional<qreal>         Opacity;
+			std::chrono::nanoseconds     Fade{0};
+		};
+
+		const std::vector<Change> &changes() const;
+
+	private:
+		friend class Compositor;
+		std::vector<Change>                     d_changes;
+		std::optional<std::chrono::nanoseconds> d_at;
+	};
+
+	/// Schedules all changes of a transaction on one output frame, and
+	/// returns its running time. Thread safe.
+	std::chrono::nanoseconds commit(Transaction transaction);
+
+	/// Adjusts the image of a layer from the next composited frame on,
+	/// whatever it plays. Thread safe.
+	void setEffects(int layer, const LayerEffects &effects);
+
+	/// Replaces the slices of Options::PixelMapping, from the next frame on.
+	/// Thread safe.
+	/// @throws cpptrace::logic_error without a pixel mapping.
+	/// @throws cpptrace::invalid_argument if the map changes the outputs.
+	void setPixelMap(PixelMap map);
+
+	/// Reads back a frame of a source, Program or a layer, at size or at
+	/// its own size if empty. Program grabs wait for the output frame, or
+	/// the next one. The copy goes through pixel buffer objects and never
+	/// stalls the output. An idle compositor, see Options::IdlePause, is
+	/// resumed to serve it. Thread safe.
+	/// @throws cpptrace::logic_error without Options::Grab.
+	/// @throws cpptrace::invalid_argument for an unknown source.
+	std::future<QImage> grab(int source, QSize size = {}, quint64 frame = 0);
+
 public slots:
 	void start();
 	void play(const MediaPlayInfo &media, int layer);
+	// Starts on the first output frame at or after a running time, or at
+	// earliestStart() if it has already passed. Requests for the same time
+	// on several layers start on the same frame.
+	void playAt(
+	    const MediaPlayInfo &media, int layer, std::chrono::nanoseconds at
+	);
+	void playAtFrame(const MediaPlayInfo &media, int layer, quint64 frame);
+	// Decodes a media up to its first frame on the spare input of a layer,
+	// a later play or transaction of the same media on that layer then
+	// starts without opening it. At most one media is prerolled per layer.
+	void preroll(const MediaPlayInfo &media, int layer);
+	void cancelPreroll(int layer);
 	void stop();
 
 private slots:
 	void playUnsafe(
-	    const MediaPlayInfo &media, int layer, std::chrono::nanoseconds from
+	    const MediaPlayInfo     &media,
+	    int                      layer,
+	    std::chrono::nanoseconds from,
+	    quint32                  latencyCode
 	);
 
+	void prerollUnsafe(const MediaPlayInfo &media, int layer);
+	void cancelPrerollUnsafe(int layer);
+
 	void removeMedia(InputData *layer);
 	void reportTimeToFirstBuffer(qint64 runningTime, qint64 PTS, qint64 start);
+	void updateQoS();
 signals:
 	void newFrame(yams::Frame::Ptr frame);
 	void outputSizeChanged(QSize size);
+	void qosLevelChanged(yams::QoSGovernor::Level level);
+	// emitted from the streaming thread, see Options::ChecksumEvery.
+	void frameChecksum(quint64 frame, quint32 crc);
+	// the pixel map atlas, see Options::PixelMapping.
+	void pixelMapFrame(yams::Frame::Ptr frame);
+	// emitted from the streaming threads, at most at the preview FPS. source
+	// is Program or a layer.
+	void previewFrame(int source, QImage image);
 
 protected:
 	void            onMessage(GstMessage *msg) noexcept override;
 	GstBusSyncReply onSyncMessage(GstMessage *msg) noexcept override;
 
 private:
-	static GstPadProbeReturn onSinkEventProbe(
+	static GstPadProbeReturn onSinkProbe(
 	    GstPad *pad, GstPadProbeInfo *info, Compositor::InputData *layer
 	);
 
@@ -74,12 +270,70 @@ private:
 	    GstPad *pad, GstPadProbeInfo *info, Compositor::InputData *layer
 	);
 
+	static GstPadProbeReturn onProxyPushProbe(
+	    GstPad *pad, GstPadProbeInfo *info, Compositor::InputData *layer
+	);
+
+	static GstPadProbeReturn
+	onMixerOutputProbe(GstPad *pad, GstPadProbeInfo *info, Compositor *self);
+
+	static GstPadProbeReturn
+	onLatencyProbe(GstPad *pad, GstPadProbeInfo *info, Compositor *self);
+
 	static GstFlowReturn onNewSampleCb(GstElement *appsink, Compositor *self);
 
+	static gboolean onPixelMapDraw(
+	    GstElement *filter,
+	    guint       texture,
+	    guint       width,
+	    guint       height,
+	    Compositor *self
+	);
+	static GstFlowReturn
+	onPixelMapSampleCb(GstElement *appsink, Compositor *self);
+
+	void releaseMixerPads();
+
+	static gboolean onRetireTimeout(
+	    GstClock *clock, GstClockTime time, GstClockID id, InputData *input
+	);
+	void commitUnsafe(Transaction transaction, std::chrono::nanoseconds at);
+	void retire(InputData &input, std::chrono::nanoseconds at);
+	void setOpacity(
+	    LayerData               &layer,
+	    qreal                    opacity,
+	    std::chrono::nanoseconds at,
+	    std::chrono::nanoseconds fade
+	);
+	std::chrono::nanoseconds preroll(const Transaction &transaction) const;
+
 	void buildLayers(const Options &options);
+	void addHeartbeat(int num, int denum);
+	GstElement *addOutputTee(GstElement *upstream);
+	void        addPixelMapBranch(const PixelMap &map, bool throttled);
+	void        addSharedMemoryOutput(const PixelMap &map, size_t output);
 
-	std::chrono::nanoseconds runningTime();
-	std::chrono::nanoseconds outputTime();
+	quint64 frameNumber(GstClockTime PTS) const;
+	// start of the first output frame at or after a running time.
+	std::chrono::nanoseconds
+	nextFrameTime(std::chrono::nanoseconds runningTime) const;
+
+	void schedule(
+	    const MediaPlayInfo &media, int layer, std::chrono::nanoseconds at
+	);
+	// a free input of the layer, the one prerolled with media if any.
+	InputData *pickInput(LayerData &layer, const MediaPlayInfo &media);
+
+	void applyQoS(QoSGovernor::Level level);
+	void setMixSize(QSize size);
+
+	// must be called after any change of the layers.
+	void publishState();
+
+	void updateIdle();
+	void wakeUp();
+
+	std::chrono::nanoseconds outputTime() const;
 
 	slog::Logger<1> d_logger;
 
@@ -90,15 +344,64 @@ private:
 	GstGLContextPtr             d_gstContext{nullptr};
 	std::optional<GstVideoInfo> d_infos;
 
-	GstElementPtr d_blacksrc, d_videoMixer;
+	GstElementPtr d_heartbeat, d_videoMixer, d_mixCaps, d_outputTee;
 	GstPadPtr     d_videoMixerSrc;
 
 	using FramePool = ObjectPool<Frame>;
 	FramePool::Ptr d_pool;
 
-	QSize                                   d_size;
+	QSize                                   d_size, d_mixSize;
 	std::vector<std::unique_ptr<LayerData>> d_layers;
 	GstClockPtr                             d_clock;
+	std::unique_ptr<LatencyProbe>           d_latency;
+
+	metrics::Counter   &d_framesTotal;
+	metrics::Gauge     &d_framesAllocated;
+	metrics::Histogram &d_timeToFirstBuffer;
+
+	QoSGovernor       d_qos;
+	metrics::Counter &d_qosLate, &d_qosDegraded, &d_qosRecovered;
+	metrics::Gauge   &d_qosLevel;
+
+	bool              d_idlePause, d_idle{false};
+	std::atomic<bool> d_framePushed{false};
+	metrics::Gauge   &d_idleGauge;
+
+	// mixer sink pads waiting for their last buffer to be output.
+	struct PendingRelease {
+		GstPad                               *Sink;
+		std::chrono::nanoseconds              Until;
+		std::chrono::steady_clock::time_point Since;
+	};
+
+	std::vector<PendingRelease> d_pendingReleases;
+	// earliest Until of d_pendingReleases, checked on each output buffer.
+	std::atomic<int64_t> d_nextRelease{std::numeric_limits<int64_t>::max()};
+	metrics::Gauge      &d_pendingReleasesGauge;
+	metrics::Histogram  &d_releaseTime;
+
+	int64_t d_fpsNum, d_fpsDenum;
+
+	std::unique_ptr<PixelMapper> d_pixelMapper;
+	GstElementPtr                d_pixelMapTee;
+	FramePool::Ptr               d_pixelMapPool;
+	std::optional<GstVideoInfo>  d_pixelMapInfos;
+
+	std::unique_ptr<OutputTaps> d_taps;
+
+	// written by the mixer output probe only, Latency is kept apart.
+	SeqLock<Timeline>    d_timeline;
+	std::atomic<int64_t> d_outputLatency{0};
+	// base time of the appsink, read on the first sample after each switch
+	// to PLAYING, which picks a new one.
+	std::atomic<GstClockTime> d_outputBaseTime{GST_CLOCK_TIME_NONE};
+	// written by the compositor thread only.
+	SeqLock<CompositorState> d_state;
+
+	// slowly decaying maximum of the time to first buffer, per media type.
+	std::array<std::atomic<int64_t>, 3> d_preroll{};
+
+	metrics::Counter &d_prerollHits, &d_prerollMisses;
 };
 
 } // namespace yams
@@ -0,0 +1,64 @@
+#include "CompositorState.hpp"
+
+#include <algorithm>
+
+namespace yams {
+
+std::string_view CompositorState::Layer::location() const {
+	return {Location.data()};
+}
+
+std::chrono::nanoseconds
+CompositorState::Layer::position(std::chrono::nanoseconds at) const {
+	if (Playing == false || at < Start) {
+		return 0ns;
+	}
+	auto res = at - Start;
+	if (Loop == true && Duration > 0ns) {
+		return res % Duration;
+	}
+	return std::min(res, Duration);
+}
+
+std::chrono::nanoseconds
+CompositorState::Layer::remaining(std::chrono::nanoseconds at) const {
+	if (Playing == false) {
+		return 0ns;
+	}
+	return Duration - position(at);
+}
+
+double CompositorState::Layer::opacity(std::chrono::nanoseconds at) const {
+	if (Keyframes == 0) {
+		return 1.0;
+	}
+	auto before = [](std::chrono::nanoseconds t, const Keyframe &key) {
+		return t < key.At;
+	};
+	auto begin = Opacity.begin();
+	auto end   = Opacity.begin() + Keyframes;
+	auto it    = std::upper_bound(begin, end, at, before);
+	if (it == begin) {
+		return it->Value;
+	}
+	auto prev = std::prev(it);
+	if (it == end) {
+		return prev->Value;
+	}
+	return prev->Value + (it->Value - prev->Value) *
+	                         double((at - prev->At).count()) /
+	                         double((it->At - prev->At).count());
+}
+
+bool CompositorState::Layer::fading(std::chrono::nanoseconds at) const {
+	for (size_t i = 1; i < Keyframes; ++i) {
+		if (Opacity[i - 1].At <= at && at < Opacity[i].At) {
+			// a cut is two keyframes 1ns apart.
+			return Opacity[i].At - Opacity[i - 1].At > 1ns &&
+			       Opacity[i].Value != Opacity[i - 1].Value;
+		}
+	}
+	return false;
+}
+
+} // namespace yams
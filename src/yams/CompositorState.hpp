@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "MediaPlayInfo.hpp"
+
+namespace yams {
+
+/// Snapshot of the compositor layers, see Compositor::state().
+///
+/// It is a plain value, trivially copyable so it is published through a
+/// SeqLock: readers get a consistent copy without ever contending with the
+/// compositor or the output path. Version changes with the layers, Frame
+/// with the output.
+struct CompositorState {
+	constexpr static size_t MaxLayers    = 3;
+	constexpr static size_t MaxKeyframes = 4;
+
+	struct Keyframe {
+		std::chrono::nanoseconds At{0};
+		double                   Value = 1.0;
+	};
+
+	struct Layer {
+		bool                Playing   = false;
+		MediaPlayInfo::Type MediaType = MediaPlayInfo::Type::VIDEO;
+		// truncated, NUL terminated.
+		std::array<char, 256> Location{};
+		// running time of the first frame of the media, or of a loop.
+		std::chrono::nanoseconds Start{0};
+		std::chrono::nanoseconds Duration{0};
+		bool                     Loop = false;
+
+		// first opacity keyframes, linearly interpolated.
+		size_t                             Keyframes = 0;
+		std::array<Keyframe, MaxKeyframes> Opacity{};
+
+		std::string_view location() const;
+		/// Time into the media at a running time, into the current
+		/// iteration for a looping one.
+		std::chrono::nanoseconds position(std::chrono::nanoseconds at) const;
+		std::chrono::nanoseconds remaining(std::chrono::nanoseconds at) const;
+		double                   opacity(std::chrono::nanoseconds at) const;
+		bool                     fading(std::chrono::nanoseconds at) const;
+	};
+
+	uint64_t Version = 0;
+	// last output frame when the snapshot was read.
+	uint64_t                 Frame = 0;
+	std::chrono::nanoseconds Position{0};
+
+	size_t                       LayerCount = 0;
+	std::array<Layer, MaxLayers> Layers{};
+};
+
+} // namespace yams
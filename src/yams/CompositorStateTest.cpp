@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+
+#include "CompositorState.hpp"
+
+namespace yams {
+
+class CompositorStateTest : public ::testing::Test {
+protected:
+	CompositorState::Layer layer{
+	    .Playing  = true,
+	    .Location = {'a', '.', 'm', 'p', '4'},
+	    .Start    = 1s,
+	    .Duration = 400ms,
+	};
+};
+
+TEST_F(CompositorStateTest, Position) {
+	EXPECT_EQ(layer.location(), "a.mp4");
+	EXPECT_EQ(layer.position(500ms), 0ns);
+	EXPECT_EQ(layer.position(1100ms), 100ms);
+	EXPECT_EQ(layer.remaining(1100ms), 300ms);
+	EXPECT_EQ(layer.position(2s), 400ms);
+	EXPECT_EQ(layer.remaining(2s), 0ns);
+
+	layer.Loop = true;
+	EXPECT_EQ(layer.position(2100ms), 300ms);
+	EXPECT_EQ(layer.remaining(2100ms), 100ms);
+
+	layer.Playing = false;
+	EXPECT_EQ(layer.remaining(1100ms), 0ns);
+}
+
+TEST_F(CompositorStateTest, Opacity) {
+	EXPECT_EQ(layer.opacity(1s), 1.0);
+	EXPECT_FALSE(layer.fading(1s));
+
+	// a cut to 0.5 at 1s, then a fade to 0 over 1s at 2s.
+	layer.Keyframes = 4;
+	layer.Opacity   = {{
+	    {.At = 1s - 1ns, .Value = 1.0},
+	    {.At = 1s, .Value = 0.5},
+	    {.At = 2s, .Value = 0.5},
+	    {.At = 3s, .Value = 0.0},
+	}};
+	EXPECT_EQ(layer.opacity(0s), 1.0);
+	EXPECT_EQ(layer.opacity(1s), 0.5);
+	EXPECT_FALSE(layer.fading(1s - 1ns));
+	EXPECT_FALSE(layer.fading(1500ms));
+	EXPECT_DOUBLE_EQ(layer.opacity(2500ms), 0.25);
+	EXPECT_TRUE(layer.fading(2500ms));
+	EXPECT_EQ(layer.opacity(4s), 0.0);
+	EXPECT_FALSE(layer.fading(4s));
+}
+
+} // namespace yams
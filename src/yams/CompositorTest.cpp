@@ -0,0 +1,779 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <QCoreApplication>
+
+#include <cpptrace/exceptions.hpp>
+
+#include <gst/check/gsttestclock.h>
+#include <gst/gstelementfactory.h>
+
+#include "HeadlessCompositor.hpp"
+
+namespace yams {
+
+// Drives a HeadlessCompositor from a GstTestClock: time only moves when the
+// test cranks the clock, so scheduling is checked frame by frame.
+class CompositorTest : public ::testing::Test {
+protected:
+	static constexpr std::chrono::nanoseconds FrameDuration = 40ms;
+
+	GstClockPtr                         clock;
+	std::unique_ptr<HeadlessCompositor> headless;
+
+	std::mutex                                         mutex;
+	std::vector<std::chrono::nanoseconds>              PTS;
+	std::vector<std::chrono::steady_clock::time_point> arrivals;
+
+	virtual Compositor::Options options() const {
+		return {
+		    .Size      = {320, 180},
+		    .Layers    = 2,
+		    .FPS       = 25,
+		    .IdlePause = false,
+		};
+	}
+
+	// element factories the compositor makes, with the options().
+	virtual std::vector<std::string> requiredElements() const {
+		return {
+		    "appsink",        "capsfilter",   "decodebin",   "filesrc",
+		    "glcolorconvert", "glcolorscale", "gldownload",  "glfilterapp",
+		    "glshader",       "gltestsrc",    "glupload",    "glvideomixer",
+		    "proxysink",      "proxysrc",     "queue",       "shmsink",
+		    "tee",            "timeoverlay",  "videotestsrc",
+		};
+	}
+
+	// only a missing plugin or GL skips, any other construction error
+	// fails the test.
+	void SetUp() override {
+		std::string missing;
+		for (const auto &name : requiredElements()) {
+			auto factory = gst_element_factory_find(name.c_str());
+			if (factory == nullptr) {
+				missing += " " + name;
+				continue;
+			}
+			gst_object_unref(factory);
+		}
+		if (missing.empty() == false) {
+			GTEST_SKIP() << "missing elements:" << missing;
+		}
+		if (auto reason = HeadlessCompositor::glUnavailable();
+		    reason.has_value()) {
+			GTEST_SKIP() << "no GL context: " << reason.value();
+		}
+
+		clock.reset(gst_test_clock_new());
+		headless = std::make_unique<HeadlessCompositor>(options(), clock.get());
+		QObject::connect(
+		    compositor(),
+		    &Compositor::newFrame,
+		    compositor(),
+		    [this](Frame::Ptr frame) {
+			    std::lock_guard lock{mutex};
+			    PTS.push_back(frame->PTS());
+			    arrivals.push_back(std::chrono::steady_clock::now());
+		    },
+		    Qt::DirectConnection
+		);
+		compositor()->start();
+	}
+
+	void TearDown() override {
+		if (headless == nullptr) {
+			return;
+		}
+		compositor()->stop();
+		headless.reset();
+	}
+
+	Compositor *compositor() {
+		return headless->compositor();
+	}
+
+	GstTestClock *testClock() {
+		return GST_TEST_CLOCK(clock.get());
+	}
+
+	// Cranks the clock from one pending wait to the next, delivering
+	// queued calls in between, until duration has elapsed.
+	void advance(std::chrono::nanoseconds duration) {
+		auto until = gst_clock_get_time(clock.get()) + duration.count();
+		while (gst_clock_get_time(clock.get()) < until) {
+			QCoreApplication::processEvents();
+			if (gst_test_clock_timed_wait_for_multiple_pending_ids(
+			        testClock(),
+			        1,
+			        1000,
+			        nullptr
+			    ) == false) {
+				ADD_FAILURE() << "pipeline stalled at "
+				              << gst_clock_get_time(clock.get());
+				return;
+			}
+			if (gst_test_clock_get_next_entry_time(testClock()) > until) {
+				gst_test_clock_set_time(testClock(), until);
+			} else {
+				gst_test_clock_crank(testClock());
+			}
+		}
+		QCoreApplication::processEvents();
+	}
+
+	std::vector<std::chrono::nanoseconds> outputPTS() {
+		std::lock_guard lock{mutex};
+		return PTS;
+	}
+
+	// Checks that at least atLeast frames were output, one frame apart.
+	void expectContinuousOutput(size_t atLeast = 2) {
+		auto pts = outputPTS();
+		ASSERT_GE(pts.size(), atLeast);
+		for (size_t i = 1; i < pts.size(); ++i) {
+			EXPECT_EQ(pts[i] - pts[i - 1], FrameDuration) << "at frame " << i;
+		}
+	}
+
+	// Longest wall-clock time between two output frames, from frame since
+	// on. The clock is only cranked once the output waits on it, a branch
+	// blocking the output stretches it.
+	std::chrono::nanoseconds longestOutputGap(size_t since) {
+		std::lock_guard          lock{mutex};
+		std::chrono::nanoseconds res{0};
+		for (size_t i = std::max<size_t>(since, 1); i < arrivals.size(); ++i) {
+			res = std::max<std::chrono::nanoseconds>(
+			    res,
+			    arrivals[i] - arrivals[i - 1]
+			);
+		}
+		return res;
+	}
+
+	static MediaPlayInfo testMedia(
+	    const QString &pattern, std::chrono::nanoseconds duration, bool loop
+	) {
+		return {
+		    .MediaType = MediaPlayInfo::Type::TEST,
+		    .Location  = pattern,
+		    .Duration  = duration,
+		    .Loop      = loop,
+		};
+	}
+
+	std::vector<std::chrono::nanoseconds> scheduledOffsets(size_t layer) {
+		std::vector<std::chrono::nanoseconds> res;
+		for (const auto &input : compositor()->inputStates(layer)) {
+			if (input.Scheduled == true) {
+				res.push_back(input.Offset);
+			}
+		}
+		return res;
+	}
+
+	void play(
+	    std::chrono::nanoseconds duration,
+	    bool                     loop,
+	    int                      layer   = 0,
+	    const QString           &pattern = "smpte"
+	) {
+		compositor()->play(testMedia(pattern, duration, loop), layer);
+	}
+};
+
+TEST_F(CompositorTest, OutputPTSIsContinuous) {
+	advance(200ms);
+	play(300ms, true);
+	advance(2s);
+
+	expectContinuousOutput(41);
+}
+
+TEST_F(CompositorTest, TimelineFollowsTheOutput) {
+	advance(500ms);
+	auto pts      = outputPTS();
+	auto timeline = compositor()->timeline();
+	ASSERT_FALSE(pts.empty());
+	// the mixer output is ahead of the appsink by the queue only.
+	EXPECT_GE(timeline.PTS, pts.back());
+	EXPECT_EQ(timeline.Frame, timeline.PTS / FrameDuration);
+	EXPECT_EQ(timeline.Position, timeline.PTS + FrameDuration);
+}
+
+TEST_F(CompositorTest, StateSnapshotFollowsLayers) {
+	auto initial = compositor()->state();
+	EXPECT_EQ(initial.LayerCount, 2);
+	EXPECT_FALSE(initial.Layers[0].Playing);
+
+	advance(200ms);
+	play(1s, true, 0, "ball");
+	advance(FrameDuration);
+	auto state = compositor()->state();
+	EXPECT_GT(state.Version, initial.Version);
+	ASSERT_TRUE(state.Layers[0].Playing);
+	EXPECT_EQ(state.Layers[0].location(), "ball");
+	EXPECT_EQ(state.Layers[0].Start, scheduledOffsets(0).at(0));
+	EXPECT_FALSE(state.Layers[1].Playing);
+
+	advance(1500ms);
+	state = compositor()->state();
+	EXPECT_GT(state.Frame, 40);
+	EXPECT_LT(state.Layers[0].position(state.Position), 1s);
+}
+
+TEST_F(CompositorTest, LoopsAreScheduledOnDurationMultiples) {
+	constexpr auto duration = 280ms;
+	advance(200ms);
+	play(duration, true);
+	advance(FrameDuration);
+
+	auto first = compositor()->inputStates(0).at(0);
+	ASSERT_TRUE(first.Scheduled);
+
+	auto latest = first.Offset;
+	for (int i = 0; i < 10; ++i) {
+		advance(duration);
+		for (const auto &input : compositor()->inputStates(0)) {
+			if (input.Scheduled == false) {
+				continue;
+			}
+			EXPECT_EQ((input.Offset - first.Offset) % duration, 0ns);
+			latest = std::max(latest, input.Offset);
+		}
+	}
+	EXPECT_GE(latest - first.Offset, 8 * duration);
+}
+
+TEST_F(CompositorTest, FramePoolStaysBounded) {
+	advance(200ms);
+	play(200ms, true, 0);
+	play(120ms, true, 1);
+	advance(1s);
+	auto allocated = compositor()->framesAllocated();
+	advance(4s);
+	EXPECT_EQ(compositor()->framesAllocated(), allocated);
+	EXPECT_LE(allocated, 4);
+}
+
+TEST_F(CompositorTest, ReleasesMixerPadsAfterEOS) {
+	advance(200ms);
+	play(200ms, false);
+	advance(FrameDuration);
+	EXPECT_TRUE(compositor()->inputStates(0).at(0).Scheduled);
+
+	advance(1s);
+	for (const auto &input : compositor()->inputStates(0)) {
+		EXPECT_FALSE(input.Scheduled);
+	}
+	EXPECT_EQ(compositor()->pendingReleases(), 0);
+}
+
+TEST_F(CompositorTest, PlayAtAlignsLayersOnAFrame) {
+	advance(200ms);
+	auto earliest = compositor()->earliestStart();
+	EXPECT_EQ(
+	    compositor()->frameTime(compositor()->frameAt(earliest)),
+	    earliest
+	);
+
+	auto frame = compositor()->frameAt(earliest) + 10;
+	auto start = compositor()->frameTime(frame);
+	compositor()->playAt(
+	    {.MediaType = MediaPlayInfo::Type::TEST,
+	     .Location  = "smpte",
+	     .Duration  = 1s},
+	    0,
+	    start - 13ms
+	);
+	compositor()->playAtFrame(
+	    {.MediaType = MediaPlayInfo::Type::TEST,
+	     .Location  = "ball",
+	     .Duration  = 1s},
+	    1,
+	    frame
+	);
+	advance(FrameDuration);
+
+	EXPECT_EQ(compositor()->inputStates(0).at(0).Offset, start);
+	EXPECT_EQ(compositor()->inputStates(1).at(0).Offset, start);
+}
+
+TEST_F(CompositorTest, PlayAtInThePastStartsAsSoonAsPossible) {
+	advance(1s);
+	auto earliest = compositor()->earliestStart();
+	compositor()->playAt(
+	    {.MediaType = MediaPlayInfo::Type::TEST,
+	     .Location  = "smpte",
+	     .Duration  = 1s},
+	    0,
+	    100ms
+	);
+	advance(FrameDuration);
+	EXPECT_GE(compositor()->inputStates(0).at(0).Offset, earliest);
+}
+
+TEST_F(CompositorTest, TransactionsApplyOnASingleFrame) {
+	using ::testing::Contains;
+	using ::testing::IsEmpty;
+
+	advance(200ms);
+	auto start = compositor()->commit(
+	    Compositor::Transaction{}
+	        .play(0, testMedia("smpte", 1s, true))
+	        .play(1, testMedia("ball", 1s, true))
+	);
+	EXPECT_EQ(compositor()->frameTime(compositor()->frameAt(start)), start);
+	advance(FrameDuration);
+	EXPECT_THAT(scheduledOffsets(0), Contains(start));
+	EXPECT_THAT(scheduledOffsets(1), Contains(start));
+
+	advance(1500ms);
+	auto cut = compositor()->commit(
+	    Compositor::Transaction{}
+	        .play(0, testMedia("pinwheel", 400ms, false))
+	        .stop(1)
+	        .setOpacity(0, 0.5)
+	);
+	EXPECT_GT(cut, start + 1500ms);
+	advance(FrameDuration);
+	EXPECT_THAT(scheduledOffsets(0), Contains(cut));
+
+	// retired inputs are stopped once the mixer output passed the cut.
+	advance(cut - start + 1s);
+	EXPECT_THAT(scheduledOffsets(1), IsEmpty());
+}
+
+TEST_F(CompositorTest, CutJustAfterALoopBoundaryStartsOnTime) {
+	using ::testing::Contains;
+	using ::testing::ElementsAre;
+
+	constexpr auto duration = 2s;
+	advance(200ms);
+	auto start = compositor()->commit(
+	    Compositor::Transaction{}.play(0, testMedia("smpte", duration, true))
+	);
+	advance(start + 200ms - compositor()->outputTime());
+	// the current loop and the next one are both scheduled before the cut,
+	// and both retired by it.
+	auto boundary = start + duration;
+	ASSERT_THAT(scheduledOffsets(0), Contains(start));
+	ASSERT_THAT(scheduledOffsets(0), Contains(boundary));
+
+	auto cut = compositor()->commit(
+	    Compositor::Transaction{}
+	        .play(0, testMedia("pinwheel", duration, false))
+	        .at(boundary + FrameDuration)
+	);
+	ASSERT_EQ(cut, boundary + FrameDuration);
+	advance(FrameDuration);
+	EXPECT_THAT(scheduledOffsets(0), Contains(cut));
+	EXPECT_EQ(compositor()->state().Layers[0].Start, cut);
+
+	advance(cut + 1s - compositor()->outputTime());
+	EXPECT_THAT(scheduledOffsets(0), ElementsAre(cut));
+}
+
+class CompositorPixelMapTest : public CompositorTest {
+protected:
+	std::vector<std::chrono::nanoseconds> mapped;
+
+	Compositor::Options options() const override {
+		auto res         = CompositorTest::options();
+		res.PixelMapping = PixelMap{
+		    .Outputs =
+		        {
+		            {.Name = "left", .Width = 64, .Height = 32, .Screen = "0"},
+		            {.Name = "right", .Width = 32, .Height = 64, .Screen = "1"},
+		        },
+		    .Slices =
+		        {
+		            {.Source = {0, 0, 160, 80}, .Output = 0, .Scale = 0.4},
+		            {
+		                .Source   = {160, 0, 160, 80},
+		                .Output   = 1,
+		                .Scale    = 0.4,
+		                .Rotation = 90,
+		            },
+		        },
+		};
+		return res;
+	}
+
+	void SetUp() override {
+		CompositorTest::SetUp();
+		if (IsSkipped()) {
+			return;
+		}
+		QObject::connect(
+		    compositor(),
+		    &Compositor::pixelMapFrame,
+		    compositor(),
+		    [this](Frame::Ptr frame) {
+			    std::lock_guard lock{mutex};
+			    mapped.push_back(frame->PTS());
+		    },
+		    Qt::DirectConnection
+		);
+	}
+};
+
+TEST_F(CompositorPixelMapTest, MapsTheOutputFrames) {
+	play(10s, false, 0, "smpte");
+	advance(1s);
+	// the mapping branch is not paced by the clock, waits for it.
+	for (int i = 0; i < 200; ++i) {
+		{
+			std::lock_guard lock{mutex};
+			if (mapped.empty() == false && mapped.back() == PTS.back()) {
+				break;
+			}
+		}
+		std::this_thread::sleep_for(10ms);
+	}
+	std::lock_guard lock{mutex};
+	ASSERT_GT(mapped.size(), 10);
+	EXPECT_EQ(mapped.back(), PTS.back());
+	// its queue is leaky, frames may be skipped but never reordered.
+	EXPECT_TRUE(std::is_sorted(mapped.begin(), mapped.end()));
+	for (const auto &pts : mapped) {
+		EXPECT_THAT(PTS, ::testing::Contains(pts));
+	}
+}
+
+TEST_F(CompositorPixelMapTest, SlicesChangeWithoutNewOutputs) {
+	auto map = options().PixelMapping.value();
+	map.Slices[0].FlipX = true;
+	EXPECT_NO_THROW(compositor()->setPixelMap(map));
+
+	map.Outputs[0].Width = 128;
+	EXPECT_THROW(compositor()->setPixelMap(map), cpptrace::invalid_argument);
+}
+
+// Previews are consumed by a slot slower than the output frame rate, which
+// must not change the output timing.
+class CompositorPreviewTest : public CompositorTest {
+protected:
+	static constexpr std::chrono::milliseconds ConsumerDelay = 300ms;
+
+	std::map<int, std::vector<QSize>> previews;
+
+	Compositor::Options options() const override {
+		auto res    = CompositorTest::options();
+		res.Preview = Compositor::PreviewOptions{.Size = {32, 18}, .FPS = 5};
+		return res;
+	}
+
+	void SetUp() override {
+		CompositorTest::SetUp();
+		if (IsSkipped()) {
+			return;
+		}
+		QObject::connect(
+		    compositor(),
+		    &Compositor::previewFrame,
+		    compositor(),
+		    [this](int source, QImage image) {
+			    {
+				    std::lock_guard lock{mutex};
+				    previews[source].push_back(image.size());
+			    }
+			    std::this_thread::sleep_for(ConsumerDelay);
+		    },
+		    Qt::DirectConnection
+		);
+	}
+};
+
+TEST_F(CompositorPreviewTest, SlowPreviewsDoNotDelayTheOutput) {
+	play(10s, false, 0, "smpte");
+	advance(500ms);
+	auto since = outputPTS().size();
+	advance(2s);
+
+	expectContinuousOutput(41 + since);
+	// test clock waits tolerate a blocked output, the wall-clock time does
+	// not: a preview holding the output would stall it for ConsumerDelay.
+	EXPECT_LT(longestOutputGap(since), ConsumerDelay / 2);
+
+	std::lock_guard lock{mutex};
+	for (int source : {Compositor::Program, 0}) {
+		ASSERT_FALSE(previews[source].empty()) << "source " << source;
+		// at most 5 per second over 2.5s, whatever the consumer does.
+		EXPECT_LE(previews[source].size(), 14) << "source " << source;
+		for (const auto &size : previews[source]) {
+			EXPECT_EQ(size, QSize(32, 18));
+		}
+	}
+}
+
+class CompositorGrabTest : public CompositorTest {
+protected:
+	Compositor::Options options() const override {
+		auto res = CompositorTest::options();
+		res.Grab = true;
+		return res;
+	}
+
+	// frames only flow while the clock is cranked.
+	QImage wait(std::future<QImage> &image) {
+		for (int i = 0; i < 20; ++i) {
+			if (image.wait_for(0s) == std::future_status::ready) {
+				return image.get();
+			}
+			advance(FrameDuration);
+			image.wait_for(10ms);
+		}
+		ADD_FAILURE() << "grab never completed";
+		return {};
+	}
+};
+
+TEST_F(CompositorGrabTest, GrabsFullAndDownscaledFrames) {
+	play(10s, false, 0, "smpte");
+	advance(200ms);
+
+	auto full   = compositor()->grab(Compositor::Program);
+	auto scaled = compositor()->grab(Compositor::Program, {32, 18});
+	auto layer  = compositor()->grab(0, {64, 36});
+	EXPECT_EQ(wait(full).size(), QSize(320, 180));
+	EXPECT_EQ(wait(scaled).size(), QSize(32, 18));
+	EXPECT_EQ(wait(layer).size(), QSize(64, 36));
+
+	expectContinuousOutput();
+
+	EXPECT_THROW(compositor()->grab(2), cpptrace::invalid_argument);
+}
+
+TEST_F(CompositorGrabTest, WaitsForTheRequestedFrame) {
+	advance(200ms);
+	ASSERT_FALSE(outputPTS().empty());
+	auto frame = quint64(outputPTS().back() / FrameDuration) + 10;
+	auto image = compositor()->grab(Compositor::Program, {32, 18}, frame);
+
+	advance(5 * FrameDuration);
+	EXPECT_EQ(image.wait_for(50ms), std::future_status::timeout);
+	EXPECT_FALSE(wait(image).isNull());
+	EXPECT_GE(quint64(outputPTS().back() / FrameDuration), frame);
+}
+
+// Records through an encoder slower than the output frame rate, which must
+// drop frames from the recording rather than delay the output.
+class CompositorRecordTest : public CompositorTest {
+protected:
+	std::filesystem::path path = std::filesystem::temp_directory_path() /
+	                             "yams-compositor-record-test.mkv";
+
+	Compositor::Options options() const override {
+		auto res   = CompositorTest::options();
+		res.Record = Compositor::RecordOptions{
+		    .Path = path.string(),
+		    // 10 frames per second at best, in real time.
+		    .Encoder = "identity sleep-time=100000 ! videoconvert ! "
+		               "jpegenc",
+		    .QueueFrames = 5,
+		};
+		return res;
+	}
+
+	std::vector<std::string> requiredElements() const override {
+		auto res = CompositorTest::requiredElements();
+		res.insert(
+		    res.end(),
+		    {"bin", "filesink", "identity", "jpegenc", "matroskamux",
+		     "videoconvert"}
+		);
+		return res;
+	}
+
+	void SetUp() override {
+		std::filesystem::remove(path);
+		CompositorTest::SetUp();
+	}
+
+	void TearDown() override {
+		CompositorTest::TearDown();
+		std::filesystem::remove(path);
+	}
+};
+
+TEST_F(CompositorRecordTest, SlowEncoderDoesNotDelayTheOutput) {
+	auto &dropped = metrics::Registry::Global().counter(
+	    "yams_record_dropped_frames_total",
+	    "Output frames dropped in front of the recording encoder."
+	);
+	auto before = dropped.value();
+
+	play(10s, false, 0, "smpte");
+	advance(2s);
+
+	expectContinuousOutput(41);
+	EXPECT_GT(dropped.value(), before);
+
+	// the muxer writes its index on stop.
+	compositor()->stop();
+	ASSERT_TRUE(std::filesystem::exists(path));
+	EXPECT_GT(std::filesystem::file_size(path), 0);
+}
+
+// Reads back every fifth frame and compares its CRC with golden sequences
+// in testdata/golden. Goldens are recorded with Mesa's llvmpipe: run with
+// LIBGL_ALWAYS_SOFTWARE=1 YAMS_UPDATE_GOLDEN=1 to record them again after an
+// intended output change.
+class CompositorChecksumTest : public CompositorTest {
+protected:
+	static constexpr size_t Every = 5;
+
+	std::map<quint64, quint32> checksums;
+
+	Compositor::Options options() const override {
+		auto res          = CompositorTest::options();
+		res.ChecksumEvery = Every;
+		return res;
+	}
+
+	void SetUp() override {
+		CompositorTest::SetUp();
+		if (IsSkipped()) {
+			return;
+		}
+		QObject::connect(
+		    compositor(),
+		    &Compositor::frameChecksum,
+		    compositor(),
+		    [this](quint64 frame, quint32 crc) {
+			    std::lock_guard lock{mutex};
+			    checksums[frame] = crc;
+		    },
+		    Qt::DirectConnection
+		);
+	}
+
+	// the readback branch is not paced by the clock, waits for it to
+	// catch up with the output.
+	std::map<quint64, quint32> outputChecksums() {
+		auto pts = outputPTS();
+		if (pts.empty()) {
+			return {};
+		}
+		auto last = quint64(pts.back() / FrameDuration);
+		for (int i = 0; i < 200; ++i) {
+			{
+				std::lock_guard lock{mutex};
+				if (checksums.empty() == false &&
+				    checksums.rbegin()->first + Every > last) {
+					return checksums;
+				}
+			}
+			std::this_thread::sleep_for(10ms);
+		}
+		ADD_FAILURE() << "checksum branch is stalled";
+		std::lock_guard lock{mutex};
+		return checksums;
+	}
+
+	void expectGolden(const std::map<quint64, quint32> &actual) {
+		auto name = std::string{
+		    ::testing::UnitTest::GetInstance()->current_test_info()->name()
+		};
+		auto path = std::filesystem::path{YAMS_TESTDATA_DIR} / "golden" /
+		            (name + ".crc");
+
+		if (std::getenv("YAMS_UPDATE_GOLDEN") != nullptr) {
+			std::filesystem::create_directories(path.parent_path());
+			std::ofstream out{path};
+			for (const auto &[frame, crc] : actual) {
+				out << frame << " " << std::hex << crc << std::dec << "\n";
+			}
+			GTEST_SKIP() << "recorded " << path;
+		}
+
+		std::ifstream in{path};
+		if (in.is_open() == false) {
+			GTEST_FAIL() << "no golden " << path
+			             << ", record it with LIBGL_ALWAYS_SOFTWARE=1 "
+			                "YAMS_UPDATE_GOLDEN=1";
+		}
+		quint64 frame;
+		quint32 crc;
+		size_t  checked{0}, missing{0};
+		while (in >> frame >> std::hex >> crc >> std::dec) {
+			auto it = actual.find(frame);
+			if (it == actual.end()) {
+				// dropped by the leaky checksum queue.
+				++missing;
+				continue;
+			}
+			EXPECT_EQ(it->second, crc) << "at frame " << frame;
+			++checked;
+		}
+		EXPECT_GT(checked, 0);
+		EXPECT_LT(missing, checked) << "too many checksums dropped";
+	}
+};
+
+TEST_F(CompositorChecksumTest, ReadsBackEveryNthFrame) {
+	advance(2s);
+	auto actual = outputChecksums();
+	ASSERT_GT(actual.size(), 5);
+	quint32 background = actual.begin()->second;
+	for (const auto &[frame, crc] : actual) {
+		EXPECT_EQ(frame % Every, 0);
+		// nothing is scheduled, the output is the black background.
+		EXPECT_EQ(crc, background) << "at frame " << frame;
+	}
+}
+
+TEST_F(CompositorChecksumTest, EffectsApplyWhilePlaying) {
+	advance(200ms);
+	auto background = outputChecksums().rbegin()->second;
+	play(10s, false, 0, "smpte");
+	advance(1500ms);
+	EXPECT_NE(outputChecksums().rbegin()->second, background);
+
+	// a black tint only changes uniforms, the layer becomes the background.
+	compositor()->setEffects(0, {.Tint = {0.0, 0.0, 0.0}});
+	advance(500ms);
+	EXPECT_EQ(outputChecksums().rbegin()->second, background);
+}
+
+TEST_F(CompositorChecksumTest, SinglePattern) {
+	advance(200ms);
+	play(1s, true, 0, "smpte");
+	advance(3s);
+	expectGolden(outputChecksums());
+}
+
+TEST_F(CompositorChecksumTest, LayerStack) {
+	advance(200ms);
+	play(1s, true, 0, "smpte");
+	play(600ms, true, 1, "ball");
+	advance(3s);
+	expectGolden(outputChecksums());
+}
+
+TEST_F(CompositorChecksumTest, FadeSequence) {
+	advance(200ms);
+	play(1s, true, 0, "smpte");
+	play(1s, true, 1, "ball");
+	advance(1500ms);
+	// every frame of the fades is a different blend of both layers.
+	compositor()->commit(Compositor::Transaction{}.setOpacity(1, 0.0, 1s));
+	advance(1500ms);
+	compositor()->commit(Compositor::Transaction{}.setOpacity(1, 1.0, 600ms));
+	advance(1s);
+	expectGolden(outputChecksums());
+}
+
+} // namespace yams
@@ -0,0 +1,135 @@
+#include "CueList.hpp"
+
+#include <algorithm>
+
+#include <slog++/slog++.hpp>
+
+namespace yams {
+
+CueList::CueList(Compositor *compositor, Options options, QObject *parent)
+    : QObject{parent}
+    , d_logger{slog::With(slog::String("component", "cuelist"))}
+    , d_compositor{compositor}
+    , d_options{options} {
+	d_follow.setSingleShot(true);
+	connect(&d_follow, &QTimer::timeout, this, [this]() { fire(d_followAt); });
+}
+
+CueList::~CueList() = default;
+
+std::vector<CueList::Preroll> CueList::Plan(
+    const std::vector<Cue> &cues,
+    size_t                  index,
+    const Options          &options,
+    size_t                  bytesPerPreroll
+) {
+	std::vector<Preroll> res;
+	std::vector<int>     seen;
+	auto                 end = std::min(cues.size(), index + options.Lookahead);
+	for (; index < end; ++index) {
+		for (const auto &change : cues[index].Changes.changes()) {
+			if (change.Media.has_value() == false ||
+			    std::find(seen.begin(), seen.end(), change.Layer) !=
+			        seen.end()) {
+				continue;
+			}
+			seen.push_back(change.Layer);
+			if (res.size() >= options.MaxPrerolled ||
+			    (res.size() + 1) * bytesPerPreroll > options.MemoryBudget) {
+				return res;
+			}
+			res.push_back({.Layer = change.Layer, .Media = *change.Media});
+		}
+	}
+	return res;
+}
+
+void CueList::setCues(std::vector<Cue> cues) {
+	d_follow.stop();
+	d_cues     = std::move(cues);
+	d_position = 0;
+	preload();
+}
+
+size_t CueList::position() const {
+	return d_position;
+}
+
+void CueList::go() {
+	d_follow.stop();
+	fire(std::nullopt);
+}
+
+void CueList::goTo(size_t index) {
+	d_follow.stop();
+	d_position = std::min(index, d_cues.size());
+	preload();
+}
+
+void CueList::fire(std::optional<std::chrono::nanoseconds> at) {
+	if (d_position >= d_cues.size()) {
+		d_logger.Warn("no cue left to go");
+		return;
+	}
+	auto        index       = d_position++;
+	const auto &cue         = d_cues[index];
+	auto        transaction = cue.Changes;
+	if (at.has_value()) {
+		transaction.at(at.value() + cue.Wait);
+	} else if (cue.Wait > 0ns) {
+		transaction.at(d_compositor->earliestStart() + cue.Wait);
+	}
+
+	auto start = d_compositor->commit(std::move(transaction));
+	d_logger.Info(
+	    "cue fired",
+	    slog::Int("index", index),
+	    slog::String("name", cue.Name.toStdString()),
+	    slog::Duration("start", start)
+	);
+	emit fired(index, start);
+	preload();
+
+	if (cue.Follow.has_value() == false || d_position >= d_cues.size()) {
+		return;
+	}
+	// the next cue is committed ahead with an explicit time, the timer only
+	// needs to be early.
+	d_followAt = start + cue.Follow.value();
+	auto delay =
+	    d_followAt - d_compositor->runningTime() - d_options.CommitAhead;
+	d_follow.start(
+	    std::chrono::duration_cast<std::chrono::milliseconds>(
+	        std::max(delay, 0ns)
+	    )
+	);
+}
+
+void CueList::preload() {
+	auto size = d_compositor->outputSize();
+	auto plan = Plan(
+	    d_cues,
+	    d_position,
+	    d_options,
+	    size_t(size.width()) * size_t(size.height()) * 4 * FramesPerPreroll
+	);
+
+	std::vector<int> layers;
+	for (const auto &preroll : plan) {
+		layers.push_back(preroll.Layer);
+		d_compositor->preroll(preroll.Media, preroll.Layer);
+	}
+	for (auto layer : d_prerolledLayers) {
+		if (std::find(layers.begin(), layers.end(), layer) == layers.end()) {
+			d_compositor->cancelPreroll(layer);
+		}
+	}
+	d_prerolledLayers = std::move(layers);
+	d_logger.Debug(
+	    "preloaded cues",
+	    slog::Int("position", d_position),
+	    slog::Int("prerolled", d_prerolledLayers.size())
+	);
+}
+
+} // namespace yams
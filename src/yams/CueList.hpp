@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <vector>
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+#include <slog++/Logger.hpp>
+
+#include "Compositor.hpp"
+#include "MediaPlayInfo.hpp"
+
+namespace yams {
+using namespace std::chrono_literals;
+
+/// Ordered list of cues fired by go(), as on a show control desk.
+///
+/// Each cue is a Compositor::Transaction, committed Wait after its go. A cue
+/// with a Follow time fires the next one automatically, Follow after its own
+/// start. The medias of the next Lookahead cues are prerolled on the spare
+/// input of their layer, so they start without opening a file on go. The
+/// number of prerolled medias and their estimated memory are bounded, the
+/// nearest cues are served first.
+class CueList : public QObject {
+	Q_OBJECT
+public:
+	struct Options {
+		// upcoming cues, from the next one to go, whose medias are prerolled.
+		size_t Lookahead = 2;
+		// open decoders kept for prerolled medias.
+		size_t MaxPrerolled = 4;
+		// estimated memory of the prerolled medias, in bytes.
+		size_t MemoryBudget = size_t(512) << 20;
+		// follow cues are committed this long before their start.
+		std::chrono::nanoseconds CommitAhead = 500ms;
+	};
+
+	struct Cue {
+		QString                 Name;
+		Compositor::Transaction Changes;
+		// delay between the go and the start of the cue.
+		std::chrono::nanoseconds Wait{0};
+		// fires the next cue this long after the start of this one.
+		std::optional<std::chrono::nanoseconds> Follow;
+	};
+
+	struct Preroll {
+		int           Layer;
+		MediaPlayInfo Media;
+	};
+
+	// decoded frames held by a prerolled media: the decoder pool and the
+	// queue up to the blocked pad.
+	constexpr static size_t FramesPerPreroll = 8;
+
+	/// Medias to preroll for the cues from index on. Only the first
+	/// upcoming media of a layer can be prerolled.
+	static std::vector<Preroll> Plan(
+	    const std::vector<Cue> &cues,
+	    size_t                  index,
+	    const Options          &options,
+	    size_t                  bytesPerPreroll
+	);
+
+	CueList(Compositor *compositor, Options options, QObject *parent = nullptr);
+	virtual ~CueList();
+
+	void setCues(std::vector<Cue> cues);
+
+	/// Index of the next cue to go.
+	size_t position() const;
+
+public slots:
+	void go();
+	// Moves to a cue without firing anything.
+	void goTo(size_t index);
+
+signals:
+	void fired(size_t index, std::chrono::nanoseconds at);
+
+private:
+	void fire(std::optional<std::chrono::nanoseconds> at);
+	void preload();
+
+	slog::Logger<1> d_logger;
+	Compositor     *d_compositor;
+	Options         d_options;
+
+	std::vector<Cue>         d_cues;
+	size_t                   d_position{0};
+	std::vector<int>         d_prerolledLayers;
+	QTimer                   d_follow;
+	std::chrono::nanoseconds d_followAt{0};
+};
+
+} // namespace yams
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+
+#include "CueList.hpp"
+
+namespace yams {
+
+class CueListTest : public ::testing::Test {
+protected:
+	static MediaPlayInfo media(const QString &location) {
+		return {
+		    .MediaType = MediaPlayInfo::Type::VIDEO,
+		    .Location  = location,
+		    .Duration  = 10s,
+		};
+	}
+
+	static std::vector<QString>
+	locations(const std::vector<CueList::Preroll> &plan) {
+		std::vector<QString> res;
+		for (const auto &preroll : plan) {
+			res.push_back(preroll.Media.Location);
+		}
+		return res;
+	}
+
+	std::vector<CueList::Cue> cues{
+	    {
+	        .Name    = "intro",
+	        .Changes = Compositor::Transaction{}.play(0, media("a")),
+	    },
+	    {
+	        .Name    = "titles",
+	        .Changes = Compositor::Transaction{}
+	                       .play(1, media("b"))
+	                       .setOpacity(1, 0.0),
+	    },
+	    {
+	        .Name    = "fade in",
+	        .Changes = Compositor::Transaction{}.setOpacity(1, 1.0, 2s),
+	    },
+	    {
+	        .Name    = "next",
+	        .Changes = Compositor::Transaction{}.play(0, media("c")),
+	    },
+	    {
+	        .Name    = "blackout",
+	        .Changes = Compositor::Transaction{}.stop(0).stop(1),
+	    },
+	    {
+	        .Name    = "outro",
+	        .Changes = Compositor::Transaction{}.play(0, media("d")),
+	    },
+	};
+};
+
+TEST_F(CueListTest, PrerollsTheNextCues) {
+	CueList::Options options{.Lookahead = 2};
+	EXPECT_EQ(
+	    locations(CueList::Plan(cues, 0, options, 1)),
+	    (std::vector<QString>{"a", "b"})
+	);
+	EXPECT_EQ(
+	    locations(CueList::Plan(cues, 2, options, 1)),
+	    (std::vector<QString>{"c"})
+	);
+	EXPECT_TRUE(CueList::Plan(cues, 6, options, 1).empty());
+}
+
+TEST_F(CueListTest, OnlyTheFirstMediaOfALayerIsPrerolled) {
+	CueList::Options options{.Lookahead = 6};
+	// c and d play on layer 0 after a.
+	EXPECT_EQ(
+	    locations(CueList::Plan(cues, 0, options, 1)),
+	    (std::vector<QString>{"a", "b"})
+	);
+	// a stop does not use the spare input.
+	EXPECT_EQ(
+	    locations(CueList::Plan(cues, 4, options, 1)),
+	    (std::vector<QString>{"d"})
+	);
+}
+
+TEST_F(CueListTest, RespectsBudgets) {
+	CueList::Options options{
+	    .Lookahead    = 4,
+	    .MaxPrerolled = 1,
+	};
+	EXPECT_EQ(
+	    locations(CueList::Plan(cues, 0, options, 1)),
+	    (std::vector<QString>{"a"})
+	);
+
+	options.MaxPrerolled = 4;
+	options.MemoryBudget = 100;
+	EXPECT_EQ(locations(CueList::Plan(cues, 0, options, 60)).size(), 1);
+	EXPECT_TRUE(CueList::Plan(cues, 0, options, 101).empty());
+}
+
+} // namespace yams
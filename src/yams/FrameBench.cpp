@@ -0,0 +1,63 @@
+#include "Frame.hpp"
+#include <benchmark/benchmark.h>
+
+#include <gst/app/gstappsink.h>
+#include <gst/gst.h>
+#include <gst/video/video-info.h>
+
+#include <yams/gstreamer/Memory.hpp>
+#include <yams/utils/defer.hpp>
+
+namespace yams {
+
+// Maps a GL buffer the way Compositor::onNewSampleCb does, and releases it
+// the way the FramePool does.
+static void BM_FrameMapUnmapGL(benchmark::State &state) {
+	auto pipeline = GstElementPtr{gst_parse_launch(
+	    "gltestsrc num-buffers=1 ! "
+	    "video/x-raw(memory:GLMemory),format=RGBA,width=1920,height=1080 ! "
+	    "appsink name=sink0",
+	    nullptr
+	)};
+	if (pipeline == nullptr) {
+		state.SkipWithError("could not build gltestsrc pipeline");
+		return;
+	}
+	defer {
+		gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+	};
+	auto sink = GstElementPtr{
+	    gst_bin_get_by_name(GST_BIN_CAST(pipeline.get()), "sink0")
+	};
+	gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+
+	GstSample *sample =
+	    gst_app_sink_try_pull_sample(GST_APP_SINK_CAST(sink.get()), GST_SECOND);
+	if (sample == nullptr) {
+		state.SkipWithError("no GL buffer, is a GL display available?");
+		return;
+	}
+	defer {
+		gst_sample_unref(sample);
+	};
+
+	GstVideoInfo infos;
+	gst_video_info_from_caps(&infos, gst_sample_get_caps(sample));
+	auto buffer = gst_sample_get_buffer(sample);
+
+	Frame frame;
+	for (auto _ : state) {
+		if (frame.map(&infos, buffer, GstMapFlags(GST_MAP_READ | GST_MAP_GL)) ==
+		    false) {
+			state.SkipWithError("failed to map GL buffer");
+			return;
+		}
+		benchmark::DoNotOptimize(frame.TexID());
+		frame.unmap();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_FrameMapUnmapGL);
+
+} // namespace yams
@@ -0,0 +1,197 @@
+#include "HeadlessCompositor.hpp"
+
+#include <fstream>
+#include <string>
+#include <utility>
+
+#include <cpptrace/exceptions.hpp>
+
+#include <gst/gl/gl.h>
+#include <gst/gl/gstglcontext.h>
+#include <gst/gl/gstgldisplay.h>
+
+#if GST_GL_HAVE_PLATFORM_EGL
+#include <gst/gl/egl/gstgldisplay_egl.h>
+#endif
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+#include <slog++/slog++.hpp>
+
+namespace yams {
+
+namespace {
+GstGLDisplayPtr headlessDisplay() {
+#if GST_GL_HAVE_PLATFORM_EGL && GST_CHECK_VERSION(1, 24, 0)
+	if (auto display = gst_gl_display_egl_new_surfaceless();
+	    display != nullptr) {
+		return GstGLDisplayPtr{GST_GL_DISPLAY_CAST(display)};
+	}
+	slog::Warn("no surfaceless EGL display, using the default GL display");
+#endif
+	// honors GST_GL_PLATFORM and GST_GL_WINDOW, e.g. under Xvfb.
+	return GstGLDisplayPtr{gst_gl_display_new()};
+}
+
+// a context on display, or the reason it could not be created.
+std::pair<GstGLContext *, std::string> createContext(GstGLDisplay *display) {
+	GstGLContext *context{nullptr};
+	GError       *error{nullptr};
+	GST_OBJECT_LOCK(display);
+	bool created =
+	    gst_gl_display_create_context(display, nullptr, &context, &error);
+	if (created == true) {
+		gst_gl_display_add_context(display, context);
+	}
+	GST_OBJECT_UNLOCK(display);
+
+	if (created == true) {
+		return {context, {}};
+	}
+	std::string reason = error != nullptr ? error->message : "unknown";
+	g_clear_error(&error);
+	return {nullptr, reason};
+}
+
+size_t residentBytes() {
+#if defined(__linux__)
+	std::ifstream statm{"/proc/self/statm"};
+	size_t        size{0}, resident{0};
+	statm >> size >> resident;
+	return resident * sysconf(_SC_PAGESIZE);
+#else
+	return 0;
+#endif
+}
+} // namespace
+
+HeadlessCompositor::HeadlessCompositor(
+    Compositor::Options options, GstClock *pipelineClock, QObject *parent
+)
+    : QObject{parent}
+    , d_display{headlessDisplay()} {
+	if (d_display == nullptr) {
+		throw cpptrace::runtime_error{"could not open a GL display"};
+	}
+
+	auto [context, reason] = createContext(d_display.get());
+	if (context == nullptr) {
+		throw cpptrace::runtime_error{"could not create GL context: " + reason};
+	}
+	d_context.reset(context);
+
+	slog::Info(
+	    "headless GL context",
+	    slog::String(
+	        "platform",
+	        gst_gl_platform_to_string(gst_gl_context_get_gl_platform(context))
+	    ),
+	    slog::String(
+	        "api",
+	        gst_gl_api_to_string(gst_gl_context_get_gl_api(context))
+	    )
+	);
+
+	d_compositor = std::make_unique<Compositor>(
+	    options,
+	    Compositor::Args{
+	        .Display = d_display.get(),
+	        .Context = d_context.get(),
+	        .Parent  = nullptr,
+	        .Clock   = pipelineClock,
+	    }
+	);
+
+	// frames are released from the streaming thread, they are never drawn.
+	connect(
+	    d_compositor.get(),
+	    &Compositor::newFrame,
+	    this,
+	    &HeadlessCompositor::onNewFrame,
+	    Qt::DirectConnection
+	);
+
+	d_since = clock::now();
+}
+
+std::optional<std::string> HeadlessCompositor::glUnavailable() {
+	auto display = headlessDisplay();
+	if (display == nullptr) {
+		return "could not open a GL display";
+	}
+	auto [context, reason] = createContext(display.get());
+	if (context == nullptr) {
+		return "could not create GL context: " + reason;
+	}
+	GstGLContextPtr{context}.reset();
+	return std::nullopt;
+}
+
+HeadlessCompositor::~HeadlessCompositor() {
+	d_compositor.reset();
+}
+
+Compositor *HeadlessCompositor::compositor() {
+	return d_compositor.get();
+}
+
+void HeadlessCompositor::onNewFrame(yams::Frame::Ptr frame) {
+	auto now = clock::now();
+	auto lag = d_compositor->runningTime() - frame->PTS();
+
+	std::lock_guard lock{d_mutex};
+	if (d_frames > 0) {
+		auto interval = now - d_last;
+		d_intervalMin = std::min<std::chrono::nanoseconds>(
+		    d_intervalMin,
+		    interval
+		);
+		d_intervalMax = std::max<std::chrono::nanoseconds>(
+		    d_intervalMax,
+		    interval
+		);
+	} else {
+		d_intervalMin = std::chrono::nanoseconds::max();
+	}
+	d_last    = now;
+	d_lagSum += lag;
+	d_lagMax  = std::max(d_lagMax, lag);
+	++d_frames;
+}
+
+HeadlessCompositor::Stats HeadlessCompositor::stats() {
+	auto now        = clock::now();
+	auto traceSince = trace::now();
+	auto stages     = trace::stageLatencies(d_traceSince, traceSince);
+
+	std::lock_guard lock{d_mutex};
+	auto            elapsed = std::chrono::duration<qreal>(now - d_since);
+
+	Stats res;
+	res.Frames        = d_frames;
+	res.FPS           = d_frames / elapsed.count();
+	res.Elapsed       = now - d_since;
+	res.LagMax        = d_lagMax;
+	res.IntervalMax   = d_intervalMax;
+	res.ResidentBytes = residentBytes();
+	res.Stages        = std::move(stages);
+	if (d_frames > 0) {
+		res.LagMean = d_lagSum / d_frames;
+	}
+	if (d_frames > 1) {
+		res.IntervalMin = d_intervalMin;
+	}
+
+	d_since       = now;
+	d_traceSince  = traceSince;
+	d_frames      = 0;
+	d_lagSum      = std::chrono::nanoseconds{0};
+	d_lagMax      = std::chrono::nanoseconds{0};
+	d_intervalMin = std::chrono::nanoseconds{0};
+	d_intervalMax = std::chrono::nanoseconds{0};
+	return res;
+}
+
+} // namespace yams
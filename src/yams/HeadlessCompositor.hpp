@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <QObject>
+
+#include "Compositor.hpp"
+#include "Frame.hpp"
+#include <yams/gstreamer/Memory.hpp>
+#include <yams/utils/Trace.hpp>
+
+namespace yams {
+
+/// Runs a Compositor without any window, on its own GL context.
+///
+/// On Linux the context is created on a surfaceless EGL display, which works
+/// with Mesa's llvmpipe, so composition can be measured on any CI runner.
+/// Output frames are dropped as soon as they are received, only their timing
+/// is recorded.
+class HeadlessCompositor : public QObject {
+	Q_OBJECT
+public:
+	struct Stats {
+		size_t                   Frames = 0;
+		qreal                    FPS    = 0.0;
+		// since the previous call, or the construction.
+		std::chrono::nanoseconds Elapsed{0};
+		std::chrono::nanoseconds LagMean{0}, LagMax{0};
+		std::chrono::nanoseconds IntervalMin{0}, IntervalMax{0};
+		size_t                   ResidentBytes = 0;
+		// decode to proxysrc, proxysrc to mixer and mixer to appsink, only
+		// measured while tracing.
+		std::vector<trace::StageLatency> Stages;
+	};
+
+	/// @throws cpptrace::runtime_error if no GL context can be created.
+	HeadlessCompositor(
+	    Compositor::Options options,
+	    GstClock           *pipelineClock = nullptr,
+	    QObject            *parent        = nullptr
+	);
+	virtual ~HeadlessCompositor();
+
+	HeadlessCompositor(const HeadlessCompositor &)            = delete;
+	HeadlessCompositor(HeadlessCompositor &&)                 = delete;
+	HeadlessCompositor &operator=(const HeadlessCompositor &) = delete;
+	HeadlessCompositor &operator=(HeadlessCompositor &&)      = delete;
+
+	Compositor *compositor();
+
+	/// Why no headless GL context can be created, std::nullopt if one can,
+	/// e.g. for tests to skip on machines without GL.
+	static std::optional<std::string> glUnavailable();
+
+	/// Statistics since the previous call. Lag is the running time at
+	/// reception minus the frame PTS. Stages are computed from the trace
+	/// events, see trace::stageLatencies().
+	Stats stats();
+
+private:
+	void onNewFrame(yams::Frame::Ptr frame);
+
+	GstGLDisplayPtr             d_display;
+	GstGLContextPtr             d_context;
+	std::unique_ptr<Compositor> d_compositor;
+
+	using clock = std::chrono::steady_clock;
+
+	std::mutex               d_mutex;
+	clock::time_point        d_since, d_last;
+	std::chrono::nanoseconds d_traceSince{0};
+	size_t                   d_frames{0};
+	std::chrono::nanoseconds d_lagSum{0}, d_lagMax{0};
+	std::chrono::nanoseconds d_intervalMin{0}, d_intervalMax{0};
+};
+
+} // namespace yams
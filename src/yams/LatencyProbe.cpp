@@ -0,0 +1,287 @@
+#include "LatencyProbe.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+#include <gst/gl/gl.h>
+#include <gst/gl/gstglcontext.h>
+#include <gst/gl/gstglframebuffer.h>
+#include <gst/gl/gstglmemory.h>
+
+#include <slog++/slog++.hpp>
+
+namespace yams {
+
+void LatencyProbe::Stamp(uint8_t *rgba, size_t stride, uint32_t code) {
+	for (size_t row = 0; row < 2; ++row) {
+		uint32_t value = row == 0 ? code : ~code;
+		for (size_t y = row * BlockSize; y < (row + 1) * BlockSize; ++y) {
+			auto line = rgba + y * stride;
+			for (size_t x = 0; x < RegionWidth; ++x) {
+				bool    bit   = (value >> (31 - x / BlockSize)) & 1;
+				uint8_t color = bit ? 255 : 0;
+
+				line[4 * x + 0] = color;
+				line[4 * x + 1] = color;
+				line[4 * x + 2] = color;
+				line[4 * x + 3] = 255;
+			}
+		}
+	}
+}
+
+std::optional<uint32_t>
+LatencyProbe::Decode(const uint8_t *rgba, size_t stride) {
+	uint32_t values[2] = {0, 0};
+	for (size_t row = 0; row < 2; ++row) {
+		// samples the center of each block, away from filtered edges.
+		auto line = rgba + (row * BlockSize + BlockSize / 2) * stride;
+		for (size_t block = 0; block < 32; ++block) {
+			auto pixel = line + 4 * (block * BlockSize + BlockSize / 2);
+			bool bit   = int(pixel[0]) + int(pixel[1]) + int(pixel[2]) > 384;
+
+			values[row] = (values[row] << 1) | uint32_t(bit);
+		}
+	}
+	if (values[0] != ~values[1] || values[0] == 0) {
+		return std::nullopt;
+	}
+	return values[0];
+}
+
+LatencyProbe::LatencyProbe()
+    : d_region(RegionWidth * RegionHeight * 4) {}
+
+LatencyProbe::~LatencyProbe() {
+	if (d_context != nullptr) {
+		gst_gl_context_thread_add(
+		    d_context.get(),
+		    (GstGLContextThreadFunc)&LatencyProbe::releaseGL,
+		    this
+		);
+	}
+}
+
+uint32_t LatencyProbe::trigger(clock::time_point now) {
+	std::lock_guard lock{d_mutex};
+	auto            code = d_nextCode++;
+	if (d_nextCode == 0) {
+		// 0 is never stamped, an unstamped source decodes to nothing.
+		d_nextCode = 1;
+	}
+	d_pending[code] = now;
+	++d_triggers;
+	return code;
+}
+
+bool LatencyProbe::hasPending() const {
+	std::lock_guard lock{d_mutex};
+	return d_pending.empty() == false;
+}
+
+bool LatencyProbe::resolve(uint32_t code, clock::time_point now) {
+	std::lock_guard lock{d_mutex};
+	auto            it = d_pending.find(code);
+	if (it == d_pending.end()) {
+		return false;
+	}
+	d_samples.push_back(now - it->second);
+	d_pending.erase(it);
+	return true;
+}
+
+void LatencyProbe::cancel(uint32_t code) {
+	std::lock_guard lock{d_mutex};
+	if (d_pending.erase(code) > 0) {
+		--d_triggers;
+	}
+}
+
+void LatencyProbe::expire(clock::time_point now) {
+	std::lock_guard lock{d_mutex};
+	std::erase_if(d_pending, [&](const auto &pending) {
+		if (now - pending.second < Timeout) {
+			return false;
+		}
+		++d_misses;
+		return true;
+	});
+}
+
+void LatencyProbe::readRegion(GstGLContext *context, LatencyProbe *self) {
+	const GstGLFuncs *gl   = context->gl_vtable;
+	constexpr size_t  size = RegionWidth * RegionHeight * 4;
+	bool async = gl->FenceSync != nullptr && gl->MapBufferRange != nullptr;
+
+	if (self->d_fence != nullptr) {
+		auto fence  = GLsync(self->d_fence);
+		auto status = gl->ClientWaitSync(fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			// still in flight, this frame is not read.
+			return;
+		}
+		gl->DeleteSync(fence);
+		self->d_fence = nullptr;
+		gl->BindBuffer(GL_PIXEL_PACK_BUFFER, self->d_pixelBuffer);
+		auto data =
+		    gl->MapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+		if (status != GL_WAIT_FAILED && data != nullptr) {
+			std::memcpy(self->d_region.data(), data, size);
+			self->d_regionTime  = self->d_fenceTime;
+			self->d_regionReady = true;
+		}
+		if (data != nullptr) {
+			gl->UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		gl->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	if (self->d_framebuffer == nullptr) {
+		self->d_framebuffer.reset(gst_gl_framebuffer_new(context));
+	}
+	gst_gl_framebuffer_bind(self->d_framebuffer.get());
+	gst_gl_framebuffer_attach(
+	    self->d_framebuffer.get(),
+	    GL_COLOR_ATTACHMENT0,
+	    GST_GL_BASE_MEMORY_CAST(self->d_readMemory)
+	);
+	if (async == false) {
+		gl->ReadPixels(
+		    0,
+		    0,
+		    RegionWidth,
+		    RegionHeight,
+		    GL_RGBA,
+		    GL_UNSIGNED_BYTE,
+		    self->d_region.data()
+		);
+		self->d_regionTime  = self->d_readTime;
+		self->d_regionReady = true;
+		gst_gl_context_clear_framebuffer(context);
+		return;
+	}
+
+	if (self->d_pixelBuffer == 0) {
+		gl->GenBuffers(1, &self->d_pixelBuffer);
+		gl->BindBuffer(GL_PIXEL_PACK_BUFFER, self->d_pixelBuffer);
+		gl->BufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+	} else {
+		gl->BindBuffer(GL_PIXEL_PACK_BUFFER, self->d_pixelBuffer);
+	}
+	// returns immediately, the copy completes with the fence.
+	gl->ReadPixels(
+	    0,
+	    0,
+	    RegionWidth,
+	    RegionHeight,
+	    GL_RGBA,
+	    GL_UNSIGNED_BYTE,
+	    nullptr
+	);
+	gl->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	self->d_fence     = gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	self->d_fenceTime = self->d_readTime;
+	gl->Flush();
+	gst_gl_context_clear_framebuffer(context);
+}
+
+void LatencyProbe::releaseGL(GstGLContext *context, LatencyProbe *self) {
+	const GstGLFuncs *gl = context->gl_vtable;
+	if (self->d_fence != nullptr) {
+		gl->DeleteSync(GLsync(self->d_fence));
+		self->d_fence = nullptr;
+	}
+	if (self->d_pixelBuffer != 0) {
+		gl->DeleteBuffers(1, &self->d_pixelBuffer);
+		self->d_pixelBuffer = 0;
+	}
+}
+
+void LatencyProbe::onOutputBuffer(GstBuffer *buffer) {
+	auto now = clock::now();
+	expire(now);
+	if (hasPending() == false) {
+		return;
+	}
+	auto mem = gst_buffer_peek_memory(buffer, 0);
+
+	std::optional<uint32_t> code;
+
+	if (gst_is_gl_memory(mem)) {
+		auto glMemory = GST_GL_MEMORY_CAST(mem);
+		if (gst_gl_memory_get_texture_width(glMemory) < RegionWidth ||
+		    gst_gl_memory_get_texture_height(glMemory) < RegionHeight) {
+			return;
+		}
+		auto context = GST_GL_BASE_MEMORY_CAST(mem)->context;
+		if (d_context == nullptr) {
+			d_context.reset(GST_GL_CONTEXT(gst_object_ref(context)));
+		}
+		// only the code region leaves the GPU, not the whole frame.
+		d_readMemory = glMemory;
+		d_readTime   = now;
+		gst_gl_context_thread_add(
+		    context,
+		    (GstGLContextThreadFunc)&LatencyProbe::readRegion,
+		    this
+		);
+		d_readMemory = nullptr;
+		if (d_regionReady == false) {
+			return;
+		}
+		d_regionReady = false;
+		now           = d_regionTime;
+		code          = Decode(d_region.data(), RegionWidth * 4);
+	} else {
+		GstMapInfo map;
+		if (gst_memory_map(mem, &map, GST_MAP_READ) == false) {
+			return;
+		}
+		auto meta = gst_buffer_get_video_meta(buffer);
+		if (meta != nullptr && meta->width >= RegionWidth &&
+		    meta->height >= RegionHeight) {
+			code = Decode(map.data, meta->stride[0]);
+		}
+		gst_memory_unmap(mem, &map);
+	}
+
+	if (code.has_value()) {
+		resolve(code.value(), now);
+	}
+}
+
+LatencyProbe::Stats LatencyProbe::stats() const {
+	std::vector<std::chrono::nanoseconds> samples;
+	Stats                                 res;
+	{
+		std::lock_guard lock{d_mutex};
+		samples      = d_samples;
+		res.Triggers = d_triggers;
+		res.Misses   = d_misses;
+	}
+	res.Samples = samples.size();
+	if (samples.empty()) {
+		return res;
+	}
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&samples](size_t p) {
+		// nearest rank.
+		size_t rank = (p * samples.size() + 99) / 100;
+		return samples[std::max<size_t>(rank, 1) - 1];
+	};
+	res.Min  = samples.front();
+	res.Max  = samples.back();
+	res.P50  = percentile(50);
+	res.P95  = percentile(95);
+	res.P99  = percentile(99);
+	auto sum = std::accumulate(
+	    samples.begin(),
+	    samples.end(),
+	    std::chrono::nanoseconds{0}
+	);
+	res.Mean = sum / samples.size();
+	return res;
+}
+
+} // namespace yams
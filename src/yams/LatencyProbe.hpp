@@ -0,0 +1,108 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <gst/gl/gstgl_fwd.h>
+#include <gst/gstbuffer.h>
+
+#include <yams/gstreamer/Memory.hpp>
+
+namespace yams {
+
+/// Measures the latency between a play() trigger and the first composited
+/// frame showing the triggered media.
+///
+/// Sources stamp a code identifying the trigger in the top left corner of
+/// their RGBA frames. The code is two rows of 32 blocks, the value and its
+/// complement, so that unstamped content is never decoded as a code. The
+/// compositor reads back only that region from its output texture and
+/// resolves the pending trigger. Nothing is read while no trigger is pending.
+/// When the GL API allows it, the region is read into a pixel buffer object
+/// guarded by a fence and decoded on the next frame, so the streaming thread
+/// never waits for the GPU. A trigger whose code never reaches the output
+/// within Timeout, e.g. a play() scheduled far ahead or a source that does
+/// not stamp, is counted as a miss.
+class LatencyProbe {
+public:
+	using clock = std::chrono::steady_clock;
+
+	constexpr static size_t BlockSize    = 8;
+	constexpr static size_t RegionWidth  = 32 * BlockSize;
+	constexpr static size_t RegionHeight = 2 * BlockSize;
+
+	constexpr static std::chrono::seconds Timeout{5};
+
+	struct Stats {
+		size_t                   Triggers = 0, Samples = 0, Misses = 0;
+		std::chrono::nanoseconds Min{0}, Mean{0}, P50{0}, P95{0}, P99{0},
+		    Max{0};
+	};
+
+	/// Writes code in a RGBA image, which must be at least RegionWidth x
+	/// RegionHeight.
+	static void Stamp(uint8_t *rgba, size_t stride, uint32_t code);
+
+	/// Reads a code written by Stamp() from a RGBA image.
+	static std::optional<uint32_t> Decode(const uint8_t *rgba, size_t stride);
+
+	LatencyProbe();
+	~LatencyProbe();
+
+	LatencyProbe(const LatencyProbe &)            = delete;
+	LatencyProbe(LatencyProbe &&)                 = delete;
+	LatencyProbe &operator=(const LatencyProbe &) = delete;
+	LatencyProbe &operator=(LatencyProbe &&)      = delete;
+
+	/// Records a trigger and returns the code sources must stamp.
+	uint32_t trigger(clock::time_point now = clock::now());
+
+	/// Resolves the trigger of code, if still pending. Returns true if a
+	/// latency sample was recorded.
+	bool resolve(uint32_t code, clock::time_point now = clock::now());
+
+	/// Forgets the trigger of code, e.g. for a rejected play(). It is
+	/// neither a trigger nor a miss.
+	void cancel(uint32_t code);
+
+	/// Counts the triggers pending for longer than Timeout as misses.
+	void expire(clock::time_point now = clock::now());
+
+	/// Decodes an output buffer, either in GL or system memory. Must be
+	/// called from a streaming thread. A GL buffer may be decoded on the next
+	/// call, its latency is still measured at the time of this one.
+	void onOutputBuffer(GstBuffer *buffer);
+
+	Stats stats() const;
+
+private:
+	static void readRegion(GstGLContext *context, LatencyProbe *self);
+	static void releaseGL(GstGLContext *context, LatencyProbe *self);
+
+	bool hasPending() const;
+
+	mutable std::mutex                    d_mutex;
+	uint32_t                              d_nextCode{1};
+	std::map<uint32_t, clock::time_point> d_pending;
+	std::vector<std::chrono::nanoseconds> d_samples;
+	size_t                                d_triggers{0}, d_misses{0};
+
+	// only used from the output streaming thread.
+	GstGLContextPtr                  d_context;
+	glib_owned_ptr<GstGLFramebuffer> d_framebuffer;
+	GstGLMemory                     *d_readMemory{nullptr};
+	clock::time_point                d_readTime;
+	std::vector<uint8_t>             d_region;
+	clock::time_point                d_regionTime;
+	bool                             d_regionReady{false};
+	// pixel buffer object and GLsync of the readback in flight.
+	unsigned int                     d_pixelBuffer{0};
+	void                            *d_fence{nullptr};
+	clock::time_point                d_fenceTime;
+};
+
+} // namespace yams
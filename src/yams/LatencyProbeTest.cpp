@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+
+#include "LatencyProbe.hpp"
+
+namespace yams {
+
+class LatencyProbeTest : public ::testing::Test {
+protected:
+	constexpr static size_t Width  = LatencyProbe::RegionWidth + 13;
+	constexpr static size_t Stride = 4 * Width + 12;
+
+	std::vector<uint8_t> image =
+	    std::vector<uint8_t>(Stride * LatencyProbe::RegionHeight, 0);
+};
+
+TEST_F(LatencyProbeTest, StampedCodesAreDecoded) {
+	for (uint32_t code : {1u, 2u, 0xdeadbeefu, 0x80000000u, 0xffffffffu}) {
+		LatencyProbe::Stamp(image.data(), Stride, code);
+		auto decoded = LatencyProbe::Decode(image.data(), Stride);
+		ASSERT_TRUE(decoded.has_value()) << "code: " << code;
+		EXPECT_EQ(decoded.value(), code);
+	}
+}
+
+TEST_F(LatencyProbeTest, UnstampedImagesAreNotDecoded) {
+	EXPECT_FALSE(LatencyProbe::Decode(image.data(), Stride).has_value());
+	std::fill(image.begin(), image.end(), 255);
+	EXPECT_FALSE(LatencyProbe::Decode(image.data(), Stride).has_value());
+
+	std::mt19937                       rng{42};
+	std::uniform_int_distribution<int> pixel{0, 255};
+	for (int i = 0; i < 100; ++i) {
+		std::generate(image.begin(), image.end(), [&]() {
+			return pixel(rng);
+		});
+		EXPECT_FALSE(LatencyProbe::Decode(image.data(), Stride).has_value());
+	}
+}
+
+TEST_F(LatencyProbeTest, ToleratesScalingNoise) {
+	LatencyProbe::Stamp(image.data(), Stride, 0x12345678);
+	std::mt19937                       rng{42};
+	std::uniform_int_distribution<int> noise{-60, 60};
+	for (auto &value : image) {
+		value = std::clamp(value + noise(rng), 0, 255);
+	}
+	auto decoded = LatencyProbe::Decode(image.data(), Stride);
+	ASSERT_TRUE(decoded.has_value());
+	EXPECT_EQ(decoded.value(), 0x12345678);
+}
+
+TEST_F(LatencyProbeTest, ResolvesPendingTriggersOnce) {
+	using namespace std::chrono_literals;
+	LatencyProbe probe;
+	auto         start = LatencyProbe::clock::now();
+
+	std::vector<uint32_t> codes;
+	for (int i = 0; i < 100; ++i) {
+		codes.push_back(probe.trigger(start));
+	}
+	EXPECT_EQ(codes.front(), 1);
+	EXPECT_FALSE(probe.resolve(0, start));
+
+	for (int i = 0; i < 100; ++i) {
+		EXPECT_TRUE(probe.resolve(codes[i], start + (i + 1) * 1ms));
+		EXPECT_FALSE(probe.resolve(codes[i], start + 1s));
+	}
+
+	auto stats = probe.stats();
+	EXPECT_EQ(stats.Triggers, 100);
+	EXPECT_EQ(stats.Samples, 100);
+	EXPECT_EQ(stats.Min, 1ms);
+	EXPECT_EQ(stats.Max, 100ms);
+	EXPECT_EQ(stats.P50, 50ms);
+	EXPECT_EQ(stats.P95, 95ms);
+	EXPECT_EQ(stats.P99, 99ms);
+	EXPECT_EQ(stats.Mean, 50500us);
+}
+
+TEST_F(LatencyProbeTest, ExpiresUnresolvedTriggers) {
+	using namespace std::chrono_literals;
+	LatencyProbe probe;
+	auto         start = LatencyProbe::clock::now();
+
+	auto rejected = probe.trigger(start);
+	auto missed   = probe.trigger(start);
+	auto late     = probe.trigger(start + 1s);
+	probe.cancel(rejected);
+
+	probe.expire(start + LatencyProbe::Timeout);
+	EXPECT_FALSE(probe.resolve(rejected, start + 1ms));
+	EXPECT_FALSE(probe.resolve(missed, start + 1ms));
+	EXPECT_TRUE(probe.resolve(late, start + 5500ms));
+
+	auto stats = probe.stats();
+	EXPECT_EQ(stats.Triggers, 2);
+	EXPECT_EQ(stats.Samples, 1);
+	EXPECT_EQ(stats.Misses, 1);
+	EXPECT_EQ(stats.Max, 4500ms);
+}
+
+} // namespace yams
@@ -0,0 +1,58 @@
+#include "LayerEffects.hpp"
+
+#include <cmath>
+#include <numbers>
+
+namespace yams {
+
+namespace {
+using Matrix = std::array<std::array<double, 3>, 3>;
+
+Matrix multiply(const Matrix &a, const Matrix &b) {
+	Matrix res{};
+	for (size_t i = 0; i < 3; ++i) {
+		for (size_t j = 0; j < 3; ++j) {
+			for (size_t k = 0; k < 3; ++k) {
+				res[i][j] += a[i][k] * b[k][j];
+			}
+		}
+	}
+	return res;
+}
+} // namespace
+
+std::array<float, 12> LayerEffects::colorMatrix() const {
+	// rotation around (1,1,1), keeps greys.
+	const double angle = Hue * std::numbers::pi / 180.0;
+	const double c = std::cos(angle), s = std::sin(angle) / std::sqrt(3.0);
+	const double t = (1.0 - c) / 3.0;
+
+	Matrix hue{{
+	    {c + t, t - s, t + s},
+	    {t + s, c + t, t - s},
+	    {t - s, t + s, c + t},
+	}};
+
+	// BT.709 luma.
+	constexpr std::array<double, 3> luma = {0.2126, 0.7152, 0.0722};
+	Matrix                          saturation{};
+	for (size_t i = 0; i < 3; ++i) {
+		for (size_t j = 0; j < 3; ++j) {
+			saturation[i][j] =
+			    (1.0 - Saturation) * luma[j] + (i == j ? Saturation : 0.0);
+		}
+	}
+
+	auto                  m      = multiply(saturation, hue);
+	double                offset = 0.5 * (1.0 - Contrast) + Brightness;
+	std::array<float, 12> res;
+	for (size_t i = 0; i < 3; ++i) {
+		for (size_t j = 0; j < 3; ++j) {
+			res[4 * i + j] = float(Tint[i] * Contrast * m[i][j]);
+		}
+		res[4 * i + 3] = float(Tint[i] * offset);
+	}
+	return res;
+}
+
+} // namespace yams
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+
+namespace yams {
+
+/// Per-layer image adjustments, applied by a single shader on each input of
+/// the layer, see shaders/layereffects.fragment.
+///
+/// Every parameter is a shader uniform: changing it never renegotiates caps
+/// nor relinks the pipeline, and shows on the next composited frame.
+struct LayerEffects {
+	// fractions of the source cut from each side.
+	double CropLeft = 0.0, CropTop = 0.0, CropRight = 0.0, CropBottom = 0.0;
+	// offset of the centre, in fractions of the frame.
+	double X = 0.0, Y = 0.0;
+	double Scale = 1.0;
+	// clockwise, in degrees.
+	double Rotation = 0.0;
+
+	// added to each channel, in [-1,1].
+	double Brightness = 0.0;
+	// around mid grey, 1 keeps the source.
+	double Contrast = 1.0;
+	// 0 is greyscale, 1 keeps the source.
+	double Saturation = 1.0;
+	// rotation around the grey axis, in degrees.
+	double Hue = 0.0;
+	// multiplies each channel after the other adjustments.
+	std::array<double, 3> Tint = {1.0, 1.0, 1.0};
+
+	/// The colour adjustments fused in one affine transform, row major:
+	/// each output channel is M0*r + M1*g + M2*b + M3.
+	std::array<float, 12> colorMatrix() const;
+
+	bool operator==(const LayerEffects &) const = default;
+};
+
+} // namespace yams
@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+
+#include "LayerEffects.hpp"
+
+namespace yams {
+
+class LayerEffectsTest : public ::testing::Test {
+protected:
+	static std::array<float, 3>
+	apply(const LayerEffects &effects, std::array<float, 3> rgb) {
+		auto                 m = effects.colorMatrix();
+		std::array<float, 3> res;
+		for (size_t i = 0; i < 3; ++i) {
+			res[i] = m[4 * i] * rgb[0] + m[4 * i + 1] * rgb[1] +
+			         m[4 * i + 2] * rgb[2] + m[4 * i + 3];
+		}
+		return res;
+	}
+
+	static void expectColor(
+	    const std::array<float, 3> &actual, const std::array<float, 3> &expected
+	) {
+		for (size_t i = 0; i < 3; ++i) {
+			EXPECT_NEAR(actual[i], expected[i], 1e-5) << "channel " << i;
+		}
+	}
+};
+
+TEST_F(LayerEffectsTest, DefaultsAreIdentity) {
+	auto m = LayerEffects{}.colorMatrix();
+	for (size_t i = 0; i < 3; ++i) {
+		for (size_t j = 0; j < 4; ++j) {
+			EXPECT_NEAR(m[4 * i + j], i == j ? 1.0 : 0.0, 1e-6);
+		}
+	}
+}
+
+TEST_F(LayerEffectsTest, HueKeepsGreysAndRotatesPrimaries) {
+	LayerEffects effects{.Hue = 120.0};
+	expectColor(apply(effects, {0.3, 0.3, 0.3}), {0.3, 0.3, 0.3});
+	expectColor(apply(effects, {1.0, 0.0, 0.0}), {0.0, 1.0, 0.0});
+	expectColor(apply(effects, {0.0, 1.0, 0.0}), {0.0, 0.0, 1.0});
+}
+
+TEST_F(LayerEffectsTest, SaturationContrastBrightnessAndTint) {
+	expectColor(
+	    apply(LayerEffects{.Saturation = 0.0}, {1.0, 0.0, 0.0}),
+	    {0.2126, 0.2126, 0.2126}
+	);
+	expectColor(
+	    apply(LayerEffects{.Contrast = 2.0}, {0.75, 0.5, 0.25}),
+	    {1.0, 0.5, 0.0}
+	);
+	expectColor(
+	    apply(LayerEffects{.Brightness = 0.1}, {0.5, 0.5, 0.5}),
+	    {0.6, 0.6, 0.6}
+	);
+	expectColor(
+	    apply(LayerEffects{.Tint = {1.0, 0.5, 0.0}}, {0.8, 0.8, 0.8}),
+	    {0.8, 0.4, 0.0}
+	);
+}
+
+} // namespace yams
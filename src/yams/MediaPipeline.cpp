@@ -3,20 +3,28 @@
 #include "yams/utils/defer.hpp"
 
 #include <chrono>
+#include <cstring>
 #include <glib-object.h>
 #include <gst/gstcaps.h>
 #include <gst/gstclock.h>
 #include <gst/gstelement.h>
 #include <gst/gstmessage.h>
+#include <gst/gstpad.h>
 #include <gst/gstpipeline.h>
 #include <gst/gstsystemclock.h>
 #include <gst/gstutils.h>
 
 #include <cpptrace/exceptions.hpp>
 
+#include <QFile>
+#include <QMetaObject>
+
 #include <optional>
 #include <string>
+#include <yams/LatencyProbe.hpp>
 #include <yams/gstreamer/Factory.hpp>
+#include <yams/gstreamer/QOpenGL.hpp>
+#include <yams/utils/Trace.hpp>
 #include <yams/utils/fractional.hpp>
 
 namespace yams {
@@ -25,9 +33,35 @@ MediaPipeline::MediaPipeline(Args args, Compositor *parent)
     : Pipeline{("media" + std::to_string(args.LayerID) + "_"+std::to_string(args.SinkID)).c_str(), (QObject *)parent}
     , d_logger{slog::With(slog::String(
           "pipeline", (const char *)GST_OBJECT_NAME(d_pipeline.get())
-      ))} {
-
-	auto clock = GstClockPtr{gst_system_clock_obtain()};
+      ))}
+    , d_layerID{args.LayerID}
+    , d_display{args.Display}
+    , d_context{args.Context}
+    , d_stride{size_t(args.Size.width()) * 4}
+    , d_started{metrics::Registry::Global().counter(
+          "yams_media_started_total",
+          "Medias started on a layer.",
+          {{"layer", std::to_string(args.LayerID)}}
+      )}
+    , d_eos{metrics::Registry::Global().counter(
+          "yams_media_eos_total",
+          "Medias that reached end of stream on a layer.",
+          {{"layer", std::to_string(args.LayerID)}}
+      )}
+    , d_errors{metrics::Registry::Global().counter(
+          "yams_media_errors_total",
+          "Medias stopped by an error on a layer.",
+          {{"layer", std::to_string(args.LayerID)}}
+      )}
+    , d_prerollTime{metrics::Registry::Global().histogram(
+          "yams_preroll_seconds",
+          "Delay between a preroll request and its first decoded frame."
+      )} {
+
+	auto clock = GstClockPtr{
+	    args.Clock != nullptr ? GST_CLOCK(gst_object_ref(args.Clock))
+	                          : gst_system_clock_obtain()
+	};
 	gst_pipeline_use_clock(GST_PIPELINE(d_pipeline.get()), clock.get());
 
 	auto [num, denum] = yams::build_fraction(args.FPS);
@@ -46,6 +80,9 @@ MediaPipeline::MediaPipeline(Args args, Compositor *parent)
 	if (testCaps == nullptr) {
 		throw cpptrace::logic_error{"invalid videotestsrc caps"};
 	}
+	if (args.LatencyStamp == true) {
+		gst_caps_set_simple(testCaps, "format", G_TYPE_STRING, "RGBA", nullptr);
+	}
 	defer {
 		gst_caps_unref(testCaps);
 	};
@@ -73,8 +110,74 @@ MediaPipeline::MediaPipeline(Args args, Compositor *parent)
 	);
 	d_timeOverlay =
 	    GstElementFactoryMakeFull("timeoverlay", "name", "timeoverlay0");
+	if (args.LatencyStamp == true) {
+		auto src = GstPadPtr{
+		    gst_element_get_static_pad(d_timeOverlay.get(), "src")
+		};
+		gst_pad_add_probe(
+		    src.get(),
+		    GST_PAD_PROBE_TYPE_BUFFER,
+		    (GstPadProbeCallback)&MediaPipeline::onStampProbe,
+		    this,
+		    nullptr
+		);
+	}
+	if (d_display != nullptr) {
+		// clang-format off
+		auto glCaps = gst_caps_new_simple(
+		    "video/x-raw",
+		    "format", G_TYPE_STRING, "RGBA",
+		    "framerate", GST_TYPE_FRACTION, num, denum,
+		    "width", G_TYPE_INT, args.Size.width(),
+		    "height", G_TYPE_INT, args.Size.height(),
+		    nullptr
+		);
+		// clang-format on
+		if (glCaps == nullptr) {
+			throw cpptrace::logic_error{"invalid gltestsrc caps"};
+		}
+		gst_caps_set_features(
+		    glCaps,
+		    0,
+		    gst_caps_features_new("memory:GLMemory", nullptr)
+		);
+		defer {
+			gst_caps_unref(glCaps);
+		};
+
+		QFile shader{":shaders/testpattern.fragment"};
+		if (shader.open(QIODevice::ReadOnly) == false) {
+			throw cpptrace::runtime_error{"could not read test pattern shader"};
+		}
+		auto fragment = shader.readAll().toStdString();
+
+		d_glTestSource =
+		    GstElementFactoryMakeFull("gltestsrc", "name", "gltest0");
+		d_glTestCapsfilter = GstElementFactoryMakeFull(
+		    "capsfilter",
+		    "name",
+		    "glTestCaps0",
+		    "caps",
+		    glCaps
+		);
+		d_glOverlay = GstElementFactoryMakeFull(
+		    "glshader",
+		    "name",
+		    "glOverlay0",
+		    "fragment",
+		    fragment.c_str()
+		);
+		updateTestUniforms();
+	}
+
 	d_proxySink = GstElementFactoryMakeFull("proxysink", "name", "sink0");
 	d_decodeBin = GstElementFactoryMakeFull("decodebin", "name", "decode0");
+	g_signal_connect(
+	    d_decodeBin.get(),
+	    "deep-element-added",
+	    G_CALLBACK(&MediaPipeline::onDecoderAdded),
+	    this
+	);
 	d_decodeCapsfilter = GstElementFactoryMakeFull(
 	    "capsfilter",
 	    "name",
@@ -96,6 +199,19 @@ MediaPipeline::MediaPipeline(Args args, Compositor *parent)
 		throw cpptrace::runtime_error("could not link final element");
 	}
 
+	if (trace::enabled()) {
+		auto sink = GstPadPtr{
+		    gst_element_get_static_pad(d_proxySink.get(), "sink")
+		};
+		gst_pad_add_probe(
+		    sink.get(),
+		    GST_PAD_PROBE_TYPE_BUFFER,
+		    (GstPadProbeCallback)&MediaPipeline::onDecodeOutProbe,
+		    this,
+		    nullptr
+		);
+	}
+
 	// we disable auto-flushing to see this pipeline go to null state. All
 	// message are processed in our QThread, so it is fine.
 	gst_pipeline_set_auto_flush_bus(GST_PIPELINE(d_pipeline.get()), false);
@@ -105,15 +221,195 @@ MediaPipeline::~MediaPipeline() {
 	gst_element_set_state(d_pipeline.get(), GST_STATE_NULL);
 }
 
+GstPadProbeReturn MediaPipeline::onDecodeOutProbe(
+    GstPad *pad, GstPadProbeInfo *info, MediaPipeline *self
+) {
+	trace::mark(
+	    trace::Stage::DecodeOut,
+	    self->d_layerID,
+	    GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info))
+	);
+	return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn MediaPipeline::onStampProbe(
+    GstPad *pad, GstPadProbeInfo *info, MediaPipeline *self
+) {
+	auto code = self->d_latencyStamp.load();
+	if (code == 0) {
+		return GST_PAD_PROBE_OK;
+	}
+	auto buffer = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+	GST_PAD_PROBE_INFO_DATA(info) = buffer;
+
+	GstMapInfo map;
+	if (gst_buffer_map(buffer, &map, GST_MAP_WRITE) == false) {
+		return GST_PAD_PROBE_OK;
+	}
+	if (self->d_stride >= 4 * LatencyProbe::RegionWidth &&
+	    map.size >= self->d_stride * LatencyProbe::RegionHeight) {
+		LatencyProbe::Stamp(map.data, self->d_stride, code);
+	}
+	gst_buffer_unmap(buffer, &map);
+	return GST_PAD_PROBE_OK;
+}
+
+void MediaPipeline::setLatencyStamp(uint32_t code) {
+	d_latencyStamp.store(code);
+	if (d_glOverlay != nullptr) {
+		updateTestUniforms();
+	}
+}
+
+void MediaPipeline::updateTestUniforms() {
+	auto code = d_latencyStamp.load();
+	// clang-format off
+	auto uniforms = gst_structure_new(
+	    "uniforms",
+	    "pattern", G_TYPE_INT, d_overlayPattern,
+	    "stamped", G_TYPE_INT, int(code != 0),
+	    "stamp_hi", G_TYPE_FLOAT, float(code >> 16),
+	    "stamp_lo", G_TYPE_FLOAT, float(code & 0xffff),
+	    nullptr
+	);
+	// clang-format on
+	g_object_set(d_glOverlay.get(), "uniforms", uniforms, nullptr);
+	gst_structure_free(uniforms);
+}
+
+void MediaPipeline::setDegradation(Degradation degradation) {
+	std::lock_guard lock{d_decodersMutex};
+	if (d_degradation == degradation) {
+		return;
+	}
+	d_degradation = degradation;
+	for (const auto &decoder : d_decoders) {
+		applyDegradation(decoder.get(), degradation);
+	}
+}
+
+void MediaPipeline::onDecoderAdded(
+    GstBin *bin, GstBin *subBin, GstElement *element, MediaPipeline *self
+) {
+	auto klass = gst_element_get_metadata(element, GST_ELEMENT_METADATA_KLASS);
+	if (klass == nullptr || std::strstr(klass, "Decoder") == nullptr ||
+	    std::strstr(klass, "Video") == nullptr) {
+		return;
+	}
+	std::lock_guard lock{self->d_decodersMutex};
+	self->d_decoders.emplace_back(GST_ELEMENT(gst_object_ref(element)));
+	self->applyDegradation(element, self->d_degradation);
+}
+
+void MediaPipeline::applyDegradation(
+    GstElement *decoder, Degradation degradation
+) {
+	// Only libav decoders expose these knobs, others are left untouched.
+	auto klass = G_OBJECT_GET_CLASS(decoder);
+	if (g_object_class_find_property(klass, "skip-frame") != nullptr) {
+		// 1: skip B-frames, the non reference ones.
+		gst_util_set_object_arg(
+		    G_OBJECT(decoder),
+		    "skip-frame",
+		    degradation.SkipNonReference ? "1" : "0"
+		);
+	}
+	if (g_object_class_find_property(klass, "lowres") != nullptr) {
+		// 1: half resolution, the mixer pad scales it back.
+		gst_util_set_object_arg(
+		    G_OBJECT(decoder),
+		    "lowres",
+		    degradation.ReducedResolution ? "1" : "0"
+		);
+	}
+	d_logger.Debug(
+	    "decoder degradation",
+	    slog::String("decoder", (const char *)GST_OBJECT_NAME(decoder)),
+	    slog::Bool("skip_non_reference", degradation.SkipNonReference),
+	    slog::Bool("reduced_resolution", degradation.ReducedResolution)
+	);
+}
+
 GstElement *MediaPipeline::proxySink() {
 	return d_proxySink.get();
 }
 
 void MediaPipeline::play(const MediaPlayInfo &infos) {
+	if (d_prerolled.has_value() && d_prerolled.value() == infos) {
+		d_logger.Info("starting prerolled media");
+		d_prerolled.reset();
+		gst_pad_remove_probe(
+		    GstPadPtr{gst_element_get_static_pad(d_queue.get(), "src")}.get(),
+		    d_prerollProbe
+		);
+		d_prerollProbe = 0;
+		d_started.inc();
+		gst_element_set_state(d_pipeline.get(), GST_STATE_PLAYING);
+		return;
+	}
+	if (d_prerolled.has_value()) {
+		d_logger.Info("dropping prerolled media for another one");
+		cancel();
+	}
 	if (d_playing == true) {
 		d_logger.Error("already playing");
 		return;
 	}
+	d_started.inc();
+	start(infos);
+}
+
+void MediaPipeline::preroll(const MediaPlayInfo &infos) {
+	if (d_playing == true) {
+		d_logger.Error("cannot preroll, already playing");
+		return;
+	}
+	// blocks the first decoded buffer before the proxysink, the queue and
+	// the decoder stay filled until play().
+	d_prerollDone.store(false);
+	d_prerollStart = std::chrono::steady_clock::now();
+	d_prerollProbe = gst_pad_add_probe(
+	    GstPadPtr{gst_element_get_static_pad(d_queue.get(), "src")}.get(),
+	    GstPadProbeType(GST_PAD_PROBE_TYPE_BLOCK | GST_PAD_PROBE_TYPE_BUFFER),
+	    (GstPadProbeCallback)&MediaPipeline::onPrerollProbe,
+	    this,
+	    nullptr
+	);
+	d_prerolled   = infos;
+	d_targetState = GST_STATE_PAUSED;
+	start(infos);
+	d_targetState = GST_STATE_PLAYING;
+	if (d_playing == false) {
+		// could not build the pipeline.
+		cancel();
+	}
+}
+
+GstPadProbeReturn MediaPipeline::onPrerollProbe(
+    GstPad *pad, GstPadProbeInfo *info, MediaPipeline *self
+) {
+	if (self->d_prerollDone.exchange(true) == false) {
+		self->d_prerollTime.record(
+		    std::chrono::steady_clock::now() - self->d_prerollStart
+		);
+		QMetaObject::invokeMethod(
+		    self,
+		    &MediaPipeline::Prerolled,
+		    Qt::QueuedConnection
+		);
+	}
+	return GST_PAD_PROBE_OK;
+}
+
+void MediaPipeline::cancel() {
+	if (d_playing == false && d_prerolled.has_value() == false) {
+		return;
+	}
+	gst_element_set_state(d_pipeline.get(), GST_STATE_NULL);
+	reset();
+}
+
+void MediaPipeline::start(const MediaPlayInfo &infos) {
 	d_currentMedia = infos.MediaType;
 	switch (infos.MediaType) {
 	case MediaPlayInfo::Type::IMAGE:
@@ -126,6 +422,17 @@ void MediaPipeline::play(const MediaPlayInfo &infos) {
 	}
 }
 
+GstBusSyncReply MediaPipeline::onSyncMessage(GstMessage *msg) noexcept {
+	if (GST_MESSAGE_TYPE(msg) != GST_MESSAGE_NEED_CONTEXT ||
+	    d_display == nullptr) {
+		return GST_BUS_PASS;
+	}
+	if (setGLContext(msg, d_display, d_context) == true) {
+		return GST_BUS_DROP;
+	}
+	return GST_BUS_PASS;
+}
+
 void MediaPipeline::onMessage(GstMessage *msg) noexcept {
 	switch (GST_MESSAGE_TYPE(msg)) {
 	case GST_MESSAGE_ERROR: {
@@ -152,8 +459,17 @@ void MediaPipeline::onMessage(GstMessage *msg) noexcept {
 	}
 	case GST_MESSAGE_EOS:
 		d_logger.Info("EOS", slog::String("src", (const char *)msg->src->name));
+		d_eos.inc();
 		onEOS();
 		break;
+	case GST_MESSAGE_QOS: {
+		gint64 jitter{0};
+		gst_message_parse_qos_values(msg, &jitter, nullptr, nullptr);
+		if (jitter > 0) {
+			emit Late();
+		}
+		break;
+	}
 	case GST_MESSAGE_STATE_CHANGED: {
 		if (GST_OBJECT(d_pipeline.get()) != msg->src) {
 			break;
@@ -163,7 +479,9 @@ void MediaPipeline::onMessage(GstMessage *msg) noexcept {
 
 		gst_message_parse_state_changed(msg, &oldState, &newState, &pending);
 
-		if (newState != GST_STATE_NULL) {
+		// cancel() already reset it, and it may play again since.
+		if (newState != GST_STATE_NULL ||
+		    GST_STATE(d_pipeline.get()) != GST_STATE_NULL) {
 			break;
 		}
 		reset();
@@ -190,6 +508,7 @@ void MediaPipeline::forceDownstreamEOS() {
 }
 
 void MediaPipeline::onError() {
+	d_errors.inc();
 	// send EOS event on proxySink
 	forceDownstreamEOS();
 	emit Error();
@@ -198,6 +517,18 @@ void MediaPipeline::onError() {
 
 void MediaPipeline::reset() {
 	d_logger.Info("resetting after reaching NULL");
+	{
+		std::lock_guard lock{d_decodersMutex};
+		d_decoders.clear();
+	}
+	if (d_prerollProbe != 0) {
+		gst_pad_remove_probe(
+		    GstPadPtr{gst_element_get_static_pad(d_queue.get(), "src")}.get(),
+		    d_prerollProbe
+		);
+		d_prerollProbe = 0;
+	}
+	d_prerolled.reset();
 
 	if (d_currentMedia.has_value()) {
 		switch (d_currentMedia.value()) {
@@ -219,6 +550,23 @@ void MediaPipeline::reset() {
 			);
 			break;
 		case MediaPlayInfo::Type::TEST:
+			if (d_glTest == true) {
+				gst_element_unlink_many(
+				    d_glTestSource.get(),
+				    d_glTestCapsfilter.get(),
+				    d_glOverlay.get(),
+				    d_queue.get(),
+				    nullptr
+				);
+				gst_bin_remove_many(
+				    GST_BIN(d_pipeline.get()),
+				    d_glTestSource.get(),
+				    d_glTestCapsfilter.get(),
+				    d_glOverlay.get(),
+				    nullptr
+				);
+				break;
+			}
 			gst_element_unlink_many(
 			    d_testSource.get(),
 			    d_testCapsfilter.get(),
@@ -238,6 +586,7 @@ void MediaPipeline::reset() {
 	}
 
 	d_playing      = false;
+	d_glTest       = false;
 	d_currentMedia = std::nullopt;
 }
 
@@ -273,7 +622,7 @@ void MediaPipeline::playFile(const MediaPlayInfo &infos) {
 		);
 		return;
 	}
-	gst_element_set_state(d_pipeline.get(), GST_STATE_PLAYING);
+	gst_element_set_state(d_pipeline.get(), d_targetState);
 	d_playing      = true;
 	d_currentMedia = infos.MediaType;
 }
@@ -329,6 +678,33 @@ void MediaPipeline::playTest(const MediaPlayInfo &infos) {
 	    )
 	);
 
+	// patterns gltestsrc renders, or the overlay shader draws over its
+	// black one. Others need the CPU videotestsrc.
+	static std::map<std::string, std::pair<int, int>> glPatternByName = {
+	    {"smpte", {0, 0}},
+	    {"snow", {1, 0}},
+	    {"black", {2, 0}},
+	    {"white", {3, 0}},
+	    {"red", {4, 0}},
+	    {"green", {5, 0}},
+	    {"blue", {6, 0}},
+	    {"checkers-1", {7, 0}},
+	    {"checkers-2", {8, 0}},
+	    {"checkers-4", {9, 0}},
+	    {"checkers-8", {10, 0}},
+	    {"circular", {11, 0}},
+	    {"blink", {12, 0}},
+	    {"ball", {2, 1}},
+	    {"gradient", {2, 2}},
+	    {"colors", {2, 3}},
+	    {"bar", {2, 4}},
+	};
+	if (d_glTestSource != nullptr && glPatternByName.count(patternName) > 0) {
+		auto [pattern, overlayPattern] = glPatternByName.at(patternName);
+		playGLTest(buffers, pattern, overlayPattern);
+		return;
+	}
+
 	g_object_set(
 	    d_testSource.get(),
 	    "pattern",
@@ -364,8 +740,54 @@ void MediaPipeline::playTest(const MediaPlayInfo &infos) {
 		return;
 	}
 
-	gst_element_set_state(d_pipeline.get(), GST_STATE_PLAYING);
+	gst_element_set_state(d_pipeline.get(), d_targetState);
+	d_playing      = true;
+	d_currentMedia = MediaPlayInfo::Type::TEST;
+}
+
+void MediaPipeline::playGLTest(
+    uint64_t buffers, int pattern, int overlayPattern
+) {
+	g_object_set(
+	    d_glTestSource.get(),
+	    "pattern",
+	    pattern,
+	    "num-buffers",
+	    gint(buffers),
+	    nullptr
+	);
+	d_overlayPattern = overlayPattern;
+	updateTestUniforms();
+
+	auto bin = GST_BIN(d_pipeline.get());
+	gst_bin_add_many(
+	    bin,
+	    g_object_ref(d_glTestSource.get()),
+	    g_object_ref(d_glTestCapsfilter.get()),
+	    g_object_ref(d_glOverlay.get()),
+	    nullptr
+	);
+	if (gst_element_link_many(
+	        d_glTestSource.get(),
+	        d_glTestCapsfilter.get(),
+	        d_glOverlay.get(),
+	        d_queue.get(),
+	        nullptr
+	    ) == false) {
+		d_logger.Error("could not link GL test pipeline");
+		gst_bin_remove_many(
+		    bin,
+		    d_glTestSource.get(),
+		    d_glTestCapsfilter.get(),
+		    d_glOverlay.get(),
+		    nullptr
+		);
+		return;
+	}
+
+	gst_element_set_state(d_pipeline.get(), d_targetState);
 	d_playing      = true;
+	d_glTest       = true;
 	d_currentMedia = MediaPlayInfo::Type::TEST;
 }
 
@@ -1,12 +1,23 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <vector>
 #include <slog++/slog++.hpp>
 
+#include <gst/gl/gstgl_fwd.h>
+#include <gst/gstclock.h>
+#include <gst/gstelement.h>
+#include <gst/gstpad.h>
+
 #include <QSize>
 
 #include <yams/MediaPlayInfo.hpp>
 #include <yams/gstreamer/Pipeline.hpp>
+#include <yams/utils/Metrics.hpp>
 
 namespace yams {
 class Compositor;
@@ -19,6 +30,22 @@ public:
 		size_t SinkID  = 0;
 		QSize  Size    = {1920, 1080};
 		qreal  FPS     = 60.0;
+		// Test sources produce RGBA frames stamped with a LatencyProbe code.
+		bool LatencyStamp = false;
+		// GL objects of the compositor. When set, test patterns are
+		// rendered on the GPU.
+		GstGLDisplay *Display = nullptr;
+		GstGLContext *Context = nullptr;
+		// the system clock if nullptr.
+		GstClock *Clock = nullptr;
+	};
+
+	/// Decoding shortcuts requested under overload, see QoSGovernor.
+	struct Degradation {
+		bool SkipNonReference  = false;
+		bool ReducedResolution = false;
+
+		bool operator==(const Degradation &) const = default;
 	};
 
 	MediaPipeline(Args args, Compositor *parent);
@@ -31,13 +58,28 @@ public:
 
 	GstElement *proxySink();
 
+	/// Code stamped in the next test frames, 0 disables stamping.
+	void setLatencyStamp(uint32_t code);
+
+	/// Applied to the current and future decoders, when they support it.
+	void setDegradation(Degradation degradation);
+
 signals:
 	void EOS();
 	void Error();
+	// an element of the pipeline processed or dropped a late buffer.
+	void Late();
+	// the first frame of a preroll() is decoded and waits for play().
+	void Prerolled();
 
 public slots:
 	void play(const MediaPlayInfo &infos);
 	void stop();
+	// Opens and decodes a media up to its first frame, so a later play()
+	// of the same media starts without any delay.
+	void preroll(const MediaPlayInfo &infos);
+	// Tears down the current media at once, without EOS.
+	void cancel();
 
 protected:
 	void forceDownstreamEOS();
@@ -46,19 +88,63 @@ protected:
 	void onError();
 	void reset();
 
+	void start(const MediaPlayInfo &infos);
 	void playFile(const MediaPlayInfo &infos);
 	void playTest(const MediaPlayInfo &infos);
+	void playGLTest(uint64_t buffers, int pattern, int overlayPattern);
+	void updateTestUniforms();
+
+	void            onMessage(GstMessage *msg) noexcept override;
+	GstBusSyncReply onSyncMessage(GstMessage *msg) noexcept override;
+
+	static GstPadProbeReturn
+	onDecodeOutProbe(GstPad *pad, GstPadProbeInfo *info, MediaPipeline *self);
 
-	void onMessage(GstMessage *msg) noexcept override;
+	static GstPadProbeReturn
+	onStampProbe(GstPad *pad, GstPadProbeInfo *info, MediaPipeline *self);
+
+	static GstPadProbeReturn
+	onPrerollProbe(GstPad *pad, GstPadProbeInfo *info, MediaPipeline *self);
+
+	static void onDecoderAdded(
+	    GstBin *bin, GstBin *subBin, GstElement *element, MediaPipeline *self
+	);
+
+	void applyDegradation(GstElement *decoder, Degradation degradation);
 
 	slog::Logger<1> d_logger;
+	size_t          d_layerID;
 	GstElementPtr   d_fileSource, d_decodeBin, d_decodeCapsfilter, d_testSource,
 	    d_testCapsfilter, d_timeOverlay, d_queue, d_proxySink;
 
+	GstGLDisplay *d_display;
+	GstGLContext *d_context;
+	GstElementPtr d_glTestSource, d_glTestCapsfilter, d_glOverlay;
+	bool          d_glTest{false};
+	int           d_overlayPattern{0};
+
 	uint64_t d_framerateNum, d_framerateDenum;
 
 	std::optional<MediaPlayInfo::Type> d_currentMedia;
 	bool                               d_playing{false};
+	// state reached by start(), PAUSED while prerolling.
+	GstState d_targetState{GST_STATE_PLAYING};
+
+	std::optional<MediaPlayInfo>          d_prerolled;
+	gulong                                d_prerollProbe{0};
+	std::atomic<bool>                     d_prerollDone{false};
+	std::chrono::steady_clock::time_point d_prerollStart;
+
+	size_t                d_stride;
+	std::atomic<uint32_t> d_latencyStamp{0};
+
+	// decoders are added from streaming threads.
+	std::mutex                 d_decodersMutex;
+	std::vector<GstElementPtr> d_decoders;
+	Degradation                d_degradation;
+
+	metrics::Counter   &d_started, &d_eos, &d_errors;
+	metrics::Histogram &d_prerollTime;
 };
 
 }; // namespace yams
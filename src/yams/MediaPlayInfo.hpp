@@ -18,6 +18,8 @@ struct MediaPlayInfo {
 	std::chrono::nanoseconds Duration;
 	std::chrono::nanoseconds Fade{0};
 	bool                     Loop{false};
+
+	bool operator==(const MediaPlayInfo &) const = default;
 };
 
 } // namespace yams
@@ -0,0 +1,56 @@
+#include "OutputMapping.hpp"
+
+namespace yams {
+
+OutputMapping::Corners
+OutputMapping::Fit(double regionAspect, double outputAspect) {
+	double width = 1.0, height = 1.0;
+	if (regionAspect > outputAspect) {
+		height = outputAspect / regionAspect;
+	} else {
+		width = regionAspect / outputAspect;
+	}
+	double left = 0.5 - width / 2.0, top = 0.5 - height / 2.0;
+	return {{
+	    {left, top},
+	    {left + width, top},
+	    {left + width, top + height},
+	    {left, top + height},
+	}};
+}
+
+OutputMapping::Matrix3 OutputMapping::Homography(const Corners &corners) {
+	// square to quad, from Heckbert's "Fundamentals of Texture Mapping".
+	std::array<double, 4> x, y;
+	for (size_t i = 0; i < 4; ++i) {
+		x[i] = 2.0 * corners[i][0] - 1.0;
+		y[i] = 1.0 - 2.0 * corners[i][1];
+	}
+	double dx1 = x[1] - x[2], dx2 = x[3] - x[2];
+	double dy1 = y[1] - y[2], dy2 = y[3] - y[2];
+	double dx3 = x[0] - x[1] + x[2] - x[3];
+	double dy3 = y[0] - y[1] + y[2] - y[3];
+
+	double g = 0.0, h = 0.0;
+	double den = dx1 * dy2 - dx2 * dy1;
+	if ((dx3 != 0.0 || dy3 != 0.0) && den != 0.0) {
+		g = (dx3 * dy2 - dx2 * dy3) / den;
+		h = (dx1 * dy3 - dx3 * dy1) / den;
+	}
+	double a = x[1] - x[0] + g * x[1], b = x[3] - x[0] + h * x[3];
+	double d = y[1] - y[0] + g * y[1], e = y[3] - y[0] + h * y[3];
+
+	return {
+	    float(a),
+	    float(d),
+	    float(g),
+	    float(b),
+	    float(e),
+	    float(h),
+	    float(x[0]),
+	    float(y[0]),
+	    1.0f,
+	};
+}
+
+} // namespace yams
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <optional>
+
+namespace yams {
+
+/// How a VideoOutput presents the composition: the region it shows, where
+/// that region lands on the output, and the edge blend ramps for
+/// overlapping projectors. Applied by shaders/frame.vertex and
+/// shaders/frame.fragment.
+struct OutputMapping {
+	// x,y in fractions of a frame, y going down.
+	using Point   = std::array<double, 2>;
+	using Corners = std::array<Point, 4>;
+	// column major, as glUniformMatrix3fv expects.
+	using Matrix3 = std::array<float, 9>;
+
+	// region of the composition shown, in fractions of the frame.
+	double SourceX = 0.0, SourceY = 0.0;
+	double SourceWidth = 1.0, SourceHeight = 1.0;
+
+	// top-left, top-right, bottom-right and bottom-left corners of the
+	// region on the output, in fractions of the output. Keystone and
+	// projection warps are exact, the quad is mapped by a homography. When
+	// unset, the region is centred keeping its aspect ratio.
+	std::optional<Corners> Warp;
+
+	// width of the blend ramps on each edge of the region, in fractions of
+	// the region.
+	double BlendLeft = 0.0, BlendTop = 0.0, BlendRight = 0.0, BlendBottom = 0.0;
+	// response of the projectors, the ramps are linear in light.
+	double BlendGamma = 2.2;
+
+	/// Corners of a region centred in an output, keeping its aspect ratio.
+	static Corners Fit(double regionAspect, double outputAspect);
+
+	/// Maps the unit square to normalized device coordinates, (0,0) on the
+	/// first corner and (1,1) on the third one.
+	static Matrix3 Homography(const Corners &corners);
+};
+
+} // namespace yams
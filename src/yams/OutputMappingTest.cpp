@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include "OutputMapping.hpp"
+
+namespace yams {
+
+class OutputMappingTest : public ::testing::Test {
+protected:
+	// normalized device coordinates of a point of the unit square.
+	static OutputMapping::Point
+	map(const OutputMapping::Matrix3 &m, double u, double v) {
+		double x = m[0] * u + m[3] * v + m[6];
+		double y = m[1] * u + m[4] * v + m[7];
+		double w = m[2] * u + m[5] * v + m[8];
+		return {x / w, y / w};
+	}
+
+	static void expectPoint(
+	    const OutputMapping::Point &actual, const OutputMapping::Point &expected
+	) {
+		EXPECT_NEAR(actual[0], expected[0], 1e-5);
+		EXPECT_NEAR(actual[1], expected[1], 1e-5);
+	}
+};
+
+TEST_F(OutputMappingTest, FitKeepsAspectRatio) {
+	auto corners = OutputMapping::Fit(16.0 / 9.0, 4.0 / 3.0);
+	expectPoint(corners[0], {0.0, 0.125});
+	expectPoint(corners[2], {1.0, 0.875});
+
+	corners = OutputMapping::Fit(1.0, 2.0);
+	expectPoint(corners[0], {0.25, 0.0});
+	expectPoint(corners[2], {0.75, 1.0});
+}
+
+TEST_F(OutputMappingTest, FullFrameIsFlippedIdentity) {
+	auto m = OutputMapping::Homography(OutputMapping::Fit(1.0, 1.0));
+	expectPoint(map(m, 0.0, 0.0), {-1.0, 1.0});
+	expectPoint(map(m, 1.0, 1.0), {1.0, -1.0});
+	expectPoint(map(m, 0.25, 0.5), {-0.5, 0.0});
+}
+
+TEST_F(OutputMappingTest, HomographyMapsKeystoneCorners) {
+	OutputMapping::Corners corners{{
+	    {0.1, 0.0},
+	    {0.9, 0.1},
+	    {1.0, 1.0},
+	    {0.0, 0.8},
+	}};
+	auto m = OutputMapping::Homography(corners);
+	expectPoint(map(m, 0.0, 0.0), {-0.8, 1.0});
+	expectPoint(map(m, 1.0, 0.0), {0.8, 0.8});
+	expectPoint(map(m, 1.0, 1.0), {1.0, -1.0});
+	expectPoint(map(m, 0.0, 1.0), {-1.0, -0.6});
+	// a projective map, not an affine one.
+	EXPECT_NE(m[2], 0.0f);
+}
+
+} // namespace yams
@@ -0,0 +1,836 @@
+#include "OutputTaps.hpp"
+
+#include <algorithm>
+
+#include <slog++/Types.hpp>
+#include <slog++/slog++.hpp>
+
+#include <cpptrace/exceptions.hpp>
+
+#include <glib-object.h>
+#include <glib.h>
+#include <gst/app/gstappsink.h>
+#include <gst/gstcaps.h>
+#include <gst/gstelement.h>
+#include <gst/gstevent.h>
+#include <gst/gstghostpad.h>
+#include <gst/gstobject.h>
+#include <gst/gstparse.h>
+#include <gst/gstutils.h>
+#include <gst/video/video-frame.h>
+#include <gst/video/video-info.h>
+
+#include <yams/gstreamer/Factory.hpp>
+#include <yams/utils/crc32.hpp>
+#include <yams/utils/defer.hpp>
+
+namespace yams {
+using namespace std::chrono_literals;
+
+namespace {
+// wraps a downloaded RGBA sample without copy, the image keeps the buffer
+// mapped until its last copy is gone. Null if the sample can not be mapped.
+QImage mappedImage(GstSample *sample) {
+	GstVideoInfo infos;
+	auto         frame = new GstVideoFrame;
+	if (gst_video_info_from_caps(&infos, gst_sample_get_caps(sample)) ==
+	        false ||
+	    gst_video_frame_map(
+	        frame,
+	        &infos,
+	        gst_sample_get_buffer(sample),
+	        GST_MAP_READ
+	    ) == false) {
+		delete frame;
+		return {};
+	}
+
+	return QImage{
+	    (const uchar *)GST_VIDEO_FRAME_PLANE_DATA(frame, 0),
+	    GST_VIDEO_FRAME_WIDTH(frame),
+	    GST_VIDEO_FRAME_HEIGHT(frame),
+	    GST_VIDEO_FRAME_PLANE_STRIDE(frame, 0),
+	    QImage::Format_RGBA8888,
+	    [](void *data) {
+		    auto frame = reinterpret_cast<GstVideoFrame *>(data);
+		    gst_video_frame_unmap(frame);
+		    delete frame;
+	    },
+	    frame
+	};
+}
+
+GstCaps *downloadedCaps() {
+	// clang-format off
+	auto caps = gst_caps_new_simple(
+	    "video/x-raw",
+	    "format", G_TYPE_STRING, "RGBA",
+	    nullptr
+	);
+	// clang-format on
+	if (caps == nullptr) {
+		throw cpptrace::runtime_error{"could not build downloaded caps"};
+	}
+	return caps;
+}
+} // namespace
+
+struct OutputTaps::PreviewTap {
+	OutputTaps              *self;
+	int                      source;
+	std::chrono::nanoseconds interval;
+	// PTS of the last frame let through, -1 before the first one.
+	std::atomic<int64_t> last{-1};
+};
+
+struct OutputTaps::GrabTap {
+	OutputTaps   *self;
+	int           source;
+	GstElementPtr caps;
+	// size caps is set to, written by the probe only.
+	QSize size;
+};
+
+OutputTaps::OutputTaps(Options options, Args args)
+    : d_logger{slog::With(slog::String(
+          "pipeline", (const char *)GST_OBJECT_NAME(args.Bin)
+      ))}
+    , d_options{std::move(options)}
+    , d_args{args}
+    , d_grabTime{metrics::Registry::Global().histogram(
+          "yams_grab_seconds", "Delay between a grab request and its image."
+      )}
+    , d_recordDropped{metrics::Registry::Global().counter(
+          "yams_record_dropped_frames_total",
+          "Output frames dropped in front of the recording encoder."
+      )}
+    , d_recordQueued{metrics::Registry::Global().gauge(
+          "yams_record_queued_frames",
+          "Output frames waiting for the recording encoder."
+      )}
+    , d_recordLag{metrics::Registry::Global().gauge(
+          "yams_record_lag_seconds",
+          "Output PTS minus the PTS of the last frame encoded for recording."
+      )} {}
+
+OutputTaps::~OutputTaps() = default;
+
+bool OutputTaps::tapsOutput() const {
+	return d_options.ChecksumEvery > 0 || d_options.Record.has_value() ||
+	       tapsLayers();
+}
+
+bool OutputTaps::tapsLayers() const {
+	return d_options.Preview.has_value() || d_options.Grab;
+}
+
+void OutputTaps::addOutputBranches(GstElement *tee) {
+	if (d_options.ChecksumEvery > 0) {
+		addChecksumBranch(tee);
+	}
+	if (d_options.Preview.has_value()) {
+		addPreviewBranch(tee, Program, "program");
+	}
+	if (d_options.Grab) {
+		addGrabBranch(tee, Program, "program");
+	}
+	if (d_options.Record.has_value()) {
+		addRecordBranch(tee, d_options.Record.value());
+	}
+}
+
+void OutputTaps::addLayerBranches(
+    GstElement *tee, int layer, const std::string &name
+) {
+	if (d_options.Preview.has_value()) {
+		addPreviewBranch(tee, layer, name);
+	}
+	if (d_options.Grab) {
+		addGrabBranch(tee, layer, name);
+	}
+}
+
+GstElement *OutputTaps::addBranch(
+    GstElement                      *tee,
+    GstBin                          *bin,
+    const std::string               &queueName,
+    guint                            maxBuffers,
+    const std::vector<GstElement *> &elements,
+    GstPadProbeCallback              probe,
+    gpointer                         data
+) {
+	// only the buffer count limits the queue, GL memory sizes say nothing
+	// of the frames held.
+	// clang-format off
+	auto queue = GstElementFactoryMakeFull(
+	    "queue",
+	    "name", queueName.c_str(),
+	    "max-size-buffers", maxBuffers,
+	    "max-size-bytes", 0,
+	    "max-size-time", guint64(0),
+	    "leaky", 2
+	);
+	// clang-format on
+
+	gst_bin_add(bin, g_object_ref(queue.get()));
+	GstElement *previous = queue.get();
+	for (auto element : elements) {
+		gst_bin_add(bin, GST_ELEMENT_CAST(g_object_ref(element)));
+		if (gst_element_link(previous, element) == false) {
+			throw cpptrace::runtime_error{
+			    "could not link branch " + queueName
+			};
+		}
+		previous = element;
+	}
+
+	auto sink = GstPadPtr{gst_element_get_static_pad(queue.get(), "sink")};
+	GstElement *head = queue.get();
+	if (bin != d_args.Bin) {
+		gst_element_add_pad(
+		    GST_ELEMENT_CAST(bin),
+		    gst_ghost_pad_new("sink", sink.get())
+		);
+		head = GST_ELEMENT_CAST(bin);
+	}
+	if (gst_element_link(tee, head) == false) {
+		throw cpptrace::runtime_error{"could not link branch " + queueName};
+	}
+
+	if (probe != nullptr) {
+		gst_pad_add_probe(
+		    sink.get(),
+		    GST_PAD_PROBE_TYPE_BUFFER,
+		    probe,
+		    data,
+		    nullptr
+		);
+	}
+	return queue.get();
+}
+
+void OutputTaps::addChecksumBranch(GstElement *tee) {
+	// The download and the CRC never delay the output appsink, late
+	// checksums are dropped.
+	auto caps = downloadedCaps();
+	defer {
+		gst_caps_unref(caps);
+	};
+
+	// clang-format off
+	auto download = GstElementFactoryMakeFull(
+	    "gldownload",
+	    "name", "checksumdownload"
+	);
+	auto checksumCaps = GstElementFactoryMakeFull(
+	    "capsfilter",
+	    "name", "checksumcaps",
+	    "caps", caps
+	);
+	auto checksumSink = GstElementFactoryMakeFull(
+	    "appsink",
+	    "name", "checksum0",
+	    "emit-signals", true,
+	    "sync", false
+	);
+	// clang-format on
+
+	g_signal_connect(
+	    checksumSink.get(),
+	    "new-sample",
+	    G_CALLBACK(&OutputTaps::onChecksumSampleCb),
+	    this
+	);
+
+	addBranch(
+	    tee,
+	    d_args.Bin,
+	    "checksumqueue",
+	    2,
+	    {download.get(), checksumCaps.get(), checksumSink.get()},
+	    (GstPadProbeCallback)&OutputTaps::onChecksumProbe,
+	    this
+	);
+}
+
+void OutputTaps::addPreviewBranch(
+    GstElement *tee, int source, const std::string &name
+) {
+	const auto &preview = d_options.Preview.value();
+
+	auto tap    = std::make_unique<PreviewTap>();
+	tap->self   = this;
+	tap->source = source;
+	// tolerates half an output frame of jitter on the preview cadence.
+	auto frameTime = int64_t(
+	    gst_util_uint64_scale(GST_SECOND, d_args.FPSDenum, d_args.FPSNum)
+	);
+	tap->interval = std::chrono::nanoseconds{int64_t(1e9 / preview.FPS)} -
+	                std::chrono::nanoseconds{frameTime / 2};
+
+	auto scaledCaps = GLMemoryCaps(preview.Size.width(), preview.Size.height());
+	auto caps       = downloadedCaps();
+	defer {
+		gst_caps_unref(scaledCaps);
+		gst_caps_unref(caps);
+	};
+
+	// A single buffer queue: the tee never waits on the preview, a slow
+	// consumer only gets fewer frames.
+	// clang-format off
+	auto scale = GstElementFactoryMakeFull(
+	    "glcolorscale",
+	    "name", ("previewscale" + name).c_str()
+	);
+	auto scaled = GstElementFactoryMakeFull(
+	    "capsfilter",
+	    "name", ("previewscaled" + name).c_str(),
+	    "caps", scaledCaps
+	);
+	auto download = GstElementFactoryMakeFull(
+	    "gldownload",
+	    "name", ("previewdownload" + name).c_str()
+	);
+	auto downloaded = GstElementFactoryMakeFull(
+	    "capsfilter",
+	    "name", ("previewcaps" + name).c_str(),
+	    "caps", caps
+	);
+	auto appsink = GstElementFactoryMakeFull(
+	    "appsink",
+	    "name", ("preview" + name).c_str(),
+	    "emit-signals", true,
+	    "sync", false,
+	    "max-buffers", 1,
+	    "drop", true
+	);
+	// clang-format on
+
+	g_signal_connect(
+	    appsink.get(),
+	    "new-sample",
+	    G_CALLBACK(&OutputTaps::onPreviewSampleCb),
+	    tap.get()
+	);
+
+	addBranch(
+	    tee,
+	    d_args.Bin,
+	    "previewqueue" + name,
+	    1,
+	    {scale.get(),
+	     scaled.get(),
+	     download.get(),
+	     downloaded.get(),
+	     appsink.get()},
+	    (GstPadProbeCallback)&OutputTaps::onPreviewProbe,
+	    tap.get()
+	);
+	d_previewTaps.push_back(std::move(tap));
+}
+
+void OutputTaps::setPreviewEnabled(bool enabled) {
+	d_previewEnabled.store(enabled);
+}
+
+GstPadProbeReturn OutputTaps::onPreviewProbe(
+    GstPad *pad, GstPadProbeInfo *info, PreviewTap *tap
+) {
+	auto PTS = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+	if (tap->self->d_previewEnabled.load() == false ||
+	    GST_CLOCK_TIME_IS_VALID(PTS) == false) {
+		return GST_PAD_PROBE_DROP;
+	}
+	// looping medias restart their timestamps.
+	auto last = tap->last.load();
+	if (last >= 0 && int64_t(PTS) >= last &&
+	    int64_t(PTS) - last < tap->interval.count()) {
+		return GST_PAD_PROBE_DROP;
+	}
+	tap->last.store(PTS);
+	return GST_PAD_PROBE_OK;
+}
+
+GstFlowReturn
+OutputTaps::onPreviewSampleCb(GstElement *appsink, PreviewTap *tap) {
+	auto sample = gst_app_sink_pull_sample(GST_APP_SINK_CAST(appsink));
+	if (sample == nullptr) {
+		return GST_FLOW_FLUSHING;
+	}
+	defer {
+		gst_sample_unref(sample);
+	};
+
+	auto image = mappedImage(sample);
+	if (image.isNull()) {
+		// a preview must never stop the pipeline.
+		tap->self->d_logger.Error("could not map preview frame");
+		return GST_FLOW_OK;
+	}
+	emit tap->self->previewFrame(tap->source, image);
+	return GST_FLOW_OK;
+}
+
+void OutputTaps::addGrabBranch(
+    GstElement *tee, int source, const std::string &name
+) {
+	auto tap    = std::make_unique<GrabTap>();
+	tap->self   = this;
+	tap->source = source;
+
+	auto caps = downloadedCaps();
+	defer {
+		gst_caps_unref(caps);
+	};
+
+	// The probe drops every frame while no grab is pending. A grabbed frame
+	// is scaled to the grab size, the capsfilter is only set when it
+	// changes, and gldownload starts its pixel buffer object transfer
+	// behind a fence: the mapping waits for it on the appsink thread, after
+	// a second queue, while the GL thread goes on with the next frames.
+	// clang-format off
+	auto scale = GstElementFactoryMakeFull(
+	    "glcolorscale",
+	    "name", ("grabscale" + name).c_str()
+	);
+	tap->caps = GstElementFactoryMakeFull(
+	    "capsfilter",
+	    "name", ("grabscaled" + name).c_str()
+	);
+	auto download = GstElementFactoryMakeFull(
+	    "gldownload",
+	    "name", ("grabdownload" + name).c_str()
+	);
+	auto downloaded = GstElementFactoryMakeFull(
+	    "capsfilter",
+	    "name", ("grabcaps" + name).c_str(),
+	    "caps", caps
+	);
+	auto mapQueue = GstElementFactoryMakeFull(
+	    "queue",
+	    "name", ("grabmapqueue" + name).c_str(),
+	    "max-size-buffers", 2,
+	    "max-size-bytes", 0,
+	    "max-size-time", guint64(0)
+	);
+	auto appsink = GstElementFactoryMakeFull(
+	    "appsink",
+	    "name", ("grab" + name).c_str(),
+	    "emit-signals", true,
+	    "sync", false
+	);
+	// clang-format on
+
+	g_signal_connect(
+	    appsink.get(),
+	    "new-sample",
+	    G_CALLBACK(&OutputTaps::onGrabSampleCb),
+	    tap.get()
+	);
+
+	addBranch(
+	    tee,
+	    d_args.Bin,
+	    "grabqueue" + name,
+	    1,
+	    {scale.get(),
+	     tap->caps.get(),
+	     download.get(),
+	     downloaded.get(),
+	     mapQueue.get(),
+	     appsink.get()},
+	    (GstPadProbeCallback)&OutputTaps::onGrabProbe,
+	    tap.get()
+	);
+	d_grabTaps.push_back(std::move(tap));
+}
+
+std::future<QImage> OutputTaps::grab(int source, QSize size, quint64 frame) {
+	if (d_options.Grab == false) {
+		throw cpptrace::logic_error{"compositor has no grab branches"};
+	}
+	bool layer = source >= 0 && size_t(source) < d_args.Layers;
+	if (source != Program && layer == false) {
+		throw cpptrace::invalid_argument{
+		    "unknown grab source " + std::to_string(source)
+		};
+	}
+	std::lock_guard lock{d_grabMutex};
+	d_grabs.push_back({
+	    .Source = source,
+	    .Size   = size,
+	    .Frame  = source == Program ? frame : 0,
+	    .Since  = std::chrono::steady_clock::now(),
+	});
+	d_grabsPending.store(d_grabs.size());
+	return d_grabs.back().Image.get_future();
+}
+
+GstPadProbeReturn
+OutputTaps::onGrabProbe(GstPad *pad, GstPadProbeInfo *info, GrabTap *tap) {
+	// the only per-frame cost while no grab is pending.
+	if (tap->self->d_grabsPending.load(std::memory_order_relaxed) == 0) {
+		return GST_PAD_PROBE_DROP;
+	}
+	// layers are grabbed on their next frame, whatever its PTS.
+	auto    PTS   = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+	quint64 frame = tap->source == Program ? tap->self->frameNumber(PTS) : 0;
+
+	auto           &grabs = tap->self->d_grabs;
+	std::lock_guard lock{tap->self->d_grabMutex};
+
+	auto grab = std::find_if(
+	    grabs.begin(),
+	    grabs.end(),
+	    [tap, frame](const PendingGrab &grab) {
+		    return grab.Source == tap->source && frame >= grab.Frame;
+	    }
+	);
+	if (grab == grabs.end()) {
+		return GST_PAD_PROBE_DROP;
+	}
+	if (grab->Size.isEmpty()) {
+		// at the size of the source, the scale is then a passthrough.
+		auto caps = gst_pad_get_current_caps(pad);
+		if (caps == nullptr) {
+			return GST_PAD_PROBE_DROP;
+		}
+		GstVideoInfo infos;
+		bool         valid = gst_video_info_from_caps(&infos, caps);
+		gst_caps_unref(caps);
+		if (valid == false) {
+			return GST_PAD_PROBE_DROP;
+		}
+		grab->Size = {
+		    GST_VIDEO_INFO_WIDTH(&infos),
+		    GST_VIDEO_INFO_HEIGHT(&infos),
+		};
+	}
+	if (grab->Size != tap->size) {
+		// renegotiated by the scale before this buffer goes through.
+		auto caps = GLMemoryCaps(grab->Size.width(), grab->Size.height());
+		g_object_set(tap->caps.get(), "caps", caps, nullptr);
+		gst_caps_unref(caps);
+		tap->size = grab->Size;
+	}
+	return GST_PAD_PROBE_OK;
+}
+
+GstFlowReturn OutputTaps::onGrabSampleCb(GstElement *appsink, GrabTap *tap) {
+	auto sample = gst_app_sink_pull_sample(GST_APP_SINK_CAST(appsink));
+	if (sample == nullptr) {
+		return GST_FLOW_FLUSHING;
+	}
+	defer {
+		gst_sample_unref(sample);
+	};
+
+	auto    self  = tap->self;
+	auto    PTS   = GST_BUFFER_PTS(gst_sample_get_buffer(sample));
+	quint64 frame = tap->source == Program ? self->frameNumber(PTS) : 0;
+	auto    image = mappedImage(sample);
+	if (image.isNull()) {
+		// the grab is retried on the next frame, nothing stops the pipeline.
+		self->d_logger.Error("could not map grabbed frame");
+		return GST_FLOW_OK;
+	}
+
+	auto now = std::chrono::steady_clock::now();
+
+	std::lock_guard lock{self->d_grabMutex};
+	// grabs waiting for a later frame or another size stay pending.
+	std::erase_if(self->d_grabs, [&](PendingGrab &grab) {
+		if (grab.Source != tap->source || grab.Size != image.size() ||
+		    frame < grab.Frame) {
+			return false;
+		}
+		self->d_grabTime.record(now - grab.Since);
+		grab.Image.set_value(image);
+		return true;
+	});
+	self->d_grabsPending.store(self->d_grabs.size());
+	return GST_FLOW_OK;
+}
+
+void OutputTaps::addRecordBranch(
+    GstElement *tee, const RecordOptions &options
+) {
+	// When the encoder falls behind, the oldest frames are dropped from the
+	// recording. The branch is a bin, so it can be finished on its own.
+	GError       *error{nullptr};
+	GstElementPtr encoder{
+	    gst_parse_bin_from_description(options.Encoder.c_str(), true, &error)
+	};
+	if (encoder == nullptr) {
+		std::string reason = error != nullptr ? error->message : "unknown";
+		if (error != nullptr) {
+			g_error_free(error);
+		}
+		throw cpptrace::runtime_error{
+		    "could not build record encoder: " + reason
+		};
+	}
+	gst_object_set_name(GST_OBJECT_CAST(encoder.get()), "recordencoder");
+
+	// clang-format off
+	d_recordBin = GstElementFactoryMakeFull(
+	    "bin",
+	    "name", "recordbin",
+	    "message-forward", true
+	);
+	auto download = GstElementFactoryMakeFull(
+	    "gldownload",
+	    "name", "recorddownload"
+	);
+	auto muxer = GstElementFactoryMakeFull(
+	    options.Muxer.c_str(),
+	    "name", "recordmux"
+	);
+	// not synchronized, the file is written as fast as frames are encoded.
+	auto sink = GstElementFactoryMakeFull(
+	    "filesink",
+	    "name", "recordsink",
+	    "location", options.Path.c_str(),
+	    "sync", false,
+	    "async", false
+	);
+	// clang-format on
+
+	gst_bin_add(d_args.Bin, g_object_ref(d_recordBin.get()));
+	auto queue = addBranch(
+	    tee,
+	    GST_BIN_CAST(d_recordBin.get()),
+	    "recordqueue",
+	    options.QueueFrames,
+	    {download.get(), encoder.get(), muxer.get(), sink.get()}
+	);
+	d_recordQueue = GstElementPtr{GST_ELEMENT_CAST(gst_object_ref(queue))};
+
+	g_signal_connect(
+	    d_recordQueue.get(),
+	    "overrun",
+	    G_CALLBACK(&OutputTaps::onRecordOverrun),
+	    this
+	);
+
+	auto encoded = GstPadPtr{gst_element_get_static_pad(encoder.get(), "src")};
+	gst_pad_add_probe(
+	    encoded.get(),
+	    GST_PAD_PROBE_TYPE_BUFFER,
+	    (GstPadProbeCallback)&OutputTaps::onRecordEncodedProbe,
+	    this,
+	    nullptr
+	);
+	auto written = GstPadPtr{gst_element_get_static_pad(sink.get(), "sink")};
+	gst_pad_add_probe(
+	    written.get(),
+	    GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+	    (GstPadProbeCallback)&OutputTaps::onRecordEOSProbe,
+	    this,
+	    nullptr
+	);
+
+	d_logger.Info(
+	    "recording output",
+	    slog::String("path", options.Path),
+	    slog::String("encoder", options.Encoder),
+	    slog::String("muxer", options.Muxer)
+	);
+}
+
+void OutputTaps::onRecordOverrun(GstElement *queue, OutputTaps *self) {
+	// the leaky queue drops its oldest frame right after.
+	self->d_recordDropped.inc();
+}
+
+GstPadProbeReturn OutputTaps::onRecordEncodedProbe(
+    GstPad *pad, GstPadProbeInfo *info, OutputTaps *self
+) {
+	auto PTS = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+	if (GST_CLOCK_TIME_IS_VALID(PTS)) {
+		self->d_recordEncoded.store(PTS);
+	}
+	return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn OutputTaps::onRecordEOSProbe(
+    GstPad *pad, GstPadProbeInfo *info, OutputTaps *self
+) {
+	if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) != GST_EVENT_EOS) {
+		return GST_PAD_PROBE_OK;
+	}
+	{
+		std::lock_guard lock{self->d_recordMutex};
+		self->d_recordDone = true;
+	}
+	self->d_recordFinished.notify_all();
+	return GST_PAD_PROBE_OK;
+}
+
+bool OutputTaps::recording() const {
+	return d_recordBin != nullptr;
+}
+
+void OutputTaps::finishRecording() {
+	if (d_recordBin == nullptr) {
+		return;
+	}
+	auto sink =
+	    GstPadPtr{gst_element_get_static_pad(d_recordBin.get(), "sink")};
+	auto teePad = GstPadPtr{gst_pad_get_peer(sink.get())};
+	if (teePad == nullptr) {
+		return;
+	}
+	// detached first, the EOS must not reach the tee and the output.
+	auto tee = GstElementPtr{gst_pad_get_parent_element(teePad.get())};
+	gst_pad_unlink(teePad.get(), sink.get());
+	gst_element_release_request_pad(tee.get(), teePad.get());
+
+	GstState state{GST_STATE_NULL};
+	gst_element_get_state(GST_ELEMENT_CAST(d_args.Bin), &state, nullptr, 0);
+	if (state < GST_STATE_PAUSED) {
+		return;
+	}
+	// a paused sink would hold the muxer while it writes its index, only
+	// the bin plays, whatever the pipeline does meanwhile.
+	gst_element_set_locked_state(d_recordBin.get(), TRUE);
+	gst_element_set_state(d_recordBin.get(), GST_STATE_PLAYING);
+	gst_pad_send_event(sink.get(), gst_event_new_eos());
+	d_logger.Info("finishing recording");
+}
+
+void OutputTaps::waitRecording() {
+	if (d_recordBin == nullptr) {
+		return;
+	}
+	if (gst_element_is_locked_state(d_recordBin.get()) == TRUE) {
+		std::unique_lock lock{d_recordMutex};
+		if (d_recordFinished.wait_for(lock, 2s, [this] {
+			    return d_recordDone;
+		    }) == false) {
+			d_logger.Warn("recording not finalized, the file may be truncated");
+		}
+	}
+	releaseRecording();
+}
+
+bool OutputTaps::handleMessage(GstMessage *msg) {
+	// EOS of the record bin, forwarded as the pipeline is not EOS.
+	if (d_recordBin == nullptr ||
+	    GST_MESSAGE_SRC(msg) != GST_OBJECT_CAST(d_recordBin.get()) ||
+	    gst_message_has_name(msg, "GstBinForwarded") == false) {
+		return false;
+	}
+	GstMessage *forwarded{nullptr};
+	gst_structure_get(
+	    gst_message_get_structure(msg),
+	    "message",
+	    GST_TYPE_MESSAGE,
+	    &forwarded,
+	    nullptr
+	);
+	if (forwarded == nullptr) {
+		return false;
+	}
+	defer {
+		gst_message_unref(forwarded);
+	};
+	if (GST_MESSAGE_TYPE(forwarded) != GST_MESSAGE_EOS) {
+		return false;
+	}
+	releaseRecording();
+	return true;
+}
+
+void OutputTaps::releaseRecording() {
+	if (d_recordBin == nullptr) {
+		return;
+	}
+	gst_element_set_state(d_recordBin.get(), GST_STATE_NULL);
+	gst_bin_remove(d_args.Bin, d_recordBin.get());
+	d_recordBin.reset();
+	d_recordQueue.reset();
+	d_logger.Info("recording finished");
+}
+
+void OutputTaps::updateRecording(std::chrono::nanoseconds outputPTS) {
+	if (d_recordQueue == nullptr) {
+		return;
+	}
+	guint queued{0};
+	g_object_get(
+	    d_recordQueue.get(),
+	    "current-level-buffers",
+	    &queued,
+	    nullptr
+	);
+	d_recordQueued.set(queued);
+
+	auto encoded = d_recordEncoded.load();
+	if (encoded >= 0) {
+		auto lag = outputPTS - std::chrono::nanoseconds{encoded};
+		d_recordLag.set(std::chrono::duration<double>(lag).count());
+	}
+
+	auto dropped = d_recordDropped.value();
+	if (dropped > d_recordLastDropped) {
+		d_logger.Warn(
+		    "recording encoder falls behind, frames dropped",
+		    slog::Int("dropped", dropped - d_recordLastDropped),
+		    slog::Int("queued", queued)
+		);
+	}
+	d_recordLastDropped = dropped;
+}
+
+quint64 OutputTaps::frameNumber(GstClockTime PTS) const {
+	return gst_util_uint64_scale_round(
+	    PTS,
+	    d_args.FPSNum,
+	    d_args.FPSDenum * GST_SECOND
+	);
+}
+
+GstPadProbeReturn OutputTaps::onChecksumProbe(
+    GstPad *pad, GstPadProbeInfo *info, OutputTaps *self
+) {
+	auto PTS = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+	if (self->frameNumber(PTS) % self->d_options.ChecksumEvery != 0) {
+		return GST_PAD_PROBE_DROP;
+	}
+	return GST_PAD_PROBE_OK;
+}
+
+GstFlowReturn
+OutputTaps::onChecksumSampleCb(GstElement *appsink, OutputTaps *self) {
+	auto sample = gst_app_sink_pull_sample(GST_APP_SINK_CAST(appsink));
+	if (sample == nullptr) {
+		return GST_FLOW_FLUSHING;
+	}
+	defer {
+		gst_sample_unref(sample);
+	};
+
+	auto image = mappedImage(sample);
+	if (image.isNull()) {
+		// an error would stop the pipeline, the checksum is missed instead.
+		self->d_logger.Error("could not map checksum frame");
+		return GST_FLOW_OK;
+	}
+
+	// only the visible part of each row, strides may differ between
+	// drivers.
+	uint32_t crc = 0;
+	auto     row = size_t(image.width()) * 4;
+	for (int y = 0; y < image.height(); ++y) {
+		crc = crc32(image.constScanLine(y), row, crc);
+	}
+	auto number = self->frameNumber(
+	    GST_BUFFER_PTS(gst_sample_get_buffer(sample))
+	);
+
+	emit self->frameChecksum(number, crc);
+	return GST_FLOW_OK;
+}
+
+} // namespace yams
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <QImage>
+#include <QObject>
+#include <QSize>
+
+#include <gst/gstbin.h>
+#include <gst/gstmessage.h>
+#include <gst/gstpad.h>
+
+#include <qtypes.h>
+#include <slog++/Logger.hpp>
+
+#include <yams/gstreamer/Memory.hpp>
+#include <yams/utils/Metrics.hpp>
+
+namespace yams {
+
+/// Read-back branches off the compositor tees: output checksums, previews,
+/// grabs and the recording. Every branch starts with a leaky queue built by
+/// addBranch(), so a slow branch loses frames and never holds the tee it is
+/// linked to.
+class OutputTaps : public QObject {
+	Q_OBJECT
+public:
+	// previewFrame() and grab() source of the program output, layers use
+	// their index.
+	constexpr static int Program = -1;
+
+	// Low resolution previews for control UIs, see previewFrame().
+	struct PreviewOptions {
+		QSize Size = {320, 180};
+		qreal FPS  = 15;
+	};
+
+	// Records the program output to a file.
+	struct RecordOptions {
+		std::string Path;
+		// gst-launch description of the encoder, from RGBA frames to a
+		// stream the muxer accepts. gldownload lets GL memory through to
+		// encoders taking it.
+		std::string Encoder =
+		    "videoconvert ! x264enc tune=zerolatency speed-preset=veryfast "
+		    "key-int-max=60 ! h264parse";
+		// matroska files stay readable if the application dies.
+		std::string Muxer = "matroskamux";
+		// frames waiting for the encoder before the oldest are dropped.
+		guint QueueFrames = 30;
+	};
+
+	// see Compositor::Options.
+	struct Options {
+		size_t                        ChecksumEvery = 0;
+		std::optional<PreviewOptions> Preview;
+		std::optional<RecordOptions>  Record;
+		bool                          Grab = false;
+	};
+
+	struct Args {
+		// the compositor pipeline, branches are added to it.
+		GstBin *Bin;
+		int64_t FPSNum, FPSDenum;
+		size_t  Layers;
+	};
+
+	OutputTaps(Options options, Args args);
+	virtual ~OutputTaps();
+
+	OutputTaps(const OutputTaps &)            = delete;
+	OutputTaps(OutputTaps &&)                 = delete;
+	OutputTaps &operator=(const OutputTaps &) = delete;
+	OutputTaps &operator=(OutputTaps &&)      = delete;
+
+	/// Whether the program output needs a tee.
+	bool tapsOutput() const;
+	/// Whether layer inputs need a tee, for previews or grabs.
+	bool tapsLayers() const;
+
+	/// Links the program output branches to its tee.
+	/// @throws cpptrace::runtime_error if a branch can not be built.
+	void addOutputBranches(GstElement *tee);
+	/// Links the branches of a layer input to its tee.
+	/// @throws cpptrace::runtime_error if a branch can not be built.
+	void addLayerBranches(GstElement *tee, int layer, const std::string &name);
+
+	/// Stops or resumes previews, e.g. at the NO_PREVIEW QoS level. Thread
+	/// safe.
+	void setPreviewEnabled(bool enabled);
+
+	/// See Compositor::grab(). Thread safe.
+	/// @throws cpptrace::logic_error without Options::Grab.
+	/// @throws cpptrace::invalid_argument for an unknown source.
+	std::future<QImage> grab(int source, QSize size, quint64 frame);
+
+	bool recording() const;
+	/// Detaches the record bin and sends it EOS, so the muxer writes its
+	/// index. The pipeline state is left untouched, the bin is released
+	/// once its EOS is forwarded, see handleMessage().
+	void finishRecording();
+	/// Waits for the EOS of a finishing recording, before a shutdown.
+	void waitRecording();
+	/// Releases the record bin on its forwarded EOS. Returns false for any
+	/// other message.
+	bool handleMessage(GstMessage *msg);
+	/// Publishes the recording metrics, outputPTS is the last output frame.
+	void updateRecording(std::chrono::nanoseconds outputPTS);
+
+signals:
+	// emitted from the streaming thread, see Options::ChecksumEvery.
+	void frameChecksum(quint64 frame, quint32 crc);
+	// emitted from the streaming threads, at most at the preview FPS. source
+	// is Program or a layer.
+	void previewFrame(int source, QImage image);
+
+private:
+	struct PreviewTap;
+	struct GrabTap;
+
+	struct PendingGrab {
+		int                                   Source;
+		QSize                                 Size;
+		quint64                               Frame;
+		std::promise<QImage>                  Image;
+		std::chrono::steady_clock::time_point Since;
+	};
+
+	// Adds a leaky queue of maxBuffers frames then elements to bin, linked
+	// in that order and to tee, through a ghost pad if bin is not the
+	// pipeline. probe, if set, filters buffers before they are queued.
+	// Returns the queue.
+	GstElement *addBranch(
+	    GstElement                      *tee,
+	    GstBin                          *bin,
+	    const std::string               &queueName,
+	    guint                            maxBuffers,
+	    const std::vector<GstElement *> &elements,
+	    GstPadProbeCallback              probe = nullptr,
+	    gpointer                         data  = nullptr
+	);
+
+	void addChecksumBranch(GstElement *tee);
+	void addPreviewBranch(GstElement *tee, int source, const std::string &name);
+	void addGrabBranch(GstElement *tee, int source, const std::string &name);
+	void addRecordBranch(GstElement *tee, const RecordOptions &options);
+	void releaseRecording();
+
+	quint64 frameNumber(GstClockTime PTS) const;
+
+	static GstPadProbeReturn
+	onChecksumProbe(GstPad *pad, GstPadProbeInfo *info, OutputTaps *self);
+	static GstFlowReturn
+	onChecksumSampleCb(GstElement *appsink, OutputTaps *self);
+
+	static GstPadProbeReturn
+	onPreviewProbe(GstPad *pad, GstPadProbeInfo *info, PreviewTap *tap);
+	static GstFlowReturn
+	onPreviewSampleCb(GstElement *appsink, PreviewTap *tap);
+
+	static GstPadProbeReturn
+	onGrabProbe(GstPad *pad, GstPadProbeInfo *info, GrabTap *tap);
+	static GstFlowReturn onGrabSampleCb(GstElement *appsink, GrabTap *tap);
+
+	static void onRecordOverrun(GstElement *queue, OutputTaps *self);
+	static GstPadProbeReturn
+	onRecordEncodedProbe(GstPad *pad, GstPadProbeInfo *info, OutputTaps *self);
+	static GstPadProbeReturn
+	onRecordEOSProbe(GstPad *pad, GstPadProbeInfo *info, OutputTaps *self);
+
+	slog::Logger<1> d_logger;
+
+	Options d_options;
+	Args    d_args;
+
+	std::vector<std::unique_ptr<PreviewTap>> d_previewTaps;
+	// cleared at the NO_PREVIEW QoS level.
+	std::atomic<bool> d_previewEnabled{true};
+
+	std::vector<std::unique_ptr<GrabTap>> d_grabTaps;
+	std::mutex                            d_grabMutex;
+	std::vector<PendingGrab>              d_grabs;
+	// size of d_grabs, all the grab probes check without a pending grab.
+	std::atomic<size_t> d_grabsPending{0};
+	metrics::Histogram &d_grabTime;
+
+	GstElementPtr d_recordBin, d_recordQueue;
+	// PTS of the last frame out of the encoder, -1 before the first one.
+	std::atomic<int64_t>    d_recordEncoded{-1};
+	std::mutex              d_recordMutex;
+	std::condition_variable d_recordFinished;
+	bool                    d_recordDone{false};
+	uint64_t                d_recordLastDropped{0};
+	metrics::Counter       &d_recordDropped;
+	metrics::Gauge         &d_recordQueued, &d_recordLag;
+};
+
+} // namespace yams
@@ -0,0 +1,205 @@
+#include "PixelMap.hpp"
+
+#include <algorithm>
+#include <array>
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <cpptrace/exceptions.hpp>
+
+namespace yams {
+
+QSize PixelMap::atlasSize() const {
+	QSize res{0, 0};
+	for (const auto &output : Outputs) {
+		res.setWidth(res.width() + output.Width);
+		res.setHeight(std::max(res.height(), output.Height));
+	}
+	return res;
+}
+
+PixelMap::Rect PixelMap::region(size_t output) const {
+	Rect res;
+	for (size_t i = 0; i < output; ++i) {
+		res.X += Outputs[i].Width;
+	}
+	res.Width  = Outputs[output].Width;
+	res.Height = Outputs[output].Height;
+	return res;
+}
+
+PixelMap::Rect PixelMap::target(const Slice &slice) const {
+	int width  = int(slice.Source.Width * slice.Scale + 0.5);
+	int height = int(slice.Source.Height * slice.Scale + 0.5);
+	if (slice.Rotation % 180 != 0) {
+		std::swap(width, height);
+	}
+	return {slice.OutputX, slice.OutputY, width, height};
+}
+
+std::vector<float> PixelMap::vertices(QSize composite) const {
+	auto atlas = atlasSize();
+
+	std::vector<float> res;
+	res.reserve(Slices.size() * 6 * 4);
+	for (const auto &slice : Slices) {
+		auto area   = region(slice.Output);
+		auto placed = target(slice);
+
+		// corners in top-left, top-right, bottom-right, bottom-left order.
+		using Point = std::array<float, 2>;
+		float left  = float(area.X + placed.X);
+		float top   = float(area.Y + placed.Y);
+		float right = left + placed.Width, bottom = top + placed.Height;
+
+		std::array<Point, 4> position{{
+		    {left, top},
+		    {right, top},
+		    {right, bottom},
+		    {left, bottom},
+		}};
+		for (auto &p : position) {
+			p = {
+			    2.0f * p[0] / atlas.width() - 1.0f,
+			    2.0f * p[1] / atlas.height() - 1.0f,
+			};
+		}
+
+		const auto &src = slice.Source;
+		float       u0  = float(src.X) / composite.width();
+		float       v0  = float(src.Y) / composite.height();
+		float       u1  = float(src.X + src.Width) / composite.width();
+		float       v1  = float(src.Y + src.Height) / composite.height();
+		if (slice.FlipX) {
+			std::swap(u0, u1);
+		}
+		if (slice.FlipY) {
+			std::swap(v0, v1);
+		}
+		std::array<Point, 4> uv{{{u0, v0}, {u1, v0}, {u1, v1}, {u0, v1}}};
+
+		// turning clockwise, the top-left corner shows what was at the
+		// bottom-left.
+		size_t turns = size_t(slice.Rotation / 90) % 4;
+		for (size_t i : {0, 1, 2, 2, 3, 0}) {
+			const auto &p = position[i];
+			const auto &t = uv[(i + 4 - turns) % 4];
+			res.insert(res.end(), {p[0], p[1], t[0], t[1]});
+		}
+	}
+	return res;
+}
+
+void PixelMap::validate(QSize composite) const {
+	if (Outputs.empty()) {
+		throw cpptrace::invalid_argument{"pixel map has no output"};
+	}
+	for (const auto &output : Outputs) {
+		if (output.Width <= 0 || output.Height <= 0) {
+			throw cpptrace::invalid_argument{
+			    "invalid size for output '" + output.Name + "'"
+			};
+		}
+	}
+
+	for (size_t i = 0; i < Slices.size(); ++i) {
+		const auto &slice = Slices[i];
+		auto        name  = "slice " + std::to_string(i);
+		const auto &src   = slice.Source;
+		if (slice.Output >= Outputs.size()) {
+			throw cpptrace::invalid_argument{name + " has no output"};
+		}
+		if (src.Width <= 0 || src.Height <= 0 || src.X < 0 || src.Y < 0 ||
+		    src.X + src.Width > composite.width() ||
+		    src.Y + src.Height > composite.height()) {
+			throw cpptrace::invalid_argument{
+			    name + " is outside of the composite"
+			};
+		}
+		if (slice.Rotation % 90 != 0 || slice.Rotation < 0 ||
+		    slice.Scale <= 0.0) {
+			throw cpptrace::invalid_argument{
+			    name + " has an invalid rotation or scale"
+			};
+		}
+		// slices would bleed on the neighbour outputs of the atlas.
+		auto placed = target(slice);
+		auto output = Outputs[slice.Output];
+		if (placed.X < 0 || placed.Y < 0 ||
+		    placed.X + placed.Width > output.Width ||
+		    placed.Y + placed.Height > output.Height) {
+			throw cpptrace::invalid_argument{
+			    name + " is outside of output '" + output.Name + "'"
+			};
+		}
+	}
+}
+
+namespace {
+std::array<int, 4> readInts(const QJsonValue &value, size_t size) {
+	auto array = value.toArray();
+	if (array.size() != qsizetype(size)) {
+		throw cpptrace::invalid_argument{
+		    "expected an array of " + std::to_string(size) + " integers"
+		};
+	}
+	std::array<int, 4> res{};
+	for (size_t i = 0; i < size; ++i) {
+		res[i] = array[i].toInt();
+	}
+	return res;
+}
+} // namespace
+
+PixelMap PixelMap::FromJson(const QByteArray &json) {
+	QJsonParseError error;
+	auto            doc = QJsonDocument::fromJson(json, &error);
+	if (doc.isObject() == false) {
+		throw cpptrace::invalid_argument{
+		    "invalid pixel map: " + error.errorString().toStdString()
+		};
+	}
+	auto root = doc.object();
+
+	PixelMap res;
+	for (const auto &value : root["outputs"].toArray()) {
+		auto output = value.toObject();
+		res.Outputs.push_back({
+		    .Name         = output["name"].toString().toStdString(),
+		    .Width        = output["width"].toInt(),
+		    .Height       = output["height"].toInt(),
+		    .Screen       = output["screen"].toString().toStdString(),
+		    .SharedMemory = output["shm"].toString().toStdString(),
+		});
+	}
+
+	for (const auto &value : root["slices"].toArray()) {
+		auto slice  = value.toObject();
+		auto name   = slice["output"].toString().toStdString();
+		auto output = std::find_if(
+		    res.Outputs.begin(),
+		    res.Outputs.end(),
+		    [&name](const Output &o) { return o.Name == name; }
+		);
+		if (output == res.Outputs.end()) {
+			throw cpptrace::invalid_argument{"unknown output '" + name + "'"};
+		}
+		auto source   = readInts(slice["source"], 4);
+		auto position = readInts(slice["position"], 2);
+		res.Slices.push_back({
+		    .Source   = {source[0], source[1], source[2], source[3]},
+		    .Output   = size_t(output - res.Outputs.begin()),
+		    .OutputX  = position[0],
+		    .OutputY  = position[1],
+		    .Scale    = slice["scale"].toDouble(1.0),
+		    .Rotation = slice["rotation"].toInt(0),
+		    .FlipX    = slice["flip_x"].toBool(false),
+		    .FlipY    = slice["flip_y"].toBool(false),
+		});
+	}
+	return res;
+}
+
+} // namespace yams
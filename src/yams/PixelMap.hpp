@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <QByteArray>
+#include <QSize>
+
+namespace yams {
+
+/// Slices of the composite remapped onto the outputs of LED processors.
+///
+/// Outputs are laid side by side in one atlas, and all slices are drawn into
+/// it in a single pass from a vertex buffer computed once by vertices(), see
+/// PixelMapper. Changing the map only changes that buffer.
+struct PixelMap {
+	struct Rect {
+		int X = 0, Y = 0, Width = 0, Height = 0;
+
+		bool operator==(const Rect &other) const = default;
+	};
+
+	struct Output {
+		std::string Name;
+		int         Width = 0, Height = 0;
+		// screen presenting the output, by index, name or model.
+		std::string Screen;
+		// socket path of a shmsink the output is written to.
+		std::string SharedMemory;
+	};
+
+	struct Slice {
+		// region of the composite, in pixels.
+		Rect   Source;
+		size_t Output = 0;
+		// top-left corner on the output, in pixels.
+		int OutputX = 0, OutputY = 0;
+		double Scale = 1.0;
+		// clockwise, in degrees, a multiple of 90. Applied after the flips.
+		int  Rotation = 0;
+		bool FlipX = false, FlipY = false;
+	};
+
+	std::vector<Output> Outputs;
+	std::vector<Slice>  Slices;
+
+	/// Size of the atlas holding all outputs.
+	QSize atlasSize() const;
+	/// Region of an output in the atlas.
+	Rect region(size_t output) const;
+	/// Placement of a slice on its output, in pixels.
+	Rect target(const Slice &slice) const;
+
+	/// Two triangles per slice, four floats per vertex: the position in the
+	/// atlas in normalized device coordinates, then the texture coordinate
+	/// in the composite. Both have their first row at y = -1 and v = 0, as
+	/// GStreamer GL memory stores frames.
+	std::vector<float> vertices(QSize composite) const;
+
+	/// @throws cpptrace::invalid_argument if a slice is outside of the
+	/// composite or of its output.
+	void validate(QSize composite) const;
+
+	/// Reads a map from JSON:
+	///
+	/// {"outputs": [{"name": "left", "width": 960, "height": 540,
+	///               "screen": "HDMI-1"}],
+	///  "slices": [{"output": "left", "source": [0, 0, 960, 540],
+	///              "position": [0, 0], "scale": 1.0, "rotation": 90,
+	///              "flip_x": false, "flip_y": false}]}
+	///
+	/// @throws cpptrace::invalid_argument on malformed input.
+	static PixelMap FromJson(const QByteArray &json);
+};
+
+} // namespace yams
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+
+#include <cpptrace/exceptions.hpp>
+
+#include "PixelMap.hpp"
+
+namespace yams {
+
+class PixelMapTest : public ::testing::Test {
+protected:
+	static constexpr QSize Composite{400, 200};
+
+	static PixelMap twoOutputs() {
+		return {
+		    .Outputs =
+		        {
+		            {.Name = "left", .Width = 100, .Height = 50},
+		            {.Name = "right", .Width = 200, .Height = 100},
+		        },
+		};
+	}
+
+	// position then texture coordinate of vertex i of slice 0.
+	static std::array<float, 4>
+	vertex(const std::vector<float> &vertices, size_t i) {
+		return {
+		    vertices[4 * i],
+		    vertices[4 * i + 1],
+		    vertices[4 * i + 2],
+		    vertices[4 * i + 3],
+		};
+	}
+
+	static void expectVertex(
+	    const std::array<float, 4> &actual, std::array<float, 4> expected
+	) {
+		for (size_t i = 0; i < 4; ++i) {
+			EXPECT_NEAR(actual[i], expected[i], 1e-6) << "component " << i;
+		}
+	}
+};
+
+TEST_F(PixelMapTest, OutputsAreSideBySide) {
+	auto map = twoOutputs();
+	EXPECT_EQ(map.atlasSize(), QSize(300, 100));
+	EXPECT_EQ(map.region(0), (PixelMap::Rect{0, 0, 100, 50}));
+	EXPECT_EQ(map.region(1), (PixelMap::Rect{100, 0, 200, 100}));
+}
+
+TEST_F(PixelMapTest, SlicesAreDrawnInTheirOutputRegion) {
+	auto map = twoOutputs();
+	map.Slices.push_back({
+	    .Source  = {200, 100, 100, 50},
+	    .Output  = 1,
+	    .OutputX = 50,
+	    .OutputY = 50,
+	});
+	map.validate(Composite);
+	auto vertices = map.vertices(Composite);
+	ASSERT_EQ(vertices.size(), 24);
+	// top-left then bottom-right corner.
+	expectVertex(vertex(vertices, 0), {0.0, 0.0, 0.5, 0.5});
+	expectVertex(vertex(vertices, 2), {2.0 / 3.0, 1.0, 0.75, 0.75});
+}
+
+TEST_F(PixelMapTest, RotationsAndFlips) {
+	auto map = twoOutputs();
+	map.Slices.push_back({
+	    .Source   = {0, 0, 100, 200},
+	    .Output   = 1,
+	    .Scale    = 0.5,
+	    .Rotation = 90,
+	});
+	EXPECT_EQ(map.target(map.Slices[0]), (PixelMap::Rect{0, 0, 100, 50}));
+	auto vertices = map.vertices(Composite);
+	// the top-left corner shows the bottom-left of the source.
+	expectVertex(vertex(vertices, 0), {-1.0 / 3.0, -1.0, 0.0, 1.0});
+	expectVertex(vertex(vertices, 1), {1.0 / 3.0, -1.0, 0.0, 0.0});
+
+	map.Slices[0].Rotation = 0;
+	map.Slices[0].Scale    = 0.25;
+	map.Slices[0].FlipX    = true;
+	vertices               = map.vertices(Composite);
+	expectVertex(vertex(vertices, 0), {-1.0 / 3.0, -1.0, 0.25, 0.0});
+}
+
+TEST_F(PixelMapTest, RejectsSlicesOutsideOfTheirOutput) {
+	auto map = twoOutputs();
+	map.Slices.push_back({.Source = {0, 0, 120, 20}, .Output = 0});
+	EXPECT_THROW(map.validate(Composite), cpptrace::invalid_argument);
+
+	map.Slices[0].Source = {390, 0, 20, 20};
+	EXPECT_THROW(map.validate(Composite), cpptrace::invalid_argument);
+
+	map.Slices[0].Source = {0, 0, 50, 20};
+	EXPECT_NO_THROW(map.validate(Composite));
+	map.Slices[0].Rotation = 45;
+	EXPECT_THROW(map.validate(Composite), cpptrace::invalid_argument);
+}
+
+TEST_F(PixelMapTest, ReadsJson) {
+	auto map = PixelMap::FromJson(R"({
+	    "outputs": [
+	        {"name": "left", "width": 100, "height": 50, "screen": "HDMI-1"},
+	        {"name": "right", "width": 200, "height": 100, "shm": "/tmp/led"}
+	    ],
+	    "slices": [
+	        {"output": "right", "source": [0, 0, 100, 50],
+	         "position": [10, 20], "rotation": 180, "flip_y": true}
+	    ]
+	})");
+	ASSERT_EQ(map.Outputs.size(), 2);
+	EXPECT_EQ(map.Outputs[0].Screen, "HDMI-1");
+	EXPECT_EQ(map.Outputs[1].SharedMemory, "/tmp/led");
+	ASSERT_EQ(map.Slices.size(), 1);
+	EXPECT_EQ(map.Slices[0].Output, 1);
+	EXPECT_EQ(map.Slices[0].OutputY, 20);
+	EXPECT_EQ(map.Slices[0].Rotation, 180);
+	EXPECT_TRUE(map.Slices[0].FlipY);
+	EXPECT_DOUBLE_EQ(map.Slices[0].Scale, 1.0);
+
+	EXPECT_THROW(
+	    PixelMap::FromJson(R"({"slices": [{"output": "none"}]})"),
+	    cpptrace::invalid_argument
+	);
+	EXPECT_THROW(PixelMap::FromJson("not json"), cpptrace::invalid_argument);
+}
+
+} // namespace yams
@@ -0,0 +1,154 @@
+#include "PixelMapper.hpp"
+
+#include <gst/gl/gl.h>
+#include <gst/gl/gstglfuncs.h>
+
+#include <cpptrace/exceptions.hpp>
+#include <slog++/slog++.hpp>
+
+namespace yams {
+
+PixelMapper::PixelMapper(PixelMap map, QSize composite)
+    : d_composite{composite} {
+	map.validate(composite);
+	d_atlas    = map.atlasSize();
+	d_vertices = map.vertices(composite);
+}
+
+PixelMapper::~PixelMapper() {
+	if (d_context == nullptr) {
+		return;
+	}
+	gst_gl_context_thread_add(
+	    d_context,
+	    (GstGLContextThreadFunc)&PixelMapper::release,
+	    this
+	);
+	gst_object_unref(d_context);
+}
+
+QSize PixelMapper::atlasSize() const {
+	return d_atlas;
+}
+
+void PixelMapper::setMap(PixelMap map) {
+	map.validate(d_composite);
+	if (map.atlasSize() != d_atlas) {
+		throw cpptrace::invalid_argument{
+		    "pixel map outputs cannot change while running"
+		};
+	}
+	auto vertices = map.vertices(d_composite);
+
+	std::lock_guard lock{d_mutex};
+	d_vertices = std::move(vertices);
+	d_dirty    = true;
+}
+
+bool PixelMapper::initialize(GstGLContext *context) {
+	GError *error{nullptr};
+	// positions are already in the atlas, the default shader only samples.
+	d_shader = gst_gl_shader_new_default(context, &error);
+	if (d_shader == nullptr) {
+		slog::Error(
+		    "could not build pixel map shader",
+		    slog::String("error", error != nullptr ? error->message : "unknown")
+		);
+		if (error != nullptr) {
+			g_error_free(error);
+		}
+		return false;
+	}
+	if (g_object_is_floating(d_shader)) {
+		gst_object_ref_sink(d_shader);
+	}
+
+	const GstGLFuncs *gl = context->gl_vtable;
+	if (gl->GenVertexArrays != nullptr) {
+		gl->GenVertexArrays(1, &d_vao);
+	}
+	gl->GenBuffers(1, &d_vbo);
+	d_context = GST_GL_CONTEXT(gst_object_ref(context));
+	return true;
+}
+
+void PixelMapper::release(GstGLContext *context, PixelMapper *self) {
+	const GstGLFuncs *gl = context->gl_vtable;
+	if (self->d_vao != 0) {
+		gl->DeleteVertexArrays(1, &self->d_vao);
+	}
+	gl->DeleteBuffers(1, &self->d_vbo);
+	gst_object_unref(self->d_shader);
+}
+
+bool PixelMapper::draw(unsigned int texture) {
+	auto context = gst_gl_context_get_current();
+	if (context == nullptr ||
+	    (d_context == nullptr && initialize(context) == false)) {
+		return false;
+	}
+	const GstGLFuncs *gl = context->gl_vtable;
+
+	gl->ClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	gl->Clear(GL_COLOR_BUFFER_BIT);
+
+	if (d_vao != 0) {
+		gl->BindVertexArray(d_vao);
+	}
+	gl->BindBuffer(GL_ARRAY_BUFFER, d_vbo);
+	{
+		std::lock_guard lock{d_mutex};
+		if (d_dirty == true) {
+			gl->BufferData(
+			    GL_ARRAY_BUFFER,
+			    d_vertices.size() * sizeof(float),
+			    d_vertices.data(),
+			    GL_STATIC_DRAW
+			);
+			d_vertexCount = d_vertices.size() / 4;
+			d_dirty       = false;
+		}
+	}
+
+	gst_gl_shader_use(d_shader);
+	GLuint position =
+	    gst_gl_shader_get_attribute_location(d_shader, "a_position");
+	GLuint texcoord =
+	    gst_gl_shader_get_attribute_location(d_shader, "a_texcoord");
+	gl->VertexAttribPointer(
+	    position,
+	    2,
+	    GL_FLOAT,
+	    GL_FALSE,
+	    4 * sizeof(float),
+	    (void *)(0 * sizeof(float))
+	);
+	gl->VertexAttribPointer(
+	    texcoord,
+	    2,
+	    GL_FLOAT,
+	    GL_FALSE,
+	    4 * sizeof(float),
+	    (void *)(2 * sizeof(float))
+	);
+	gl->EnableVertexAttribArray(position);
+	gl->EnableVertexAttribArray(texcoord);
+
+	gl->ActiveTexture(GL_TEXTURE0);
+	gl->BindTexture(GL_TEXTURE_2D, texture);
+	gst_gl_shader_set_uniform_1i(d_shader, "tex", 0);
+
+	gl->DrawArrays(GL_TRIANGLES, 0, GLsizei(d_vertexCount));
+
+	gl->DisableVertexAttribArray(position);
+	gl->DisableVertexAttribArray(texcoord);
+	gl->BindTexture(GL_TEXTURE_2D, 0);
+	gl->BindBuffer(GL_ARRAY_BUFFER, 0);
+	if (d_vao != 0) {
+		gl->BindVertexArray(0);
+	}
+	gst_gl_context_clear_shader(context);
+	return true;
+}
+
+} // namespace yams
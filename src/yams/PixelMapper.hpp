@@ -0,0 +1,55 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include <gst/gl/gstgl_fwd.h>
+
+#include "PixelMap.hpp"
+
+namespace yams {
+
+/// Draws a PixelMap from the composite texture into the current framebuffer,
+/// in one draw call. Used from the "client-draw" signal of a glfilterapp, so
+/// it runs on the GStreamer GL thread and only touches GL from there.
+class PixelMapper {
+public:
+	/// @throws cpptrace::invalid_argument if the map does not fit the
+	/// composite.
+	PixelMapper(PixelMap map, QSize composite);
+	~PixelMapper();
+
+	PixelMapper(const PixelMapper &)            = delete;
+	PixelMapper(PixelMapper &&)                 = delete;
+	PixelMapper &operator=(const PixelMapper &) = delete;
+	PixelMapper &operator=(PixelMapper &&)      = delete;
+
+	QSize atlasSize() const;
+
+	/// Replaces the slices, uploaded before the next draw. Thread safe.
+	/// @throws cpptrace::invalid_argument if the map does not fit the
+	/// composite or changes the outputs.
+	void setMap(PixelMap map);
+
+	/// Must be called with a GL context current, see glfilterapp.
+	bool draw(unsigned int texture);
+
+private:
+	bool initialize(GstGLContext *context);
+	static void release(GstGLContext *context, PixelMapper *self);
+
+	const QSize d_composite;
+	QSize       d_atlas;
+
+	std::mutex         d_mutex;
+	std::vector<float> d_vertices;
+	bool               d_dirty{true};
+
+	// GL objects, owned by d_context.
+	GstGLContext *d_context{nullptr};
+	GstGLShader  *d_shader{nullptr};
+	unsigned int  d_vao{0}, d_vbo{0};
+	size_t        d_vertexCount{0};
+};
+
+} // namespace yams
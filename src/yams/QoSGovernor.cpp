@@ -0,0 +1,69 @@
+#include "QoSGovernor.hpp"
+
+namespace yams {
+
+const char *QoSGovernor::LevelName(Level level) noexcept {
+	switch (level) {
+	case Level::NOMINAL:
+		return "nominal";
+	case Level::SKIP_BACKGROUND_FRAMES:
+		return "skip-background-frames";
+	case Level::REDUCED_DECODE:
+		return "reduced-decode";
+	case Level::REDUCED_MIX:
+		return "reduced-mix";
+	case Level::NO_PREVIEW:
+		return "no-preview";
+	}
+	return "<unknown>";
+}
+
+QoSGovernor::QoSGovernor(Options options)
+    : d_options{options} {}
+
+std::optional<QoSGovernor::Level> QoSGovernor::update(clock::time_point now) {
+	if (d_windowStart == clock::time_point{}) {
+		d_windowStart = now;
+		return std::nullopt;
+	}
+	if (now - d_windowStart < d_options.Window) {
+		return std::nullopt;
+	}
+	d_windowStart = now;
+
+	auto frames = d_frames.exchange(0, std::memory_order_relaxed);
+	auto late   = d_late.exchange(0, std::memory_order_relaxed);
+	// a stalled output is the worst overload, not an idle one.
+	double pressure = frames == 0 ? (late > 0 ? 1.0 : 0.0)
+	                              : double(late) / double(frames);
+
+	auto level = d_level.load(std::memory_order_relaxed);
+	if (pressure > d_options.DegradeAbove) {
+		d_idle = 0;
+		if (++d_overloaded < d_options.DegradeAfter || level == MaxLevel) {
+			return std::nullopt;
+		}
+		d_overloaded = 0;
+		level        = Level(int(level) + 1);
+	} else if (pressure < d_options.RecoverBelow) {
+		d_overloaded = 0;
+		if (++d_idle < d_options.RecoverAfter || level == Level::NOMINAL) {
+			return std::nullopt;
+		}
+		d_idle = 0;
+		level  = Level(int(level) - 1);
+	} else {
+		d_overloaded = 0;
+		d_idle       = 0;
+		return std::nullopt;
+	}
+
+	d_level.store(level, std::memory_order_relaxed);
+	return level;
+}
+
+QoSGovernor::Level QoSGovernor::level() const noexcept {
+	return d_level.load(std::memory_order_relaxed);
+}
+
+} // namespace yams
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+namespace yams {
+using namespace std::chrono_literals;
+
+/// Decides how much the compositor should degrade its output under
+/// sustained overload.
+///
+/// Late events (QoS messages from decoders and the mixer, deadline misses
+/// from the renderer) are counted against output frames over fixed windows.
+/// After DegradeAfter consecutive windows above DegradeAbove the level steps
+/// down once, and it steps back up after RecoverAfter consecutive windows
+/// below RecoverBelow. Levels are cumulative, each one keeps the
+/// degradations of the previous ones.
+///
+/// Events can be reported from any thread, update() must be called from a
+/// single one.
+class QoSGovernor {
+public:
+	using clock = std::chrono::steady_clock;
+
+	enum class Level {
+		NOMINAL = 0,
+		// decoders of layers below the top one skip non-reference frames.
+		SKIP_BACKGROUND_FRAMES,
+		// all decoders output at half resolution when they can.
+		REDUCED_DECODE,
+		// the mixer works at half the output resolution, its output is
+		// scaled back.
+		REDUCED_MIX,
+		// preview taps stop producing frames.
+		NO_PREVIEW,
+	};
+
+	constexpr static Level MaxLevel = Level::NO_PREVIEW;
+
+	static const char *LevelName(Level level) noexcept;
+
+	struct Options {
+		std::chrono::nanoseconds Window = 1s;
+		// late events per output frame.
+		double DegradeAbove = 0.05;
+		double RecoverBelow = 0.005;
+		size_t DegradeAfter = 2;
+		size_t RecoverAfter = 5;
+	};
+
+	QoSGovernor(Options options);
+
+	inline void reportFrame() noexcept {
+		d_frames.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	inline void reportLate() noexcept {
+		d_late.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/// Closes the current window if it is over, and returns the new level
+	/// if it changed.
+	std::optional<Level> update(clock::time_point now = clock::now());
+
+	Level level() const noexcept;
+
+private:
+	Options               d_options;
+	std::atomic<uint64_t> d_frames{0}, d_late{0};
+	clock::time_point     d_windowStart;
+	size_t                d_overloaded{0}, d_idle{0};
+	std::atomic<Level>    d_level{Level::NOMINAL};
+};
+
+} // namespace yams
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include "QoSGovernor.hpp"
+
+namespace yams {
+
+class QoSGovernorTest : public ::testing::Test {
+protected:
+	using Level = QoSGovernor::Level;
+
+	QoSGovernor                    governor{{}};
+	QoSGovernor::clock::time_point now = QoSGovernor::clock::now();
+
+	void SetUp() override {
+		governor.update(now);
+	}
+
+	// reports a one second window of 60 frames with late events.
+	std::optional<Level> window(size_t late) {
+		for (size_t i = 0; i < 60; ++i) {
+			governor.reportFrame();
+		}
+		for (size_t i = 0; i < late; ++i) {
+			governor.reportLate();
+		}
+		now += 1s;
+		return governor.update(now);
+	}
+};
+
+TEST_F(QoSGovernorTest, WaitsForTheWindowToClose) {
+	governor.reportLate();
+	EXPECT_FALSE(governor.update(now + 500ms).has_value());
+	EXPECT_FALSE(governor.update(now + 1s).has_value());
+	EXPECT_EQ(governor.level(), Level::NOMINAL);
+}
+
+TEST_F(QoSGovernorTest, DegradesOnSustainedPressureOnly) {
+	// isolated bursts never degrade.
+	for (int i = 0; i < 10; ++i) {
+		EXPECT_FALSE(window(10).has_value());
+		EXPECT_FALSE(window(0).has_value());
+	}
+	EXPECT_EQ(governor.level(), Level::NOMINAL);
+
+	EXPECT_FALSE(window(10).has_value());
+	EXPECT_EQ(window(10), Level::SKIP_BACKGROUND_FRAMES);
+	EXPECT_FALSE(window(10).has_value());
+	EXPECT_EQ(window(10), Level::REDUCED_DECODE);
+	EXPECT_FALSE(window(10).has_value());
+	EXPECT_EQ(window(10), Level::REDUCED_MIX);
+	EXPECT_FALSE(window(10).has_value());
+	EXPECT_EQ(window(10), Level::NO_PREVIEW);
+	for (int i = 0; i < 10; ++i) {
+		EXPECT_FALSE(window(10).has_value());
+	}
+	EXPECT_EQ(governor.level(), QoSGovernor::MaxLevel);
+}
+
+TEST_F(QoSGovernorTest, RecoversWithHysteresis) {
+	for (int i = 0; i < 4; ++i) {
+		window(60);
+	}
+	ASSERT_EQ(governor.level(), Level::REDUCED_DECODE);
+
+	// moderate pressure neither degrades nor recovers.
+	for (int i = 0; i < 10; ++i) {
+		EXPECT_FALSE(window(1).has_value());
+	}
+
+	for (int i = 0; i < 4; ++i) {
+		EXPECT_FALSE(window(0).has_value());
+	}
+	EXPECT_EQ(window(0), Level::SKIP_BACKGROUND_FRAMES);
+	for (int i = 0; i < 4; ++i) {
+		EXPECT_FALSE(window(0).has_value());
+	}
+	EXPECT_EQ(window(0), Level::NOMINAL);
+	for (int i = 0; i < 10; ++i) {
+		EXPECT_FALSE(window(0).has_value());
+	}
+}
+
+TEST_F(QoSGovernorTest, StalledOutputIsOverload) {
+	governor.reportLate();
+	now += 1s;
+	EXPECT_FALSE(governor.update(now).has_value());
+	governor.reportLate();
+	now += 1s;
+	EXPECT_EQ(governor.update(now), Level::SKIP_BACKGROUND_FRAMES);
+}
+
+} // namespace yams
@@ -26,6 +26,10 @@
 #include <qwindow.h>
 #include <yams/gstreamer/Memory.hpp>
 #include <yams/gstreamer/QOpenGL.hpp>
+#include <yams/utils/Trace.hpp>
+
+#include <cpptrace/exceptions.hpp>
+#include <yams/utils/defer.hpp>
 #include <yams/utils/slogQt.hpp>
 
 #include <gst/video/video.h>
@@ -35,42 +39,66 @@ namespace yams {
 void VideoOutput::pushNewFrame(yams::Frame::Ptr frame) {
 	using clock = std::chrono::steady_clock;
 
-	static clock::time_point        last;
-	static bool                     once = false;
-	static int                      i    = 0;
-	static std::chrono::nanoseconds delta{0}, max{0}, min{1s};
-
 	auto now = clock::now();
-
-	if (once) {
-		delta = now - last;
-		min   = std::min(min, delta);
-		max   = std::max(max, delta);
+	if (d_pushed > 0) {
+		auto delta    = now - d_lastPush;
+		d_minInterval = std::min(d_minInterval, delta);
+		d_maxInterval = std::max(d_maxInterval, delta);
+		d_frameInterval.record(delta);
 	}
-	last = now;
-	once = true;
-	if (++i % 60 == 0) {
+	d_lastPush = now;
+	if (++d_pushed % 60 == 0) {
 		slog::Info(
 		    "pushed",
-		    slog::Int("i", i),
+		    slog::String("output", d_options.Name),
+		    slog::Int("i", d_pushed),
 		    slog::Duration("PTS", frame->PTS()),
 		    slog::Duration("DTS", frame->DTS()),
 		    slog::Duration("duration", frame->Duration()),
-		    slog::Duration("delta", delta),
-		    slog::Duration("delta_min", min),
-		    slog::Duration("delta_max", max)
+		    slog::Duration("delta_min", d_minInterval),
+		    slog::Duration("delta_max", d_maxInterval)
 		);
-		max = std::chrono::nanoseconds{0};
-		min = std::chrono::nanoseconds{1s};
+		d_maxInterval = std::chrono::nanoseconds{0};
+		d_minInterval = std::chrono::nanoseconds{1s};
 	}
-	d_frame = frame;
+	trace::mark(trace::Stage::Handoff, -1, frame->PTS().count());
+	if (d_frame != nullptr && d_framePainted == false) {
+		d_droppedFrames.inc();
+		// a secondary screen at a lower refresh rate always drops frames,
+		// only the primary paces the composition.
+		if (d_primary == nullptr && d_compositor != nullptr) {
+			d_compositor->reportLate();
+		}
+	}
+	d_frame        = frame;
+	d_framePainted = false;
 	update();
+	emit framePushed(frame);
 }
 
-VideoOutput::VideoOutput(QScreen *target, QWindow *parent)
+VideoOutput::VideoOutput(
+    QScreen *target, Options options, VideoOutput *primary, QWindow *parent
+)
     : QOpenGLWindow(QOpenGLWindow::NoPartialUpdate, parent)
+    , d_options{std::move(options)}
+    , d_primary{primary}
     , d_size{target->geometry().size()}
-    , d_inputSize{target->geometry().size()} {
+    , d_inputSize{target->geometry().size()}
+    , d_frameInterval{metrics::Registry::Global().histogram(
+          "yams_output_frame_interval_seconds",
+          "Interval between frames received by the output.",
+          {{"output", d_options.Name}}
+      )}
+    , d_syncWait{metrics::Registry::Global().histogram(
+          "yams_output_gl_sync_wait_seconds",
+          "Time spent waiting on the compositor GL sync point.",
+          {{"output", d_options.Name}}
+      )}
+    , d_droppedFrames{metrics::Registry::Global().counter(
+          "yams_output_dropped_frames_total",
+          "Frames replaced by a newer one before being painted.",
+          {{"output", d_options.Name}}
+      )} {
 
 	setCursor(QCursor{Qt::BlankCursor});
 	setFlags(Qt::Window | Qt::FramelessWindowHint);
@@ -91,9 +119,76 @@ VideoOutput::VideoOutput(QScreen *target, QWindow *parent)
 
 	connect(this, &QWindow::visibleChanged, this, displayFormat);
 #endif
+	connect(this, &QOpenGLWindow::frameSwapped, this, [this]() {
+		if (trace::enabled() == false) {
+			return;
+		}
+		trace::record(
+		    trace::Stage::Swap,
+		    d_paintEnd,
+		    trace::now() - d_paintEnd,
+		    -1,
+		    d_frame != nullptr ? d_frame->PTS().count() : -1
+		);
+	});
+	if (d_options.PixelMapOutput.has_value()) {
+		presentPixelMap(d_options.PixelMapOutput.value());
+	} else if (d_primary != nullptr) {
+		// the primary emits from the GUI thread, but may do so before this
+		// output is exposed.
+		connect(
+		    d_primary,
+		    &VideoOutput::framePushed,
+		    this,
+		    &VideoOutput::pushNewFrame
+		);
+		connect(
+		    d_primary,
+		    &VideoOutput::workingSizeChanged,
+		    this,
+		    &VideoOutput::updateWorkingSize
+		);
+	}
 	d_projection = computeProjection();
 }
 
+void VideoOutput::presentPixelMap(size_t output) {
+	if (d_primary == nullptr ||
+	    d_primary->d_options.PixelMapping.has_value() == false ||
+	    output >= d_primary->d_options.PixelMapping->Outputs.size()) {
+		throw cpptrace::invalid_argument{
+		    "output " + d_options.Name + " has no pixel map output"
+		};
+	}
+	const auto &map    = d_primary->d_options.PixelMapping.value();
+	auto        atlas  = map.atlasSize();
+	auto        region = map.region(output);
+
+	d_inputSize = atlas;
+
+	auto &mapping        = d_options.Mapping;
+	mapping.SourceX      = double(region.X) / atlas.width();
+	mapping.SourceY      = double(region.Y) / atlas.height();
+	mapping.SourceWidth  = double(region.Width) / atlas.width();
+	mapping.SourceHeight = double(region.Height) / atlas.height();
+	// LED processors capture a fixed pixel area, nothing is scaled.
+	double right  = double(region.Width) / d_size.width();
+	double bottom = double(region.Height) / d_size.height();
+	mapping.Warp  = OutputMapping::Corners{{
+	    {0.0, 0.0},
+	    {right, 0.0},
+	    {right, bottom},
+	    {0.0, bottom},
+	}};
+
+	connect(
+	    d_primary,
+	    &VideoOutput::pixelMapFramePushed,
+	    this,
+	    &VideoOutput::pushNewFrame
+	);
+}
+
 void VideoOutput::showOnTarget() {
 	show();
 	QCoreApplication::processEvents();
@@ -134,38 +229,9 @@ void VideoOutput::initializeGL() {
 		}
 	}
 
-	d_compositor = std::make_unique<Compositor>(
-	    Compositor::Options{
-	        .Size   = screen()->geometry().size(),
-	        .Layers = 2,
-	        .FPS    = screen()->refreshRate(),
-	    },
-	    Compositor::Args{
-	        .Display = d_display.get(),
-	        .Context = d_context.get(),
-	        .Parent  = nullptr,
-	    }
-	);
-	d_compositor->moveToThread(&d_gstreamerThread);
-	d_gstreamerThread.start();
-
-	connect(
-	    d_compositor.get(),
-	    &Compositor::outputSizeChanged,
-	    this,
-	    &VideoOutput::updateWorkingSize,
-	    Qt::QueuedConnection
-	);
-	connect(
-	    d_compositor.get(),
-	    &Compositor::newFrame,
-	    this,
-	    &VideoOutput::pushNewFrame,
-	    Qt::QueuedConnection
-	);
-
-	d_compositor->start();
-
+	if (d_primary == nullptr) {
+		startCompositor();
+	}
 	d_initialized.store(true);
 	d_initialized.notify_all();
 
@@ -223,7 +289,11 @@ void VideoOutput::initializeGL() {
 	d_frameVAO.release();
 
 	QSize textureSize = {320, 240};
-	d_inputSize       = textureSize;
+	if (d_primary == nullptr) {
+		d_inputSize = textureSize;
+	} else if (d_options.PixelMapOutput.has_value() == false) {
+		d_inputSize = d_primary->d_inputSize;
+	}
 	QImage frame{textureSize, QImage::Format_RGB888};
 	frame.fill(Qt::cyan);
 
@@ -231,45 +301,94 @@ void VideoOutput::initializeGL() {
 	d_projection  = computeProjection();
 }
 
-VideoOutput::Matrix3f VideoOutput::computeProjection() const {
-	auto  ratio = float(d_size.height()) / float(d_inputSize.height());
-	float width = d_inputSize.width() * ratio;
-	if (width <= d_size.width()) {
-		ratio = float(width) / float(d_size.width());
-		// viewport with full height
-		// clang-format off
-		return Matrix3f{
-		    .data = {
-				ratio, 0.0f, 0.0f,
-				0.0f, -1.0f, 0.0f,
-		        0.0f, 0.0f, 0.0f
-			},
-		};
-		// clang-format on
-	} else {
-		float height = d_inputSize.height() * float(d_size.width()) /
-		               float(d_inputSize.width());
-		ratio = float(height) / float(d_size.height());
-		// viewport with full width
-		// clang-format off
-		return Matrix3f{
-		    .data = {
-				1.0f, 0.0f, 0.0f,
-				0.0f, -ratio, 0.0f,
-		        0.0f, 0.0f, 0.0f
-			},
-		};
-		// clang-format on
+void VideoOutput::startCompositor() {
+	std::optional<Compositor::RecordOptions> record;
+	if (auto path = std::getenv("YAMS_RECORD"); path != nullptr) {
+		record = Compositor::RecordOptions{.Path = path};
+	}
+	d_compositor = std::make_unique<Compositor>(
+	    Compositor::Options{
+	        .Size           = screen()->geometry().size(),
+	        .Layers         = 2,
+	        .FPS            = screen()->refreshRate(),
+	        .MeasureLatency = std::getenv("YAMS_MEASURE_LATENCY") != nullptr,
+	        .PixelMapping   = d_options.PixelMapping,
+	        .Record         = record,
+	    },
+	    Compositor::Args{
+	        .Display = d_display.get(),
+	        .Context = d_context.get(),
+	        .Parent  = nullptr,
+	    }
+	);
+	d_compositor->moveToThread(&d_gstreamerThread);
+	d_gstreamerThread.start();
+
+	connect(
+	    d_compositor.get(),
+	    &Compositor::outputSizeChanged,
+	    this,
+	    &VideoOutput::updateWorkingSize,
+	    Qt::QueuedConnection
+	);
+	connect(
+	    d_compositor.get(),
+	    &Compositor::newFrame,
+	    this,
+	    &VideoOutput::pushNewFrame,
+	    Qt::QueuedConnection
+	);
+	connect(
+	    d_compositor.get(),
+	    &Compositor::pixelMapFrame,
+	    this,
+	    &VideoOutput::pixelMapFramePushed,
+	    Qt::QueuedConnection
+	);
+
+	d_compositor->start();
+}
+
+OutputMapping::Matrix3 VideoOutput::computeProjection() const {
+	const auto &mapping = d_options.Mapping;
+	if (mapping.Warp.has_value()) {
+		return OutputMapping::Homography(mapping.Warp.value());
 	}
+	auto regionAspect = (mapping.SourceWidth * d_inputSize.width()) /
+	                    (mapping.SourceHeight * d_inputSize.height());
+	auto outputAspect = double(d_size.width()) / double(d_size.height());
+	return OutputMapping::Homography(
+	    OutputMapping::Fit(regionAspect, outputAspect)
+	);
 }
 
 void VideoOutput::updateWorkingSize(QSize size) {
 	d_inputSize  = size;
 	d_projection = computeProjection();
 	update();
+	emit workingSizeChanged(size);
+}
+
+void VideoOutput::setMapping(const OutputMapping &mapping) {
+	d_options.Mapping = mapping;
+	d_projection      = computeProjection();
+	update();
+}
+
+const OutputMapping &VideoOutput::mapping() const {
+	return d_options.Mapping;
 }
 
 void VideoOutput::paintGL() {
+	trace::Span span{
+	    trace::Stage::Paint,
+	    -1,
+	    d_frame != nullptr ? d_frame->PTS().count() : -1
+	};
+	defer {
+		d_paintEnd = trace::now();
+	};
+
 	while (d_toDispose.size() > 5) {
 		d_toDispose.pop_front();
 	}
@@ -279,12 +398,36 @@ void VideoOutput::paintGL() {
 
 	d_shader.bind();
 
-	auto loc = d_shader.uniformLocation("scaleMat");
-	glUniformMatrix3fv(loc, 1, GL_FALSE, d_projection.data);
+	const auto &mapping = d_options.Mapping;
+	glUniformMatrix3fv(
+	    d_shader.uniformLocation("warpMat"),
+	    1,
+	    GL_FALSE,
+	    d_projection.data()
+	);
+	d_shader.setUniformValue(
+	    "sourceRect",
+	    float(mapping.SourceX),
+	    float(mapping.SourceY),
+	    float(mapping.SourceWidth),
+	    float(mapping.SourceHeight)
+	);
+	d_shader.setUniformValue(
+	    "blend",
+	    float(mapping.BlendLeft),
+	    float(mapping.BlendTop),
+	    float(mapping.BlendRight),
+	    float(mapping.BlendBottom)
+	);
+	d_shader.setUniformValue("blendGamma", float(mapping.BlendGamma));
 
 	glActiveTexture(GL_TEXTURE0);
 	if (d_frame != nullptr) {
+		trace::Span wait{trace::Stage::GLSyncWait, -1, d_frame->PTS().count()};
+		auto        start = std::chrono::steady_clock::now();
 		d_frame->waitSync(d_context.get());
+		d_syncWait.record(std::chrono::steady_clock::now() - start);
+		d_framePainted = true;
 		glBindTexture(GL_TEXTURE_2D, d_frame->TexID());
 	} else {
 		d_placeholder->bind();
@@ -312,6 +455,9 @@ void VideoOutput::resizeGL(int w, int h) {
 }
 
 Compositor *VideoOutput::compositor() {
+	if (d_primary != nullptr) {
+		return d_primary->compositor();
+	}
 	d_initialized.wait(false);
 	return d_compositor.get();
 }
@@ -2,7 +2,10 @@
 
 #include "yams/Compositor.hpp"
 #include "yams/Frame.hpp"
+#include "yams/OutputMapping.hpp"
+#include "yams/PixelMap.hpp"
 #include <yams/gstreamer/Memory.hpp>
+#include <yams/utils/Metrics.hpp>
 
 #include <QOpenGLBuffer>
 #include <QOpenGLFunctions>
@@ -18,7 +21,28 @@ namespace yams {
 class VideoOutput : public QOpenGLWindow, protected QOpenGLFunctions {
 	Q_OBJECT
 public:
-	VideoOutput(QScreen *target, QWindow *parent = nullptr);
+	struct Options {
+		// labels the pacing metrics of this output.
+		std::string   Name = "main";
+		OutputMapping Mapping;
+		// primary only, see Compositor::Options::PixelMapping.
+		std::optional<PixelMap> PixelMapping;
+		// secondary only, presents this output of the primary pixel map,
+		// pixel for pixel from the top-left corner, instead of the
+		// composition.
+		std::optional<size_t> PixelMapOutput;
+	};
+
+	/// Without a primary, the output owns the Compositor. Otherwise it
+	/// presents the frames of its primary, sharing its GL textures. The
+	/// application must set Qt::AA_ShareOpenGLContexts, and the primary must
+	/// outlive it.
+	VideoOutput(
+	    QScreen     *target,
+	    Options      options = {},
+	    VideoOutput *primary = nullptr,
+	    QWindow     *parent  = nullptr
+	);
 	virtual ~VideoOutput();
 
 	VideoOutput(const VideoOutput &)            = delete;
@@ -28,10 +52,19 @@ public:
 
 	Compositor *compositor();
 
+	const OutputMapping &mapping() const;
+
 public slots:
 	void showOnTarget();
 	void pushNewFrame(yams::Frame::Ptr frame);
 	void updateWorkingSize(QSize size);
+	void setMapping(const yams::OutputMapping &mapping);
+
+signals:
+	// re-emitted by a primary for its secondary outputs.
+	void framePushed(yams::Frame::Ptr frame);
+	void workingSizeChanged(QSize size);
+	void pixelMapFramePushed(yams::Frame::Ptr frame);
 
 protected:
 	void initializeGL() override;
@@ -42,13 +75,13 @@ protected:
 
 private:
 	void setSize(int w, int h);
+	void startCompositor();
+	void presentPixelMap(size_t output);
 
-	struct Matrix3f {
-		float data[9];
-	};
-
-	Matrix3f computeProjection() const;
+	OutputMapping::Matrix3 computeProjection() const;
 
+	Options                     d_options;
+	VideoOutput                *d_primary = nullptr;
 	QThread                     d_gstreamerThread;
 	std::unique_ptr<Compositor> d_compositor;
 
@@ -61,8 +94,17 @@ private:
 	std::atomic<bool>        d_initialized = false;
 	GstGLDisplayPtr          d_display;
 	GstGLContextPtr          d_context;
-	Matrix3f                 d_projection;
+	OutputMapping::Matrix3   d_projection;
+	std::chrono::nanoseconds d_paintEnd{0};
+	bool                     d_framePainted{false};
+
+	std::chrono::steady_clock::time_point d_lastPush;
+	int                                   d_pushed{0};
+	std::chrono::nanoseconds d_minInterval{1s}, d_maxInterval{0};
 
 	std::deque<Frame::Ptr> d_toDispose;
+
+	metrics::Histogram &d_frameInterval, &d_syncWait;
+	metrics::Counter   &d_droppedFrames;
 };
 } // namespace yams
@@ -0,0 +1,18 @@
+#include <benchmark/benchmark.h>
+
+#include <QApplication>
+#include <gst/gst.h>
+
+#include <slog++/slog++.hpp>
+
+int main(int argc, char **argv) {
+	if (std::getenv("SLOG_DEBUG") != nullptr) {
+		slog::DefaultLogger().From(slog::Level::Debug);
+	}
+	::benchmark::Initialize(&argc, argv);
+	gst_init(&argc, &argv);
+	QApplication app(argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+	::benchmark::Shutdown();
+	return 0;
+}
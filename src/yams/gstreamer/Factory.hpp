@@ -2,6 +2,9 @@
 
 #include "Memory.hpp"
 
+#include <gst/gstcaps.h>
+#include <gst/gstcapsfeatures.h>
+
 #include <cpptrace/cpptrace.hpp>
 
 namespace yams {
@@ -21,4 +24,27 @@ GstElementFactoryMakeFull(const char *factory, Attributes &&...attrs) {
 	}
 	return GstElementPtr{res};
 }
+
+// RGBA caps in GL memory at a given size, e.g. for a capsfilter after a
+// glcolorscale. The caller owns the returned caps.
+inline GstCaps *GLMemoryCaps(int width, int height) {
+	// clang-format off
+	auto caps = gst_caps_new_simple(
+	    "video/x-raw",
+	    "format", G_TYPE_STRING, "RGBA",
+	    "width", G_TYPE_INT, width,
+	    "height", G_TYPE_INT, height,
+	    nullptr
+	);
+	// clang-format on
+	if (caps == nullptr) {
+		throw cpptrace::runtime_error{"could not build GL caps"};
+	}
+	gst_caps_set_features(
+	    caps,
+	    0,
+	    gst_caps_features_new("memory:GLMemory", nullptr)
+	);
+	return caps;
+}
 } // namespace yams
@@ -55,4 +55,5 @@ using GstMessagePtr        = glib_owned_ptr<GstMessage>;
 using GstGLDisplayPtr      = glib_owned_ptr<GstGLDisplay>;
 using GstGLContextPtr      = glib_owned_ptr<GstGLContext>;
 using GstClockPtr          = glib_owned_ptr<GstClock>;
+using GstControlSourcePtr  = glib_owned_ptr<GstControlSource>;
 } // namespace yams
@@ -0,0 +1,84 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <memory>
+
+#include <QThread>
+
+#include <gst/gstbus.h>
+#include <gst/gstmessage.h>
+#include <gst/gststructure.h>
+
+#include <yams/gstreamer/Pipeline.hpp>
+
+namespace yams {
+
+namespace {
+class BenchPipeline : public Pipeline {
+public:
+	BenchPipeline()
+	    : Pipeline{"bench", nullptr} {}
+
+	void postMessage() {
+		auto structure = gst_structure_new_empty("benchPipelineStruct");
+		auto msg       = gst_message_new_application(
+            GST_OBJECT_CAST(d_pipeline.get()),
+            structure
+        );
+		gst_bus_post(d_bus.get(), msg);
+	}
+
+	std::atomic<uint64_t> received{0};
+	bool                  dropOnSync{false};
+
+protected:
+	GstBusSyncReply onSyncMessage(GstMessage *msg) noexcept override {
+		return dropOnSync ? GST_BUS_DROP : GST_BUS_PASS;
+	}
+
+	void onMessage(GstMessage *msg) noexcept override {
+		received.fetch_add(1);
+		received.notify_all();
+	}
+};
+} // namespace
+
+// Message posted from the benchmark thread, dispatched to the pipeline's
+// QThread through the Qt event loop.
+static void BM_PipelineBusRoundTrip(benchmark::State &state) {
+	QThread thread;
+	auto    pipeline = std::make_unique<BenchPipeline>();
+	pipeline->moveToThread(&thread);
+	thread.start();
+
+	uint64_t expected = 0;
+	for (auto _ : state) {
+		pipeline->postMessage();
+		++expected;
+		for (auto current = pipeline->received.load(); current < expected;
+		     current      = pipeline->received.load()) {
+			pipeline->received.wait(current);
+		}
+	}
+	state.SetItemsProcessed(state.iterations());
+
+	pipeline.reset();
+	thread.quit();
+	thread.wait();
+}
+
+BENCHMARK(BM_PipelineBusRoundTrip)->UseRealTime();
+
+// Message handled synchronously in the posting thread.
+static void BM_PipelineBusSync(benchmark::State &state) {
+	BenchPipeline pipeline;
+	pipeline.dropOnSync = true;
+	for (auto _ : state) {
+		pipeline.postMessage();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_PipelineBusSync);
+
+} // namespace yams
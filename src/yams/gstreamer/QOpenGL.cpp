@@ -104,4 +104,47 @@ wrapQOpenGLContext(GstGLDisplay *display, QOpenGLContext *context) {
 	)};
 #endif
 }
+
+bool setGLContext(
+    GstMessage *msg, GstGLDisplay *display, GstGLContext *context
+) {
+	const gchar *contextType{nullptr};
+	gst_message_parse_context_type(msg, &contextType);
+
+	if (g_strcmp0(contextType, GST_GL_DISPLAY_CONTEXT_TYPE) == 0) {
+		GstContext *displayContext =
+		    gst_context_new(GST_GL_DISPLAY_CONTEXT_TYPE, TRUE);
+		gst_context_set_gl_display(displayContext, display);
+		gst_element_set_context(GST_ELEMENT(msg->src), displayContext);
+		gst_context_unref(displayContext);
+		slog::Debug(
+		    "handled",
+		    slog::String("type", contextType),
+		    slog::String("source", (const char *)msg->src->name),
+		    slog::Pointer("display", display)
+		);
+		return true;
+	}
+	if (g_strcmp0(contextType, "gst.gl.app_context") == 0) {
+		GstContext   *appContext = gst_context_new("gst.gl.app_context", TRUE);
+		GstStructure *s          = gst_context_writable_structure(appContext);
+		gst_structure_set(
+		    s,
+		    "context",
+		    GST_TYPE_GL_CONTEXT,
+		    context,
+		    nullptr
+		);
+		gst_element_set_context(GST_ELEMENT(msg->src), appContext);
+		gst_context_unref(appContext);
+		slog::Debug(
+		    "handled",
+		    slog::String("type", contextType),
+		    slog::String("source", (const char *)msg->src->name),
+		    slog::Pointer("context", context)
+		);
+		return true;
+	}
+	return false;
+}
 } // namespace yams
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <gst/gstmessage.h>
+
 #include <yams/gstreamer/Memory.hpp>
 class QOpenGLContext;
 
@@ -8,4 +10,11 @@ GstGLDisplayPtr fromGuiApplication();
 
 GstGLContextPtr
 wrapQOpenGLContext(GstGLDisplay *display, QOpenGLContext *context);
+
+// Answers a GST_MESSAGE_NEED_CONTEXT asking for the GL display or the
+// application GL context, so that every pipeline shares GL objects with the
+// outputs. Returns false if msg asks for another context.
+bool setGLContext(
+    GstMessage *msg, GstGLDisplay *display, GstGLContext *context
+);
 } // namespace yams
@@ -0,0 +1,235 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTimer>
+
+#include <gst/gst.h>
+
+#include <slog++/slog++.hpp>
+
+#include <yams/HeadlessCompositor.hpp>
+#include <yams/utils/Logging.hpp>
+#include <yams/utils/MetricsServer.hpp>
+#include <yams/utils/Trace.hpp>
+
+// Runs the compositor without a window and reports its throughput, e.g.:
+//   yams-headless --layers 3 --size 3840x2160 --unthrottled --duration 20
+// or measures the play() to output latency over 300 triggers:
+//   yams-headless --layers 2 --latency 300
+// or the cost of grabbing the output every 100ms, compared with --grab 0
+// where the grab branches are idle, and with no grab branch at all:
+//   yams-headless --unthrottled --grab 100 --grab-size 640x360
+int main(int argc, char *argv[]) {
+	using namespace std::chrono_literals;
+
+	gst_init(&argc, &argv);
+	yams::setLogLevel(
+	    std::getenv("YAMS_DEBUG") != nullptr ? slog::Level::Debug
+	                                         : slog::Level::Info
+	);
+	yams::initLogging();
+	QCoreApplication app(argc, argv);
+	if (yams::trace::startFromEnvironment() == false) {
+		// only kept in memory, for the per-stage latencies.
+		yams::trace::start({});
+	}
+	auto metricsServer = yams::metrics::Server::FromEnvironment(
+	    yams::metrics::Registry::Global()
+	);
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("YAMS headless compositor benchmark");
+	parser.addHelpOption();
+	parser.addOptions({
+	    {"layers", "Number of test layers (1-3).", "layers", "1"},
+	    {"size", "Output size.", "WxH", "1920x1080"},
+	    {"fps", "Output framerate when throttled.", "fps", "60"},
+	    {"unthrottled", "Produce frames as fast as possible."},
+	    {"duration", "Duration of the run in seconds.", "seconds", "10"},
+	    {"latency",
+	     "Measures the latency of N play() triggers on the top layer.",
+	     "N",
+	     "0"},
+	    {"trigger-period", "Period between triggers.", "ms", "1500"},
+	    {"grab",
+	     "Grabs the output every period, 0 only adds the grab branches.",
+	     "ms"},
+	    {"grab-size", "Size of the grabs, the output size if unset.", "WxH"},
+	});
+	parser.process(app);
+
+	auto size = parser.value("size").split('x');
+	if (size.size() != 2) {
+		parser.showHelp(1);
+	}
+	auto triggers = parser.value("latency").toInt();
+	auto period =
+	    std::chrono::milliseconds{parser.value("trigger-period").toInt()};
+	auto  grabPeriod = std::chrono::milliseconds{parser.value("grab").toInt()};
+	QSize grabSize;
+	if (parser.isSet("grab-size")) {
+		auto size = parser.value("grab-size").split('x');
+		if (size.size() != 2) {
+			parser.showHelp(1);
+		}
+		grabSize = {size[0].toInt(), size[1].toInt()};
+	}
+	yams::Compositor::Options options{
+	    .Size           = {size[0].toInt(), size[1].toInt()},
+	    .Layers         = parser.value("layers").toULong(),
+	    .FPS            = parser.value("fps").toDouble(),
+	    .Throttled      = parser.isSet("unthrottled") == false,
+	    .MeasureLatency = triggers > 0,
+	    // measures the compositing cost, even when no layer plays.
+	    .IdlePause = false,
+	    .Grab      = parser.isSet("grab"),
+	};
+	std::chrono::milliseconds duration =
+	    std::chrono::seconds{parser.value("duration").toInt()};
+	if (options.Layers < 1 || options.Size.isEmpty() || options.FPS <= 0.0 ||
+	    duration <= 0s || triggers < 0 || period <= 0ms || grabPeriod < 0ms) {
+		parser.showHelp(1);
+	}
+	if (triggers > 0) {
+		// the last trigger still needs to reach the output.
+		duration = std::max(duration, triggers * period + 2s);
+	}
+	// in latency mode the top layer is reserved to triggers.
+	size_t loopingLayers = triggers > 0 ? options.Layers - 1 : options.Layers;
+
+	yams::HeadlessCompositor headless{options};
+	headless.compositor()->start();
+
+	// let the pipeline reach PLAYING before scheduling media.
+	QTimer::singleShot(500ms, [&]() {
+		static const char *patterns[] = {"ball", "smpte", "pinwheel"};
+		for (size_t i = 0; i < loopingLayers; ++i) {
+			headless.compositor()->play(
+			    yams::MediaPlayInfo{
+			        .MediaType = yams::MediaPlayInfo::Type::TEST,
+			        .Location  = patterns[i % 3],
+			        .Duration  = duration,
+			        .Loop      = true,
+			    },
+			    i
+			);
+		}
+	});
+
+	int    triggered = 0;
+	QTimer trigger;
+	QObject::connect(&trigger, &QTimer::timeout, [&]() {
+		headless.compositor()->play(
+		    yams::MediaPlayInfo{
+		        .MediaType = yams::MediaPlayInfo::Type::TEST,
+		        .Location  = "smpte",
+		        .Duration  = 250ms,
+		    },
+		    options.Layers - 1
+		);
+		if (++triggered == triggers) {
+			trigger.stop();
+		}
+	});
+	if (triggers > 0) {
+		trigger.start(period);
+	}
+
+	QTimer grab;
+	QObject::connect(&grab, &QTimer::timeout, [&]() {
+		// images are not used, only their delay is recorded.
+		headless.compositor()->grab(yams::Compositor::Program, grabSize);
+	});
+	if (grabPeriod > 0ms) {
+		grab.start(grabPeriod);
+	}
+
+	yams::HeadlessCompositor::Stats total;
+	auto accumulate = [&](const yams::HeadlessCompositor::Stats &stats) {
+		total.Frames       += stats.Frames;
+		total.Elapsed      += stats.Elapsed;
+		total.LagMax        = std::max(total.LagMax, stats.LagMax);
+		total.IntervalMax   = std::max(total.IntervalMax, stats.IntervalMax);
+		total.ResidentBytes =
+		    std::max(total.ResidentBytes, stats.ResidentBytes);
+		if (total.Stages.empty()) {
+			total.Stages = stats.Stages;
+		} else {
+			for (size_t i = 0; i < stats.Stages.size(); ++i) {
+				auto       &stage   = total.Stages[i];
+				const auto &sampled = stats.Stages[i];
+				if (sampled.Samples == 0) {
+					continue;
+				}
+				stage.Mean = (stage.Mean * stage.Samples +
+				              sampled.Mean * sampled.Samples) /
+				             (stage.Samples + sampled.Samples);
+				stage.Max      = std::max(stage.Max, sampled.Max);
+				stage.Samples += sampled.Samples;
+			}
+		}
+	};
+
+	QTimer report;
+	QObject::connect(&report, &QTimer::timeout, [&]() {
+		auto stats = headless.stats();
+		accumulate(stats);
+		slog::Info(
+		    "headless stats",
+		    slog::Int("frames", stats.Frames),
+		    slog::Float("fps", stats.FPS),
+		    slog::Duration("lag_mean", stats.LagMean),
+		    slog::Duration("lag_max", stats.LagMax),
+		    slog::Duration("interval_min", stats.IntervalMin),
+		    slog::Duration("interval_max", stats.IntervalMax),
+		    slog::Int("rss_kib", stats.ResidentBytes / 1024)
+		);
+	});
+	report.start(1s);
+
+	QTimer::singleShot(duration + 500ms, [&]() {
+		report.stop();
+		grab.stop();
+		// the frames since the last report.
+		accumulate(headless.stats());
+		headless.compositor()->stop();
+		auto elapsed = std::chrono::duration<double>(total.Elapsed);
+		slog::Info(
+		    "headless summary",
+		    slog::Int("layers", options.Layers),
+		    slog::Int("width", options.Size.width()),
+		    slog::Int("height", options.Size.height()),
+		    slog::Int("frames", total.Frames),
+		    slog::Float("fps", total.Frames / elapsed.count()),
+		    slog::Duration("lag_max", total.LagMax),
+		    slog::Duration("interval_max", total.IntervalMax),
+		    slog::Int("rss_max_kib", total.ResidentBytes / 1024)
+		);
+		for (const auto &stage : total.Stages) {
+			slog::Info(
+			    "headless summary stage",
+			    slog::String("from", yams::trace::stageName(stage.From)),
+			    slog::String("to", yams::trace::stageName(stage.To)),
+			    slog::Int("samples", stage.Samples),
+			    slog::Duration("mean", stage.Mean),
+			    slog::Duration("max", stage.Max)
+			);
+		}
+		if (grabPeriod > 0ms) {
+			const auto &grabs = yams::metrics::Registry::Global().histogram(
+			    "yams_grab_seconds",
+			    "Delay between a grab request and its image."
+			);
+			slog::Info(
+			    "grab summary",
+			    slog::Int("grabs", grabs.count()),
+			    slog::Duration("p50", grabs.quantile(0.5)),
+			    slog::Duration("p99", grabs.quantile(0.99))
+			);
+		}
+		app.quit();
+	});
+
+	auto res = app.exec();
+	yams::trace::stop();
+	return res;
+}
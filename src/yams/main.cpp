@@ -1,4 +1,5 @@
 #include <QApplication>
+#include <QFile>
 #include <QGuiApplication>
 #include <QObject>
 #include <QOpenGLContext>
@@ -6,12 +7,18 @@
 #include <QTimer>
 
 #include "Frame.hpp"
+#include "PixelMap.hpp"
 #include "VideoOutput.hpp"
 #include "yams/Compositor.hpp"
+#include "yams/utils/Logging.hpp"
+#include "yams/utils/MetricsServer.hpp"
+#include "yams/utils/Trace.hpp"
 #include "yams/utils/slogQt.hpp"
 
 #include <algorithm>
 #include <chrono>
+#include <memory>
+#include <optional>
 #include <gst/video/video-info.h>
 #include <qcoreapplication.h>
 #include <qmetaobject.h>
@@ -20,12 +27,44 @@
 #include <qsurfaceformat.h>
 #include <qthread.h>
 #include <qwindow.h>
+#include <cpptrace/exceptions.hpp>
 #include <slog++/Attribute.hpp>
 #include <slog++/slog++.hpp>
 
+QScreen *findScreen(const QString &wanted) {
+	auto screens   = QGuiApplication::screens();
+	bool isIndex   = false;
+	auto wantedIdx = wanted.toInt(&isIndex);
+	if (isIndex) {
+		if (wantedIdx < 0 || wantedIdx >= screens.size()) {
+			slog::Warn(
+			    "screen index out of range",
+			    slog::String("wanted", wanted.toStdString())
+			);
+			return nullptr;
+		}
+		return screens[wantedIdx];
+	}
+
+	auto found = std::find_if(
+	    screens.begin(),
+	    screens.end(),
+	    [&wanted](QScreen *s) {
+		    return s->name() == wanted || s->model() == wanted;
+	    }
+	);
+	if (found == screens.end()) {
+		slog::Warn(
+		    "wanted screen not found",
+		    slog::String("wanted", wanted.toStdString())
+		);
+		return nullptr;
+	}
+	return *found;
+}
+
 QScreen *selectScreen() {
-	auto     screens = QGuiApplication::screens();
-	QScreen *target;
+	auto screens = QGuiApplication::screens();
 	if (screens.size() == 1) {
 		slog::Warn("only one screen");
 		return screens[0];
@@ -33,33 +72,8 @@ QScreen *selectScreen() {
 	auto wanted = std::getenv("YAMS_OUTPUT_SCREEN");
 
 	if (wanted != nullptr) {
-		auto wantedIdx = std::atoi(wanted);
-		if (wantedIdx > 0 || QString(wanted) == "0") {
-			if (wantedIdx >= screens.size()) {
-				slog::Warn(
-				    "screen index out of range",
-				    slog::String("wanted", wanted)
-				);
-			} else {
-				return screens[wantedIdx];
-			}
-		} else {
-
-			auto found = std::find_if(
-			    screens.begin(),
-			    screens.end(),
-			    [wanted = QString(wanted)](QScreen *s) {
-				    return s->name() == wanted || s->model() == wanted;
-			    }
-			);
-			if (found == screens.end()) {
-				slog::Warn(
-				    "wanted screen not found",
-				    slog::String("wanted", wanted)
-				);
-			} else {
-				return *found;
-			}
+		if (auto found = findScreen(wanted); found != nullptr) {
+			return found;
 		}
 	}
 	auto primaryScreen = QGuiApplication::primaryScreen();
@@ -74,6 +88,42 @@ QScreen *selectScreen() {
 	);
 }
 
+// YAMS_MIRROR_SCREENS: comma separated screens also presenting the
+// composition, by index, name or model.
+std::vector<QScreen *> selectMirrorScreens(QScreen *target) {
+	std::vector<QScreen *> res;
+	auto                   wanted = std::getenv("YAMS_MIRROR_SCREENS");
+	if (wanted == nullptr) {
+		return res;
+	}
+	for (const auto &name : QString(wanted).split(',', Qt::SkipEmptyParts)) {
+		auto screen = findScreen(name.trimmed());
+		if (screen == nullptr || screen == target ||
+		    std::find(res.begin(), res.end(), screen) != res.end()) {
+			continue;
+		}
+		res.push_back(screen);
+	}
+	return res;
+}
+
+// YAMS_PIXEL_MAP: path of a PixelMap JSON file for LED processors.
+std::optional<yams::PixelMap> loadPixelMap(QSize composite) {
+	auto path = std::getenv("YAMS_PIXEL_MAP");
+	if (path == nullptr) {
+		return std::nullopt;
+	}
+	QFile file{path};
+	if (file.open(QIODevice::ReadOnly) == false) {
+		throw cpptrace::runtime_error{
+		    std::string{"could not open pixel map "} + path
+		};
+	}
+	auto res = yams::PixelMap::FromJson(file.readAll());
+	res.validate(composite);
+	return res;
+}
+
 template <typename T> std::string enumName(T v) {
 	auto me = QMetaEnum::fromType<T>();
 	return me.valueToKey(v);
@@ -105,10 +155,24 @@ void setOpenGLFormat() {
 int main(int argc, char *argv[]) {
 
 	gst_init(&argc, &argv);
+	auto level = std::getenv("YAMS_DEBUG") != nullptr ? slog::Level::Debug
+	                                                  : slog::Level::Info;
+	yams::setLogLevel(level);
+	// streaming threads log on every frame, keep I/O out of them. Its level
+	// also filters Qt messages.
+	auto logSink = yams::AsyncSink::Create({.Level = level});
+	yams::setLogSink(logSink);
+	// before the application, to capture the platform plugin messages.
+	yams::initLogging();
+	// some Qt platform plugins warn on every frame.
+	yams::setQtRateLimit({.Burst = 10});
+	// mirror outputs present the textures of the main one.
+	QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
 	QGuiApplication app(argc, argv);
-	if (std::getenv("YAMS_DEBUG") != nullptr) {
-		slog::DefaultLogger().From(slog::Level::Debug);
-	}
+	yams::trace::startFromEnvironment();
+	auto metricsServer = yams::metrics::Server::FromEnvironment(
+	    yams::metrics::Registry::Global()
+	);
 	setOpenGLFormat();
 
 	qRegisterMetaType<yams::Frame::Ptr>();
@@ -123,12 +187,64 @@ int main(int argc, char *argv[]) {
 	    slog::String("model", target->model().toStdString())
 	);
 
-	yams::VideoOutput window{target};
+	std::optional<yams::PixelMap> pixelMap;
+	try {
+		pixelMap = loadPixelMap(target->geometry().size());
+	} catch (const std::exception &e) {
+		slog::Error("invalid pixel map", slog::String("error", e.what()));
+		return 1;
+	}
+
+	yams::VideoOutput window{
+	    target,
+	    yams::VideoOutput::Options{.PixelMapping = pixelMap},
+	};
 	if (QGuiApplication::screens().size() == 1) {
 		window.show();
 	} else {
 		window.showOnTarget();
 	}
+
+	std::vector<std::unique_ptr<yams::VideoOutput>> outputs;
+	for (auto screen : selectMirrorScreens(target)) {
+		slog::Info(
+		    "mirror screen",
+		    slog::String("name", screen->name().toStdString())
+		);
+		auto &secondary = outputs.emplace_back(
+		    std::make_unique<yams::VideoOutput>(
+		        screen,
+		        yams::VideoOutput::Options{
+		            .Name = screen->name().toStdString(),
+		        },
+		        &window
+		    )
+		);
+		secondary->showOnTarget();
+	}
+	if (pixelMap.has_value()) {
+		for (size_t i = 0; i < pixelMap->Outputs.size(); ++i) {
+			const auto &infos = pixelMap->Outputs[i];
+			if (infos.Screen.empty()) {
+				continue;
+			}
+			auto screen = findScreen(QString::fromStdString(infos.Screen));
+			if (screen == nullptr) {
+				continue;
+			}
+			auto &secondary = outputs.emplace_back(
+			    std::make_unique<yams::VideoOutput>(
+			        screen,
+			        yams::VideoOutput::Options{
+			            .Name           = infos.Name,
+			            .PixelMapOutput = i,
+			        },
+			        &window
+			    )
+			);
+			secondary->showOnTarget();
+		}
+	}
 	using namespace std::chrono_literals;
 	QTimer::singleShot(2500, [&]() {
 		slog::Info("playing ball pattern");
@@ -160,8 +276,14 @@ int main(int argc, char *argv[]) {
 
 	QTimer::singleShot(8000, [&]() {
 		slog::Info("stopping");
+		for (auto &output : outputs) {
+			output->close();
+		}
 		window.close();
 	});
 
-	return app.exec();
+	auto res = app.exec();
+	yams::trace::stop();
+	logSink->Flush();
+	return res;
 }
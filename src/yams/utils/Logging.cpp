@@ -1,24 +1,224 @@
 #include <yams/utils/Logging.hpp>
 
+#include <algorithm>
+#include <array>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <string>
+#include <variant>
 
+#include <QtCore/QHashFunctions>
+#include <QtCore/QLoggingCategory>
 #include <QtCore/QMessageLogContext>
 #include <QtCore/QString>
 
+#include <cpptrace/exceptions.hpp>
 #include <qglobal.h>
+#include <slog++/Formatters.hpp>
 #include <slog++/slog++.hpp>
 
+#ifdef Q_OS_LINUX
+#include <sys/resource.h>
+#endif
+#ifdef Q_OS_WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
 namespace yams {
 
 namespace {
 
+void lowerCurrentThreadPriority() {
+#ifdef Q_OS_LINUX
+	// on Linux the nice value is per thread, 0 targets the calling one.
+	setpriority(PRIO_PROCESS, 0, 10);
+#endif
+#ifdef Q_OS_WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#endif
+}
+
+struct CategoryRule {
+	std::string Prefix;
+	slog::Level Level;
+};
+
+using CategoryRules = std::vector<CategoryRule>;
+
+// the sink of the default logger, when installed with setLogSink().
+std::atomic<std::shared_ptr<slog::Sink>>          s_sink;
+std::atomic<bool>                                 s_hasCategoryRules{false};
+std::atomic<std::shared_ptr<const CategoryRules>> s_categoryRules;
+
+std::atomic<bool>                s_categoryFilterInstalled{false};
+QLoggingCategory::CategoryFilter s_previousCategoryFilter{nullptr};
+
+slog::Level levelFor(QtMsgType type) {
+	switch (type) {
+	case QtDebugMsg:
+		return slog::Level::Debug;
+	case QtInfoMsg:
+		return slog::Level::Info;
+	case QtWarningMsg:
+		return slog::Level::Warn;
+	case QtCriticalMsg:
+		return slog::Level::Error;
+	case QtFatalMsg:
+	default:
+		return slog::Level::Fatal;
+	}
+}
+
+/// Tells if category is prefix or one of its sub-categories.
+bool matches(const char *category, const std::string &prefix) {
+	if (std::strncmp(category, prefix.c_str(), prefix.size()) != 0) {
+		return false;
+	}
+	auto next = category[prefix.size()];
+	return next == '\0' || next == '.';
+}
+
+/// Tells if a message of category at level should reach slog++. Only looks
+/// at the category name, the message itself is never touched.
+bool accepted(const char *category, slog::Level level) {
+	auto sink = s_sink.load();
+	if (sink != nullptr && sink->Enabled(level) == false) {
+		return false;
+	}
+	if (s_hasCategoryRules.load(std::memory_order_relaxed) == false) {
+		return true;
+	}
+
+	auto   rules = s_categoryRules.load();
+	size_t best{0};
+	auto   minimal{slog::Level::Trace};
+	for (const auto &rule : *rules) {
+		if (rule.Prefix.size() >= best && matches(category, rule.Prefix)) {
+			best    = rule.Prefix.size();
+			minimal = rule.Level;
+		}
+	}
+	return level >= minimal;
+}
+
+/// Disables the levels of Qt logging categories we would drop anyway, so
+/// qCDebug() and friends do not even format their message.
+void categoryFilter(QLoggingCategory *category) {
+	if (s_previousCategoryFilter != nullptr) {
+		s_previousCategoryFilter(category);
+	}
+	for (auto type : {QtDebugMsg, QtInfoMsg, QtWarningMsg, QtCriticalMsg}) {
+		if (accepted(category->categoryName(), levelFor(type)) == false) {
+			category->setEnabled(type, false);
+		}
+	}
+}
+
+void updateCategoryFilter() {
+	if (s_categoryFilterInstalled.load() == false) {
+		return;
+	}
+	// re-installing applies the filter again on all existing categories.
+	auto previous = QLoggingCategory::installFilter(categoryFilter);
+	if (previous != categoryFilter) {
+		s_previousCategoryFilter = previous;
+	}
+}
+
+/// Counts identical messages (same type, category and text) in fixed time
+/// windows. Collisions simply evict the previous message.
+class RateLimiter {
+public:
+	void configure(QtRateLimit limit) {
+		std::lock_guard lock{d_mutex};
+		d_window = limit.Window;
+		d_entries.fill({});
+		d_burst.store(limit.Burst, std::memory_order_relaxed);
+	}
+
+	/// Returns false if the message must be dropped. Otherwise suppressed is
+	/// set to the number of copies dropped during the previous window.
+	bool admit(
+	    QtMsgType type, const char *category, const QString &msg,
+	    size_t &suppressed
+	) {
+		suppressed = 0;
+		auto burst = d_burst.load(std::memory_order_relaxed);
+		if (burst == 0) {
+			return true;
+		}
+
+		size_t key = qHash(msg) ^ (qHash(QByteArrayView{category}) << 1) ^
+		             size_t(type);
+		key        = std::max(key, size_t(1));
+		auto now   = clock::now();
+
+		std::lock_guard lock{d_mutex};
+		auto           &entry = d_entries[key % d_entries.size()];
+		if (entry.key != key || now - entry.windowStart >= d_window) {
+			suppressed        = entry.key == key ? entry.suppressed : 0;
+			entry.key         = key;
+			entry.windowStart = now;
+			entry.count       = 1;
+			entry.suppressed  = 0;
+			return true;
+		}
+		if (++entry.count <= burst) {
+			return true;
+		}
+		++entry.suppressed;
+		return false;
+	}
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	struct Entry {
+		size_t            key{0};
+		clock::time_point windowStart;
+		size_t            count{0};
+		size_t            suppressed{0};
+	};
+
+	std::atomic<size_t>       d_burst{0};
+	std::mutex                d_mutex;
+	std::chrono::milliseconds d_window{1000};
+	std::array<Entry, 64>     d_entries;
+};
+
+RateLimiter s_rateLimiter;
+
 /// Qt message handler that redirects all Qt logging to slog++
 ///
 /// Maps Qt message types to slog++ severity levels and includes
-/// source location as structured attributes.
+/// source location as structured attributes. Filtering by level, category
+/// and rate happens before any conversion of the message.
 void qtMessageHandler(
     QtMsgType type, const QMessageLogContext &context, const QString &msg
 ) {
+	if (type != QtFatalMsg) {
+		const char *categoryName = context.category ? context.category : "";
+		if (accepted(categoryName, levelFor(type)) == false) {
+			return;
+		}
+		size_t suppressed{0};
+		if (s_rateLimiter.admit(type, categoryName, msg, suppressed) ==
+		    false) {
+			return;
+		}
+		if (suppressed > 0) {
+			slog::Warn(
+			    "suppressed repeated Qt messages",
+			    slog::String("qt_category", categoryName),
+			    slog::Int("suppressed", suppressed)
+			);
+		}
+	}
+
 	// Convert QString to std::string
 	std::string message = msg.toStdString();
 
@@ -61,10 +261,258 @@ void qtMessageHandler(
 } // namespace
 
 QtMessageHandler initLogging() {
+	s_categoryFilterInstalled.store(true);
+	updateCategoryFilter();
 	// Install our custom Qt message handler and return the previous one
 	// This must be called before QApplication is created to capture all
 	// messages
 	return qInstallMessageHandler(qtMessageHandler);
 }
 
+void setLogLevel(slog::Level level) {
+	slog::DefaultLogger().From(level);
+}
+
+std::shared_ptr<slog::Sink> setLogSink(std::shared_ptr<slog::Sink> sink) {
+	s_sink.store(sink);
+	auto previous = slog::DefaultLogger().SetSink(std::move(sink));
+	updateCategoryFilter();
+	return previous;
+}
+
+void setQtCategoryLevel(std::string prefix, slog::Level level) {
+	auto rules = std::make_shared<CategoryRules>();
+	if (auto current = s_categoryRules.load(); current != nullptr) {
+		*rules = *current;
+	}
+	std::erase_if(*rules, [&prefix](const CategoryRule &rule) {
+		return rule.Prefix == prefix;
+	});
+	rules->push_back({.Prefix = std::move(prefix), .Level = level});
+	s_categoryRules.store(std::move(rules));
+	s_hasCategoryRules.store(true);
+	updateCategoryFilter();
+}
+
+void clearQtCategoryLevels() {
+	s_hasCategoryRules.store(false);
+	s_categoryRules.store(nullptr);
+	updateCategoryFilter();
+}
+
+void setQtRateLimit(QtRateLimit limit) {
+	s_rateLimiter.configure(limit);
+}
+
+/// Single producer, single consumer ring of fixed size text slots. The
+/// producer is the thread owning the ring, the consumer is whoever holds
+/// AsyncSink::d_drainMutex.
+struct AsyncSink::Ring {
+	Ring(size_t capacity, size_t recordSize)
+	    : capacity{capacity}
+	    , recordSize{recordSize}
+	    , storage{new char[capacity * recordSize]}
+	    , lengths{new size_t[capacity]} {}
+
+	const size_t              capacity, recordSize;
+	std::unique_ptr<char[]>   storage;
+	std::unique_ptr<size_t[]> lengths;
+
+	alignas(64) std::atomic<size_t> head{0};
+	alignas(64) std::atomic<size_t> tail{0};
+	std::atomic<bool> abandoned{false};
+
+	bool push(const char *data, size_t size) noexcept {
+		auto h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) >= capacity) {
+			return false;
+		}
+		char *slot = &storage[(h % capacity) * recordSize];
+		size       = std::min(size, recordSize - 1);
+		std::memcpy(slot, data, size);
+		if (size == 0 || slot[size - 1] != '\n') {
+			slot[size++] = '\n';
+		}
+		lengths[h % capacity] = size;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	template <typename Function> size_t consume(Function &&function) {
+		auto t = tail.load(std::memory_order_relaxed);
+		auto h = head.load(std::memory_order_acquire);
+		for (auto i = t; i != h; ++i) {
+			function(std::string_view{
+			    &storage[(i % capacity) * recordSize],
+			    lengths[i % capacity]
+			});
+		}
+		tail.store(h, std::memory_order_release);
+		return h - t;
+	}
+};
+
+AsyncSink::Ptr AsyncSink::Create(Options options, Writer writer) {
+	if (writer == nullptr) {
+		writer = [](std::string_view text) {
+			std::fwrite(text.data(), 1, text.size(), stderr);
+		};
+	}
+	return Ptr{new AsyncSink{std::move(options), std::move(writer)}};
+}
+
+AsyncSink::AsyncSink(Options options, Writer writer)
+    : d_ID{[] {
+	    static std::atomic<uint64_t> lastID{0};
+	    return ++lastID;
+    }()}
+    , d_options{std::move(options)}
+    , d_writer{std::move(writer)} {
+	if (d_options.Capacity == 0 || d_options.RecordSize < 2) {
+		throw cpptrace::invalid_argument{"invalid AsyncSink ring dimensions"};
+	}
+	d_thread = std::thread{[this]() { run(); }};
+}
+
+AsyncSink::~AsyncSink() {
+	{
+		std::lock_guard lock{d_runMutex};
+		d_running = false;
+	}
+	d_wakeUp.notify_all();
+	d_thread.join();
+}
+
+bool AsyncSink::Enabled(slog::Level level) const noexcept {
+	return level >= d_options.Level;
+}
+
+bool AsyncSink::AllocateOnStack() const noexcept {
+	// records are formatted before Log() returns, they are never kept.
+	return true;
+}
+
+void AsyncSink::Log(RecordVariant &&record) {
+	const slog::Record *ptr = std::visit(
+	    [](const auto &r) -> const slog::Record * {
+		    if constexpr (std::is_pointer_v<std::decay_t<decltype(r)>>) {
+			    return r;
+		    } else {
+			    return r.get();
+		    }
+	    },
+	    record
+	);
+	if (ptr == nullptr) {
+		return;
+	}
+
+	// grows to the size of the largest record once, then is reused.
+	static thread_local slog::Buffer buffer;
+	buffer.clear();
+	slog::RecordToRawText(*ptr, buffer);
+
+	if (threadRing()->push(buffer.data(), buffer.size()) == false) {
+		d_dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+AsyncSink::Ring *AsyncSink::threadRing() {
+	struct Entry {
+		uint64_t              sinkID;
+		std::shared_ptr<Ring> ring;
+	};
+
+	struct ThreadRings {
+		std::vector<Entry> entries;
+
+		~ThreadRings() {
+			for (auto &e : entries) {
+				e.ring->abandoned.store(true, std::memory_order_release);
+			}
+		}
+	};
+
+	static thread_local ThreadRings rings;
+	for (const auto &e : rings.entries) {
+		if (e.sinkID == d_ID) {
+			return e.ring.get();
+		}
+	}
+
+	auto ring =
+	    std::make_shared<Ring>(d_options.Capacity, d_options.RecordSize);
+	{
+		std::lock_guard lock{d_ringsMutex};
+		d_rings.push_back(ring);
+	}
+	rings.entries.push_back({.sinkID = d_ID, .ring = ring});
+	return ring.get();
+}
+
+void AsyncSink::Flush() {
+	drain();
+}
+
+size_t AsyncSink::Dropped() const {
+	return d_dropped.load(std::memory_order_relaxed);
+}
+
+bool AsyncSink::drain() {
+	std::lock_guard drainLock{d_drainMutex};
+	{
+		std::lock_guard lock{d_ringsMutex};
+		d_draining = d_rings;
+	}
+
+	size_t written{0}, released{0};
+	for (auto &ring : d_draining) {
+		// must be read before consuming: once set, no more pushes will come.
+		bool abandoned = ring->abandoned.load(std::memory_order_acquire);
+		written += ring->consume(d_writer);
+		if (abandoned == true) {
+			++released;
+		}
+	}
+
+	if (released > 0) {
+		std::lock_guard lock{d_ringsMutex};
+		std::erase_if(d_rings, [](const std::shared_ptr<Ring> &ring) {
+			return ring->abandoned.load(std::memory_order_acquire) &&
+			       ring->head.load() == ring->tail.load();
+		});
+	}
+	d_draining.clear();
+
+	auto dropped = d_dropped.load(std::memory_order_relaxed);
+	if (dropped != d_reportedDropped) {
+		d_writer(
+		    "AsyncSink: dropped " +
+		    std::to_string(dropped - d_reportedDropped) +
+		    " log records (total: " + std::to_string(dropped) + ")\n"
+		);
+		d_reportedDropped = dropped;
+	}
+
+	return written > 0;
+}
+
+void AsyncSink::run() {
+	lowerCurrentThreadPriority();
+	for (;;) {
+		bool running;
+		{
+			std::unique_lock lock{d_runMutex};
+			d_wakeUp.wait_for(lock, d_options.FlushPeriod, [this]() {
+				return d_running == false;
+			});
+			running = d_running;
+		}
+		drain();
+		if (running == false) {
+			return;
+		}
+	}
+}
+
 } // namespace yams
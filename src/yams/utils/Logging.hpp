@@ -1,7 +1,21 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
 #include <qglobal.h>
 
+#include <slog++/slog++.hpp>
+
 namespace yams {
 
 /// Initialize logging infrastructure for YAMS
@@ -35,4 +49,115 @@ namespace yams {
 /// @endcode
 QtMessageHandler initLogging();
 
+/// Sets the minimal level of slog++'s default logger.
+void setLogLevel(slog::Level level);
+
+/// Installs sink on slog++'s default logger and returns the previous one.
+/// Qt messages the sink is not Enabled() for are dropped by the handler
+/// installed with initLogging() before their text is converted.
+std::shared_ptr<slog::Sink> setLogSink(std::shared_ptr<slog::Sink> sink);
+
+/// Sets the minimal level of Qt logging categories whose name starts with
+/// prefix, e.g. "qt.qpa" or "qt.opengl", which also matches "qt.qpa.xcb"
+/// but not "qt.qpadebug". The longest matching prefix wins, and the sink
+/// installed with setLogSink() still applies. Disabled levels are also
+/// disabled on the QLoggingCategory, so qCDebug() and friends do not format
+/// their message.
+void setQtCategoryLevel(std::string prefix, slog::Level level);
+
+/// Removes all rules set with setQtCategoryLevel().
+void clearQtCategoryLevels();
+
+struct QtRateLimit {
+	// Maximal number of identical Qt messages per window, 0 disables.
+	size_t                    Burst = 0;
+	std::chrono::milliseconds Window{1000};
+};
+
+/// Limits how many identical Qt messages (same level, category and text) are
+/// forwarded per window. The number of dropped copies is logged when the
+/// message comes back after the window elapsed.
+void setQtRateLimit(QtRateLimit limit);
+
+/// slog++ sink that never performs I/O in the logging thread.
+///
+/// Records are formatted in the calling thread into a ring buffer owned by
+/// that thread and preallocated on its first log call. A low priority writer
+/// thread drains all rings and hands the text to a Writer. When a ring is
+/// full the record is dropped and counted, the caller never blocks. The
+/// number of dropped records is reported by the writer thread itself.
+///
+/// It is meant for logging from GStreamer streaming threads, where a
+/// synchronous sink would directly delay frames.
+///
+/// Example usage:
+/// @code
+/// auto sink = yams::AsyncSink::Create({.Level = slog::Level::Debug});
+/// slog::DefaultLogger().SetSink(sink);
+/// // ...
+/// sink->Flush();
+/// @endcode
+class AsyncSink : public slog::Sink {
+public:
+	using Ptr    = std::shared_ptr<AsyncSink>;
+	using Writer = std::function<void(std::string_view)>;
+
+	struct Options {
+		// Minimal level accepted by the sink.
+		slog::Level Level = slog::Level::Info;
+		// Slots per producer thread.
+		size_t Capacity = 1024;
+		// Bytes per slot, longer records are truncated.
+		size_t RecordSize = 512;
+		// Writer thread wake-up period.
+		std::chrono::milliseconds FlushPeriod{10};
+	};
+
+	/// Creates a sink writing to stderr when no writer is given.
+	static Ptr Create(Options options, Writer writer = nullptr);
+
+	~AsyncSink();
+
+	AsyncSink(const AsyncSink &)            = delete;
+	AsyncSink(AsyncSink &&)                 = delete;
+	AsyncSink &operator=(const AsyncSink &) = delete;
+	AsyncSink &operator=(AsyncSink &&)      = delete;
+
+	bool Enabled(slog::Level level) const noexcept override;
+	bool AllocateOnStack() const noexcept override;
+	void Log(RecordVariant &&record) override;
+
+	/// Writes all records queued so far, blocks until done.
+	void Flush();
+
+	/// Total number of records dropped because a ring was full.
+	size_t Dropped() const;
+
+private:
+	struct Ring;
+
+	AsyncSink(Options options, Writer writer);
+
+	Ring *threadRing();
+	bool  drain();
+	void  run();
+
+	const uint64_t d_ID;
+	const Options  d_options;
+	const Writer   d_writer;
+
+	std::mutex                         d_ringsMutex;
+	std::vector<std::shared_ptr<Ring>> d_rings;
+
+	std::mutex                         d_drainMutex;
+	std::vector<std::shared_ptr<Ring>> d_draining;
+	std::atomic<size_t>                d_dropped{0};
+	size_t                             d_reportedDropped{0};
+
+	std::mutex              d_runMutex;
+	std::condition_variable d_wakeUp;
+	bool                    d_running{true};
+	std::thread             d_thread;
+};
+
 } // namespace yams
@@ -0,0 +1,103 @@
+#include <benchmark/benchmark.h>
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#include <qdebug.h>
+#include <qglobal.h>
+#include <slog++/MockSink.hpp>
+#include <slog++/slog++.hpp>
+
+#include <yams/utils/Logging.hpp>
+
+namespace yams {
+
+namespace {
+// Installs the Qt-to-slog bridge and a sink discarding every record for the
+// duration of a benchmark.
+class QtBridgeFixture : public benchmark::Fixture {
+public:
+	void SetUp(::benchmark::State &state) override {
+		using ::testing::_;
+		using ::testing::Return;
+
+		d_sink = std::make_shared<::testing::NiceMock<slog::MockSink>>();
+		ON_CALL(*d_sink, Enabled(_))
+		    .WillByDefault(Return(state.range(0) != 0));
+		ON_CALL(*d_sink, AllocateOnStack()).WillByDefault(Return(true));
+
+		d_originalSink    = setLogSink(d_sink);
+		d_originalHandler = initLogging();
+	}
+
+	void TearDown(::benchmark::State &state) override {
+		qInstallMessageHandler(d_originalHandler);
+		setLogSink(std::move(d_originalSink));
+		d_sink.reset();
+	}
+
+private:
+	std::shared_ptr<::testing::NiceMock<slog::MockSink>> d_sink;
+	std::shared_ptr<slog::Sink>                          d_originalSink;
+	QtMessageHandler                                     d_originalHandler;
+};
+} // namespace
+
+// range(0) selects whether the sink accepts records or drops them, in which
+// case the handler drops them before any text conversion.
+BENCHMARK_DEFINE_F(QtBridgeFixture, QDebug)(benchmark::State &state) {
+	for (auto _ : state) {
+		qDebug() << "benchmark message" << 42;
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_REGISTER_F(QtBridgeFixture, QDebug)->Arg(0)->Arg(1);
+
+BENCHMARK_DEFINE_F(QtBridgeFixture, QWarning)(benchmark::State &state) {
+	for (auto _ : state) {
+		qWarning("benchmark message %d", 42);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_REGISTER_F(QtBridgeFixture, QWarning)->Arg(0)->Arg(1);
+
+// Log call cost as seen by a streaming thread, with the writer thread
+// discarding the text. Reports the worst call latency observed per thread and
+// how many records the rings dropped.
+static void BM_AsyncSinkLog(benchmark::State &state) {
+	using clock = std::chrono::steady_clock;
+
+	static AsyncSink::Ptr              sink;
+	static std::shared_ptr<slog::Sink> originalSink;
+	if (state.thread_index() == 0) {
+		sink         = AsyncSink::Create({}, [](std::string_view) {});
+		originalSink = slog::DefaultLogger().SetSink(sink);
+	}
+
+	std::chrono::nanoseconds worst{0};
+	int64_t                  i{0};
+	for (auto _ : state) {
+		auto start = clock::now();
+		slog::Info("benchmark record", slog::Int("i", ++i));
+		worst = std::max(worst, clock::now() - start);
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.counters["worst_ns"] = benchmark::Counter(
+	    double(worst.count()),
+	    benchmark::Counter::kAvgThreads
+	);
+
+	if (state.thread_index() == 0) {
+		state.counters["dropped"] = double(sink->Dropped());
+		slog::DefaultLogger().SetSink(std::move(originalSink));
+		sink.reset();
+	}
+}
+
+BENCHMARK(BM_AsyncSinkLog)->ThreadRange(1, 4)->UseRealTime();
+
+} // namespace yams
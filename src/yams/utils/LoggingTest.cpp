@@ -2,8 +2,11 @@
 #include "gtest/gtest.h"
 #include <gmock/gmock.h>
 
+#include <chrono>
 #include <memory>
+#include <thread>
 
+#include <QLoggingCategory>
 #include <qdebug.h>
 #include <qglobal.h>
 #include <slog++/Formatters.hpp>
@@ -150,7 +153,7 @@ TEST_F(LoggingTest, QtLoggingIsHooked) {
 	    slog::Level::Debug,
 	    "debug is hooked",
 #ifndef NDEBUG
-	    slog::Int("line", 160),
+	    slog::Int("line", 163),
 #else
 	    slog::String("file", ""),
 	    slog::Int("line", 0),
@@ -163,7 +166,7 @@ TEST_F(LoggingTest, QtLoggingIsHooked) {
 	    slog::Level::Info,
 	    "info is hooked",
 #ifndef NDEBUG
-	    slog::Int("line", 173),
+	    slog::Int("line", 176),
 #else
 	    slog::String("file", ""),
 	    slog::Int("line", 0),
@@ -176,7 +179,7 @@ TEST_F(LoggingTest, QtLoggingIsHooked) {
 	    slog::Level::Warn,
 	    "warning is hooked",
 #ifndef NDEBUG
-	    slog::Int("line", 186),
+	    slog::Int("line", 189),
 #else
 	    slog::String("file", ""),
 	    slog::Int("line", 0),
@@ -189,7 +192,7 @@ TEST_F(LoggingTest, QtLoggingIsHooked) {
 	    slog::Level::Error,
 	    "critical is hooked",
 #ifndef NDEBUG
-	    slog::Int("line", 199),
+	    slog::Int("line", 202),
 #else
 	    slog::String("file", ""),
 	    slog::Int("line", 0),
@@ -203,4 +206,191 @@ TEST_F(LoggingTest, FatalLogging) {
 	// TODO: check that fatal is hooked, but it is too complex to handle.
 }
 
+TEST_F(LoggingTest, QtMessagesBelowSinkLevelAreDropped) {
+	using ::testing::_;
+	using ::testing::Ge;
+	using ::testing::Return;
+	// the handler asks the installed sink, and drops the message before
+	// any conversion when it is disabled.
+	auto sink = std::make_shared<::testing::NiceMock<slog::MockSink>>();
+	ON_CALL(*sink, Enabled(_)).WillByDefault(Return(false));
+	ON_CALL(*sink, Enabled(Ge(slog::Level::Info)))
+	    .WillByDefault(Return(true));
+	ON_CALL(*sink, AllocateOnStack()).WillByDefault(Return(true));
+	auto previous = setLogSink(sink);
+
+	EXPECT_CALL(
+	    *sink,
+	    Log(slog::HasMessage<const slog::Record *>("kept"))
+	);
+	qDebug() << "dropped before conversion";
+	qInfo() << "kept";
+
+	setLogSink(previous);
+}
+
+TEST_F(LoggingTest, QtCategoriesCanBeFiltered) {
+	setQtCategoryLevel("qt.qpa", slog::Level::Warn);
+	QLoggingCategory qpa{"qt.qpa.yamstest"};
+	QLoggingCategory other{"qt.opengl.yamstest"};
+
+	// disabled on the category itself, the message is never formatted.
+	EXPECT_FALSE(qpa.isInfoEnabled());
+	qCInfo(qpa) << "dropped by category";
+	// bypasses QLoggingCategory, dropped by the handler.
+	QMessageLogger{__FILE__, __LINE__, nullptr, "qt.qpa.yamstest"}.info(
+	    "dropped by handler"
+	);
+
+	ExpectLog(
+	    slog::Level::Warn,
+	    "kept",
+	    slog::String("qt_category", "qt.qpa.yamstest")
+	);
+	qCWarning(qpa) << "kept";
+
+	ExpectLog(
+	    slog::Level::Info,
+	    "other category",
+	    slog::String("qt_category", "qt.opengl.yamstest")
+	);
+	qCInfo(other) << "other category";
+
+	clearQtCategoryLevels();
+	EXPECT_TRUE(qpa.isInfoEnabled());
+}
+
+TEST_F(LoggingTest, QtCategoryRulesMatchWholeNames) {
+	setQtCategoryLevel("qt.qpa", slog::Level::Warn);
+	QLoggingCategory sub{"qt.qpa.yamstest"};
+	QLoggingCategory exact{"qt.qpa"};
+	QLoggingCategory longer{"qt.qpayamstest"};
+
+	EXPECT_FALSE(sub.isInfoEnabled());
+	EXPECT_FALSE(exact.isInfoEnabled());
+	EXPECT_TRUE(longer.isInfoEnabled());
+
+	clearQtCategoryLevels();
+}
+
+TEST_F(LoggingTest, QtRepeatedMessagesAreRateLimited) {
+	using namespace std::chrono_literals;
+	setQtRateLimit({.Burst = 2, .Window = 200ms});
+
+	for (int i = 0; i < 2; ++i) {
+		ExpectLog(
+		    slog::Level::Info,
+		    "repeated",
+		    slog::String("qt_category", "default")
+		);
+		qInfo() << "repeated";
+	}
+	// over the burst, no sink calls.
+	for (int i = 0; i < 3; ++i) {
+		qInfo() << "repeated";
+	}
+
+	std::this_thread::sleep_for(250ms);
+	ExpectLog(
+	    slog::Level::Warn,
+	    "suppressed repeated Qt messages",
+	    slog::String("qt_category", "default"),
+	    slog::Int("suppressed", 3)
+	);
+	ExpectLog(
+	    slog::Level::Info,
+	    "repeated",
+	    slog::String("qt_category", "default")
+	);
+	qInfo() << "repeated";
+
+	setQtRateLimit({});
+}
+
+class AsyncSinkTest : public ::testing::Test {
+protected:
+	std::shared_ptr<slog::Sink> d_originalSink;
+	std::mutex                  d_mutex;
+	std::vector<std::string>    d_written;
+
+	// The writer thread never wakes up by itself, only Flush() writes.
+	AsyncSink::Ptr install(size_t capacity) {
+		auto sink = AsyncSink::Create(
+		    {
+		        .Level       = slog::Level::Info,
+		        .Capacity    = capacity,
+		        .FlushPeriod = std::chrono::hours{1},
+		    },
+		    [this](std::string_view text) {
+			    std::lock_guard lock{d_mutex};
+			    d_written.emplace_back(text);
+		    }
+		);
+		d_originalSink = slog::DefaultLogger().SetSink(sink);
+		return sink;
+	}
+
+	std::vector<std::string> written() {
+		std::lock_guard lock{d_mutex};
+		return d_written;
+	}
+
+	void TearDown() override {
+		if (d_originalSink) {
+			slog::DefaultLogger().SetSink(std::move(d_originalSink));
+		}
+	}
+};
+
+TEST_F(AsyncSinkTest, WritesOnlyFromWriter) {
+	using ::testing::HasSubstr;
+	auto sink = install(16);
+
+	slog::Info("async record", slog::Int("answer", 42));
+	slog::Debug("below sink level");
+	EXPECT_TRUE(written().empty());
+
+	sink->Flush();
+	auto lines = written();
+	ASSERT_EQ(lines.size(), 1);
+	EXPECT_THAT(lines[0], HasSubstr("async record"));
+	EXPECT_EQ(lines[0].back(), '\n');
+	EXPECT_EQ(sink->Dropped(), 0);
+}
+
+TEST_F(AsyncSinkTest, DropsAndCountsWhenFull) {
+	using ::testing::HasSubstr;
+	auto sink = install(4);
+
+	for (int i = 0; i < 7; ++i) {
+		slog::Info("record", slog::Int("i", i));
+	}
+	EXPECT_EQ(sink->Dropped(), 3);
+
+	sink->Flush();
+	auto lines = written();
+	ASSERT_EQ(lines.size(), 5);
+	EXPECT_THAT(lines.back(), HasSubstr("dropped 3"));
+
+	// ring is free again
+	slog::Info("after flush");
+	EXPECT_EQ(sink->Dropped(), 3);
+}
+
+TEST_F(AsyncSinkTest, DrainsExitedThreads) {
+	using ::testing::HasSubstr;
+	auto sink = install(4);
+
+	std::thread producer{[]() {
+		slog::Info("from streaming thread");
+		slog::Info("from streaming thread");
+	}};
+	producer.join();
+
+	sink->Flush();
+	auto lines = written();
+	ASSERT_EQ(lines.size(), 2);
+	EXPECT_THAT(lines[1], HasSubstr("from streaming thread"));
+}
+
 } // namespace yams
@@ -0,0 +1,231 @@
+#include "Metrics.hpp"
+
+#include <bit>
+#include <cmath>
+#include <sstream>
+
+#include <cpptrace/exceptions.hpp>
+
+namespace yams {
+namespace metrics {
+
+namespace {
+std::string escape(const std::string &value) {
+	std::string res;
+	res.reserve(value.size());
+	for (char c : value) {
+		switch (c) {
+		case '\\':
+			res += "\\\\";
+			break;
+		case '"':
+			res += "\\\"";
+			break;
+		case '\n':
+			res += "\\n";
+			break;
+		default:
+			res += c;
+		}
+	}
+	return res;
+}
+
+std::string formatLabels(const Labels &labels) {
+	std::string res;
+	for (const auto &[key, value] : labels) {
+		if (res.empty() == false) {
+			res += ',';
+		}
+		res += key + "=\"" + escape(value) + "\"";
+	}
+	return res;
+}
+
+void writeSample(
+    std::ostream      &out,
+    const std::string &name,
+    const std::string &labels,
+    const std::string &extra = ""
+) {
+	out << name;
+	if (labels.empty() == false || extra.empty() == false) {
+		out << '{' << labels;
+		if (labels.empty() == false && extra.empty() == false) {
+			out << ',';
+		}
+		out << extra << '}';
+	}
+	out << ' ';
+}
+
+double seconds(std::chrono::nanoseconds value) {
+	return std::chrono::duration<double>(value).count();
+}
+} // namespace
+
+void Counter::write(
+    std::ostream &out, const std::string &name, const std::string &labels
+) const {
+	writeSample(out, name, labels);
+	out << value() << '\n';
+}
+
+void Gauge::write(
+    std::ostream &out, const std::string &name, const std::string &labels
+) const {
+	writeSample(out, name, labels);
+	out << value() << '\n';
+}
+
+size_t Histogram::BucketIndex(uint64_t value) noexcept {
+	if (value < SubBuckets) {
+		return value;
+	}
+	size_t exponent = std::bit_width(value) - 1;
+	size_t shift    = exponent - SubBucketBits;
+	size_t sub      = (value >> shift) & (SubBuckets - 1);
+	return SubBuckets + shift * SubBuckets + sub;
+}
+
+uint64_t Histogram::BucketUpperBound(size_t index) noexcept {
+	if (index < SubBuckets) {
+		return index;
+	}
+	size_t shift = (index - SubBuckets) / SubBuckets;
+	size_t sub   = (index - SubBuckets) % SubBuckets;
+	// last value of the bucket, without overflowing on the last one.
+	return ((SubBuckets + sub) << shift) + ((uint64_t(1) << shift) - 1);
+}
+
+void Histogram::record(std::chrono::nanoseconds value) noexcept {
+	uint64_t ns = std::max<int64_t>(value.count(), 0);
+	d_buckets[BucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+	d_sum.fetch_add(ns, std::memory_order_relaxed);
+	d_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::count() const noexcept {
+	return d_count.load(std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds Histogram::sum() const noexcept {
+	return std::chrono::nanoseconds{d_sum.load(std::memory_order_relaxed)};
+}
+
+std::chrono::nanoseconds Histogram::quantile(double q) const noexcept {
+	// buckets are read one by one, the count is taken from them so the
+	// result stays consistent with concurrent updates.
+	std::array<uint64_t, Buckets> counts;
+	uint64_t                      total = 0;
+	for (size_t i = 0; i < Buckets; ++i) {
+		counts[i]  = d_buckets[i].load(std::memory_order_relaxed);
+		total     += counts[i];
+	}
+	if (total == 0) {
+		return std::chrono::nanoseconds{0};
+	}
+	uint64_t rank = std::max<uint64_t>(std::ceil(q * total), 1);
+	uint64_t seen = 0;
+	for (size_t i = 0; i < Buckets; ++i) {
+		seen += counts[i];
+		if (seen >= rank) {
+			return std::chrono::nanoseconds{BucketUpperBound(i)};
+		}
+	}
+	return std::chrono::nanoseconds{BucketUpperBound(Buckets - 1)};
+}
+
+void Histogram::write(
+    std::ostream &out, const std::string &name, const std::string &labels
+) const {
+	constexpr static std::pair<double, const char *> quantiles[] = {
+	    {0.5, "0.5"},
+	    {0.9, "0.9"},
+	    {0.99, "0.99"},
+	    {0.999, "0.999"},
+	};
+	for (const auto &[q, label] : quantiles) {
+		writeSample(
+		    out,
+		    name,
+		    labels,
+		    std::string{"quantile=\""} + label + "\""
+		);
+		out << seconds(quantile(q)) << '\n';
+	}
+	writeSample(out, name + "_sum", labels);
+	out << seconds(sum()) << '\n';
+	writeSample(out, name + "_count", labels);
+	out << count() << '\n';
+}
+
+Registry &Registry::Global() {
+	static Registry registry;
+	return registry;
+}
+
+template <typename T>
+T &Registry::get(
+    Type               type,
+    const std::string &name,
+    const std::string &help,
+    const Labels      &labels
+) {
+	std::lock_guard lock{d_mutex};
+	auto [it, inserted] =
+	    d_families.try_emplace(name, Family{type, help, {}});
+	auto &family = it->second;
+	if (family.type != type) {
+		throw cpptrace::invalid_argument{
+		    "metric '" + name + "' is already registered with another type"
+		};
+	}
+	auto &metric = family.series[formatLabels(labels)];
+	if (metric == nullptr) {
+		metric = std::make_unique<T>();
+	}
+	return static_cast<T &>(*metric);
+}
+
+Counter &Registry::counter(
+    const std::string &name, const std::string &help, const Labels &labels
+) {
+	return get<Counter>(Type::COUNTER, name, help, labels);
+}
+
+Gauge &Registry::gauge(
+    const std::string &name, const std::string &help, const Labels &labels
+) {
+	return get<Gauge>(Type::GAUGE, name, help, labels);
+}
+
+Histogram &Registry::histogram(
+    const std::string &name, const std::string &help, const Labels &labels
+) {
+	return get<Histogram>(Type::SUMMARY, name, help, labels);
+}
+
+void Registry::writePrometheus(std::ostream &out) const {
+	static const char *typeNames[] = {"counter", "gauge", "summary"};
+
+	std::lock_guard lock{d_mutex};
+	out.precision(9);
+	for (const auto &[name, family] : d_families) {
+		out << "# HELP " << name << ' ' << family.help << '\n'
+		    << "# TYPE " << name << ' ' << typeNames[size_t(family.type)]
+		    << '\n';
+		for (const auto &[labels, metric] : family.series) {
+			metric->write(out, name, labels);
+		}
+	}
+}
+
+std::string Registry::prometheusText() const {
+	std::ostringstream out;
+	writePrometheus(out);
+	return out.str();
+}
+
+} // namespace metrics
+} // namespace yams
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace yams {
+namespace metrics {
+
+using Labels = std::vector<std::pair<std::string, std::string>>;
+
+class Metric {
+public:
+	virtual ~Metric() = default;
+
+	virtual void write(
+	    std::ostream &out, const std::string &name, const std::string &labels
+	) const = 0;
+};
+
+/// Monotonic counter. Updates are a single relaxed atomic add.
+class Counter : public Metric {
+public:
+	inline void inc(uint64_t value = 1) noexcept {
+		d_value.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	inline uint64_t value() const noexcept {
+		return d_value.load(std::memory_order_relaxed);
+	}
+
+	void write(
+	    std::ostream &out, const std::string &name, const std::string &labels
+	) const override;
+
+private:
+	std::atomic<uint64_t> d_value{0};
+};
+
+/// Value that can go up and down.
+class Gauge : public Metric {
+public:
+	inline void set(double value) noexcept {
+		d_value.store(value, std::memory_order_relaxed);
+	}
+
+	inline void add(double value) noexcept {
+		d_value.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	inline double value() const noexcept {
+		return d_value.load(std::memory_order_relaxed);
+	}
+
+	void write(
+	    std::ostream &out, const std::string &name, const std::string &labels
+	) const override;
+
+private:
+	std::atomic<double> d_value{0.0};
+};
+
+/// Duration histogram with log-linear buckets, in the spirit of
+/// HdrHistogram: each power of two is split in 8 linear buckets, so any
+/// quantile is known within 12.5% from 1ns to centuries, with a fixed
+/// footprint and lock-free updates. It is exported as a Prometheus summary,
+/// in seconds.
+class Histogram : public Metric {
+public:
+	constexpr static size_t SubBucketBits = 3;
+	constexpr static size_t SubBuckets    = 1 << SubBucketBits;
+	constexpr static size_t Buckets = SubBuckets * (64 - SubBucketBits + 1);
+
+	void record(std::chrono::nanoseconds value) noexcept;
+
+	uint64_t count() const noexcept;
+
+	std::chrono::nanoseconds sum() const noexcept;
+
+	/// Upper bound of the bucket holding the q-quantile, q in [0,1].
+	std::chrono::nanoseconds quantile(double q) const noexcept;
+
+	void write(
+	    std::ostream &out, const std::string &name, const std::string &labels
+	) const override;
+
+	static size_t   BucketIndex(uint64_t value) noexcept;
+	static uint64_t BucketUpperBound(size_t index) noexcept;
+
+private:
+	std::array<std::atomic<uint64_t>, Buckets> d_buckets{};
+	std::atomic<uint64_t>                      d_count{0}, d_sum{0};
+};
+
+/// Process wide set of metrics, exported in the Prometheus text format.
+///
+/// Metrics are registered once, typically in constructors, and the returned
+/// references are kept for the hot path. Registering the same name and
+/// labels twice returns the same metric.
+///
+/// Example usage:
+/// @code
+/// auto &dropped = metrics::Registry::Global().counter(
+///     "yams_output_dropped_frames_total",
+///     "Frames replaced before being painted."
+/// );
+/// dropped.inc();
+/// @endcode
+class Registry {
+public:
+	static Registry &Global();
+
+	Registry()  = default;
+	~Registry() = default;
+
+	Registry(const Registry &)            = delete;
+	Registry(Registry &&)                 = delete;
+	Registry &operator=(const Registry &) = delete;
+	Registry &operator=(Registry &&)      = delete;
+
+	/// @throws cpptrace::invalid_argument if name is already registered
+	/// with another type.
+	Counter &counter(
+	    const std::string &name,
+	    const std::string &help,
+	    const Labels      &labels = {}
+	);
+
+	/// @throws cpptrace::invalid_argument if name is already registered
+	/// with another type.
+	Gauge &gauge(
+	    const std::string &name,
+	    const std::string &help,
+	    const Labels      &labels = {}
+	);
+
+	/// @throws cpptrace::invalid_argument if name is already registered
+	/// with another type.
+	Histogram &histogram(
+	    const std::string &name,
+	    const std::string &help,
+	    const Labels      &labels = {}
+	);
+
+	void writePrometheus(std::ostream &out) const;
+
+	std::string prometheusText() const;
+
+private:
+	enum class Type {
+		COUNTER,
+		GAUGE,
+		SUMMARY,
+	};
+
+	struct Family {
+		Type                                           type;
+		std::string                                    help;
+		std::map<std::string, std::unique_ptr<Metric>> series;
+	};
+
+	template <typename T>
+	T &get(
+	    Type               type,
+	    const std::string &name,
+	    const std::string &help,
+	    const Labels      &labels
+	);
+
+	mutable std::mutex            d_mutex;
+	std::map<std::string, Family> d_families;
+};
+
+} // namespace metrics
+} // namespace yams
@@ -0,0 +1,102 @@
+#include "MetricsServer.hpp"
+
+#include <cstdlib>
+
+#include <QTcpSocket>
+
+#include <slog++/slog++.hpp>
+
+namespace yams {
+namespace metrics {
+
+Server::Server(Registry &registry, QObject *parent)
+    : QObject{parent}
+    , d_registry{registry} {
+	connect(
+	    &d_server,
+	    &QTcpServer::newConnection,
+	    this,
+	    &Server::onNewConnection
+	);
+}
+
+Server::~Server() = default;
+
+bool Server::listen(quint16 port) {
+	if (d_server.listen(QHostAddress::LocalHost, port) == false) {
+		slog::Error(
+		    "could not listen for metrics",
+		    slog::Int("port", port),
+		    slog::String("error", d_server.errorString().toStdString())
+		);
+		return false;
+	}
+	slog::Info(
+	    "serving metrics",
+	    slog::String(
+	        "url",
+	        "http://127.0.0.1:" + std::to_string(d_server.serverPort()) +
+	            "/metrics"
+	    )
+	);
+	return true;
+}
+
+quint16 Server::port() const {
+	return d_server.serverPort();
+}
+
+std::unique_ptr<Server> Server::FromEnvironment(Registry &registry) {
+	auto value = std::getenv("YAMS_METRICS_PORT");
+	if (value == nullptr || value[0] == '\0') {
+		return nullptr;
+	}
+	auto server = std::make_unique<Server>(registry);
+	if (server->listen(std::atoi(value)) == false) {
+		return nullptr;
+	}
+	return server;
+}
+
+void Server::onNewConnection() {
+	while (auto socket = d_server.nextPendingConnection()) {
+		connect(
+		    socket,
+		    &QTcpSocket::disconnected,
+		    socket,
+		    &QObject::deleteLater
+		);
+		connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+			// a scrape is a single small GET, wait for the whole header.
+			if (socket->bytesAvailable() > 8192) {
+				socket->abort();
+				return;
+			}
+			if (socket->peek(8192).contains("\r\n\r\n") == false) {
+				return;
+			}
+			auto request = socket->readAll();
+
+			QByteArray status = "404 Not Found", body = "not found\n";
+			if (request.startsWith("GET /metrics ") ||
+			    request.startsWith("GET /metrics?")) {
+				status = "200 OK";
+				body   = QByteArray::fromStdString(d_registry.prometheusText());
+			}
+			socket->write(
+			    "HTTP/1.1 " + status +
+			    "\r\n"
+			    "Content-Type: text/plain; version=0.0.4\r\n"
+			    "Content-Length: " +
+			    QByteArray::number(body.size()) +
+			    "\r\n"
+			    "Connection: close\r\n\r\n" +
+			    body
+			);
+			socket->disconnectFromHost();
+		});
+	}
+}
+
+} // namespace metrics
+} // namespace yams
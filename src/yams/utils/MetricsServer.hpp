@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+
+#include <QObject>
+#include <QTcpServer>
+
+#include "Metrics.hpp"
+
+namespace yams {
+namespace metrics {
+
+/// Minimal HTTP endpoint serving a Registry on GET /metrics, in the
+/// Prometheus text format. It only listens on the loopback interface and
+/// runs in the thread of its QObject.
+class Server : public QObject {
+	Q_OBJECT
+public:
+	Server(Registry &registry, QObject *parent = nullptr);
+	virtual ~Server();
+
+	/// Starts listening on 127.0.0.1:port, 0 picks a free port. Returns
+	/// false on failure.
+	bool listen(quint16 port);
+
+	quint16 port() const;
+
+	/// Listens on the port given by the YAMS_METRICS_PORT environment
+	/// variable, if set.
+	static std::unique_ptr<Server> FromEnvironment(Registry &registry);
+
+private slots:
+	void onNewConnection();
+
+private:
+	Registry  &d_registry;
+	QTcpServer d_server;
+};
+
+} // namespace metrics
+} // namespace yams
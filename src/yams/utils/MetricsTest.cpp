@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <thread>
+
+#include <cpptrace/exceptions.hpp>
+
+#include "Metrics.hpp"
+
+namespace yams {
+namespace metrics {
+
+TEST(MetricsTest, CountersAndGauges) {
+	Registry registry;
+	auto    &counter = registry.counter("frames_total", "Frames.");
+	counter.inc();
+	counter.inc(2);
+	EXPECT_EQ(counter.value(), 3);
+	EXPECT_EQ(&registry.counter("frames_total", "Frames."), &counter);
+
+	auto &gauge = registry.gauge("pool", "Pool size.");
+	gauge.set(4.0);
+	gauge.add(-1.5);
+	EXPECT_DOUBLE_EQ(gauge.value(), 2.5);
+
+	EXPECT_THROW(
+	    { registry.gauge("frames_total", "Frames."); },
+	    cpptrace::invalid_argument
+	);
+}
+
+TEST(MetricsTest, HistogramBuckets) {
+	for (uint64_t value :
+	     {0ul, 1ul, 7ul, 8ul, 9ul, 15ul, 16ul, 1000ul, 16666667ul, ~0ul}) {
+		auto index = Histogram::BucketIndex(value);
+		ASSERT_LT(index, Histogram::Buckets) << "value: " << value;
+		EXPECT_GE(Histogram::BucketUpperBound(index), value);
+		if (index > 0) {
+			EXPECT_LT(Histogram::BucketUpperBound(index - 1), value);
+		}
+	}
+}
+
+TEST(MetricsTest, HistogramQuantiles) {
+	using namespace std::chrono_literals;
+	Histogram histogram;
+	EXPECT_EQ(histogram.quantile(0.5), 0ns);
+
+	std::mt19937                            rng{42};
+	std::uniform_int_distribution<uint64_t> values{1, 100000};
+	std::vector<uint64_t>                   samples;
+	for (int i = 0; i < 10000; ++i) {
+		samples.push_back(values(rng));
+		histogram.record(std::chrono::nanoseconds{samples.back()});
+	}
+	std::sort(samples.begin(), samples.end());
+	EXPECT_EQ(histogram.count(), samples.size());
+
+	for (double q : {0.5, 0.9, 0.99, 0.999}) {
+		double expected = samples[std::ceil(q * samples.size()) - 1];
+		double actual   = histogram.quantile(q).count();
+		EXPECT_GE(actual, expected) << "q: " << q;
+		EXPECT_LE(actual, expected * 1.125) << "q: " << q;
+	}
+}
+
+TEST(MetricsTest, PrometheusTextFormat) {
+	using namespace std::chrono_literals;
+	Registry registry;
+	registry.counter("errors_total", "Errors.", {{"layer", "1"}}).inc();
+	registry.counter("errors_total", "Errors.", {{"layer", "\"2\""}}).inc(2);
+	registry.histogram("latency_seconds", "Latency.").record(1ms);
+
+	auto text = registry.prometheusText();
+	EXPECT_NE(text.find("# HELP errors_total Errors.\n"), std::string::npos);
+	EXPECT_NE(text.find("# TYPE errors_total counter\n"), std::string::npos);
+	EXPECT_NE(text.find("errors_total{layer=\"1\"} 1\n"), std::string::npos);
+	EXPECT_NE(
+	    text.find("errors_total{layer=\"\\\"2\\\"\"} 2\n"),
+	    std::string::npos
+	);
+	EXPECT_NE(
+	    text.find("# TYPE latency_seconds summary\n"),
+	    std::string::npos
+	);
+	EXPECT_NE(
+	    text.find("latency_seconds{quantile=\"0.99\"} 0.001"),
+	    std::string::npos
+	);
+	EXPECT_NE(text.find("latency_seconds_sum 0.001\n"), std::string::npos);
+	EXPECT_NE(text.find("latency_seconds_count 1\n"), std::string::npos);
+}
+
+TEST(MetricsTest, ConcurrentUpdates) {
+	using namespace std::chrono_literals;
+	Registry registry;
+	auto    &counter   = registry.counter("total", "Total.");
+	auto    &histogram = registry.histogram("duration", "Duration.");
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < 4; ++i) {
+		threads.emplace_back([&]() {
+			for (int j = 0; j < 10000; ++j) {
+				counter.inc();
+				histogram.record(1us);
+			}
+		});
+	}
+	for (auto &t : threads) {
+		t.join();
+	}
+	EXPECT_EQ(counter.value(), 40000);
+	EXPECT_EQ(histogram.count(), 40000);
+	EXPECT_EQ(histogram.sum(), 40ms);
+}
+
+} // namespace metrics
+} // namespace yams
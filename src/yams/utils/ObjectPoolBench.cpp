@@ -0,0 +1,45 @@
+#include "ObjectPool.hpp"
+#include <benchmark/benchmark.h>
+
+namespace yams {
+
+namespace {
+// roughly the footprint of a yams::Frame
+struct Payload {
+	char data[64];
+};
+
+using Pool = ObjectPool<Payload>;
+
+Pool::Ptr &sharedPool() {
+	static Pool::Ptr pool = Pool::Create();
+	return pool;
+}
+} // namespace
+
+static void BM_ObjectPoolGetRelease(benchmark::State &state) {
+	auto &pool = sharedPool();
+	for (auto _ : state) {
+		auto obj = pool->Get();
+		benchmark::DoNotOptimize(obj.get());
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.counters["allocated"] = pool->PoolSize();
+}
+
+BENCHMARK(BM_ObjectPoolGetRelease)->ThreadRange(1, 8)->UseRealTime();
+
+// Same as Compositor::onNewSampleCb, which installs a release hook.
+static void BM_ObjectPoolGetReleaseWithHook(benchmark::State &state) {
+	auto &pool = sharedPool();
+	for (auto _ : state) {
+		auto obj = pool->Get([](Payload *p) { p->data[0] = 0; });
+		benchmark::DoNotOptimize(obj.get());
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.counters["allocated"] = pool->PoolSize();
+}
+
+BENCHMARK(BM_ObjectPoolGetReleaseWithHook)->ThreadRange(1, 8)->UseRealTime();
+
+} // namespace yams
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace yams {
+
+/// Value published by a single writer and read lock-free from any thread.
+///
+/// The writer makes the sequence odd while it stores the value, readers
+/// retry until they copied it under the same even sequence. The value is
+/// kept in relaxed atomic words, so a torn copy is discarded rather than
+/// being a data race. Readers never block the writer.
+template <typename T> class SeqLock {
+	static_assert(
+	    std::is_trivially_copyable_v<T>,
+	    "T must be trivially copyable"
+	);
+
+public:
+	SeqLock(const T &value = T{}) noexcept {
+		store(value);
+	}
+
+	/// Must only be called from one thread at a time.
+	void store(const T &value) noexcept {
+		Words words{};
+		std::memcpy(words.data(), &value, sizeof(T));
+
+		auto seq = d_seq.load(std::memory_order_relaxed);
+		d_seq.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < Size; ++i) {
+			d_words[i].store(words[i], std::memory_order_relaxed);
+		}
+		d_seq.store(seq + 2, std::memory_order_release);
+	}
+
+	T load() const noexcept {
+		Words words;
+		while (true) {
+			auto before = d_seq.load(std::memory_order_acquire);
+			if (before & 1) {
+				continue;
+			}
+			for (size_t i = 0; i < Size; ++i) {
+				words[i] = d_words[i].load(std::memory_order_relaxed);
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (d_seq.load(std::memory_order_relaxed) == before) {
+				break;
+			}
+		}
+		T res;
+		std::memcpy(&res, words.data(), sizeof(T));
+		return res;
+	}
+
+private:
+	constexpr static size_t Size =
+	    (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	using Words = std::array<uint64_t, Size>;
+
+	std::atomic<uint64_t>                   d_seq{0};
+	std::array<std::atomic<uint64_t>, Size> d_words{};
+};
+
+} // namespace yams
@@ -0,0 +1,60 @@
+#include "SeqLock.hpp"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+namespace yams {
+class SeqLockTest : public ::testing::Test {};
+
+struct Sample {
+	uint64_t A, B, C;
+	uint32_t D;
+};
+
+TEST_F(SeqLockTest, StoresAndLoads) {
+	SeqLock<Sample> lock{{1, 2, 3, 4}};
+	auto            value = lock.load();
+	EXPECT_EQ(value.A, 1);
+	EXPECT_EQ(value.D, 4);
+
+	lock.store({5, 6, 7, 8});
+	value = lock.load();
+	EXPECT_EQ(value.A, 5);
+	EXPECT_EQ(value.B, 6);
+	EXPECT_EQ(value.C, 7);
+	EXPECT_EQ(value.D, 8);
+}
+
+TEST_F(SeqLockTest, ReadersNeverSeeTornValues) {
+	SeqLock<Sample>   lock;
+	std::atomic<bool> done{false};
+
+	std::thread writer{[&]() {
+		for (uint64_t i = 1; i <= 200000; ++i) {
+			lock.store({i, 2 * i, 3 * i, uint32_t(i)});
+		}
+		done.store(true);
+	}};
+
+	uint64_t last{0};
+	size_t   torn{0}, backward{0};
+	while (done.load() == false) {
+		auto value = lock.load();
+		if (value.B != 2 * value.A || value.C != 3 * value.A ||
+		    value.D != uint32_t(value.A)) {
+			++torn;
+		}
+		if (value.A < last) {
+			++backward;
+		}
+		last = value.A;
+	}
+	writer.join();
+
+	EXPECT_EQ(torn, 0);
+	EXPECT_EQ(backward, 0);
+	EXPECT_EQ(lock.load().A, 200000);
+}
+
+} // namespace yams
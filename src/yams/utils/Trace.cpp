@@ -0,0 +1,348 @@
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
+#include <cpptrace/exceptions.hpp>
+
+#include <slog++/slog++.hpp>
+
+namespace yams {
+namespace trace {
+
+namespace {
+struct Event {
+	// index + 1 of the event once fully written, 0 while being written.
+	std::atomic<uint64_t> sequence{0};
+	int64_t               begin;
+	int64_t               duration;
+	int64_t               PTS;
+	int64_t               runningTime;
+	uint32_t              thread;
+	int16_t               layer;
+	Stage                 stage;
+};
+
+struct ThreadName {
+	uint32_t    ID;
+	std::string name;
+};
+
+std::atomic<bool>     s_enabled{false};
+Options               s_options;
+std::vector<Event>    s_events;
+std::atomic<uint64_t> s_next{0};
+
+std::mutex              s_threadsMutex;
+std::vector<ThreadName> s_threads;
+std::atomic<uint32_t>   s_nextThreadID{1};
+
+const auto s_epoch = std::chrono::steady_clock::now();
+
+uint32_t registerThread() noexcept {
+	uint32_t    ID   = s_nextThreadID.fetch_add(1);
+	std::string name = "thread " + std::to_string(ID);
+#if defined(__linux__)
+	char buffer[16];
+	if (pthread_getname_np(pthread_self(), buffer, sizeof(buffer)) == 0 &&
+	    buffer[0] != '\0') {
+		name = std::string{buffer} + " (" + std::to_string(ID) + ")";
+	}
+#endif
+	try {
+		std::lock_guard lock{s_threadsMutex};
+		s_threads.push_back({.ID = ID, .name = std::move(name)});
+	} catch (...) {
+		// the thread is simply left unnamed.
+	}
+	return ID;
+}
+
+uint32_t threadID() noexcept {
+	thread_local uint32_t ID = registerThread();
+	return ID;
+}
+
+const char *categoryName(Stage stage) {
+	switch (stage) {
+	case Stage::DecodeOut:
+	case Stage::ProxyPush:
+		return "input";
+	case Stage::MixerAggregate:
+	case Stage::SampleOut:
+	case Stage::Handoff:
+		return "compositor";
+	default:
+		return "output";
+	}
+}
+
+void writeEscaped(std::ostream &out, const std::string &str) {
+	for (char c : str) {
+		if (c == '"' || c == '\\') {
+			out << '\\';
+		}
+		if (static_cast<unsigned char>(c) < 0x20) {
+			continue;
+		}
+		out << c;
+	}
+}
+
+// Chrome traces use microseconds, we keep the nanosecond resolution.
+void writeMicroseconds(std::ostream &out, int64_t ns) {
+	out << ns / 1000 << '.' << std::setw(3) << std::setfill('0') << ns % 1000;
+}
+} // namespace
+
+const char *stageName(Stage stage) {
+	switch (stage) {
+	case Stage::DecodeOut:
+		return "decode-out";
+	case Stage::ProxyPush:
+		return "proxysrc-push";
+	case Stage::MixerAggregate:
+		return "mixer-aggregate";
+	case Stage::SampleOut:
+		return "appsink-sample";
+	case Stage::Handoff:
+		return "frame-handoff";
+	case Stage::Paint:
+		return "paint";
+	case Stage::GLSyncWait:
+		return "gl-sync-wait";
+	case Stage::Swap:
+		return "swap";
+	}
+	return "unknown";
+}
+
+void start(Options options) {
+	if (options.Capacity == 0) {
+		throw cpptrace::invalid_argument{"trace capacity must not be 0"};
+	}
+	s_enabled.store(false);
+	s_events = std::vector<Event>(options.Capacity);
+	s_next.store(0);
+	s_options = std::move(options);
+	s_enabled.store(true);
+}
+
+void stop() {
+	if (s_enabled.exchange(false) == false || s_options.Path.empty()) {
+		return;
+	}
+	std::ofstream out{s_options.Path};
+	if (out.is_open() == false) {
+		slog::Error(
+		    "could not open frame trace file",
+		    slog::String("path", s_options.Path)
+		);
+		return;
+	}
+	writeChromeTrace(out);
+	slog::Info(
+	    "frame trace written",
+	    slog::String("path", s_options.Path),
+	    slog::Int("events", std::min<size_t>(s_next.load(), s_events.size()))
+	);
+}
+
+bool startFromEnvironment() {
+	auto path = std::getenv("YAMS_TRACE");
+	if (path == nullptr || path[0] == '\0') {
+		return false;
+	}
+	start({.Path = path});
+	slog::Info(
+	    "recording frame trace",
+	    slog::String("path", path),
+	    slog::Int("capacity", s_options.Capacity)
+	);
+	return true;
+}
+
+bool enabled() noexcept {
+	return s_enabled.load(std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds now() noexcept {
+	return std::chrono::steady_clock::now() - s_epoch;
+}
+
+void record(
+    Stage                    stage,
+    std::chrono::nanoseconds begin,
+    std::chrono::nanoseconds duration,
+    int                      layer,
+    int64_t                  pts,
+    int64_t                  runningTime
+) noexcept {
+	if (enabled() == false) {
+		return;
+	}
+	auto  index = s_next.fetch_add(1, std::memory_order_relaxed);
+	auto &event = s_events[index % s_events.size()];
+	event.sequence.store(0, std::memory_order_relaxed);
+	event.begin    = begin.count();
+	event.duration = duration.count();
+	event.PTS         = pts;
+	event.runningTime = runningTime;
+	event.thread      = threadID();
+	event.layer       = layer;
+	event.stage       = stage;
+	event.sequence.store(index + 1, std::memory_order_release);
+}
+
+void writeChromeTrace(std::ostream &out) {
+	uint64_t last  = s_next.load();
+	uint64_t first = last - std::min<uint64_t>(last, s_events.size());
+
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool comma = false;
+	{
+		std::lock_guard lock{s_threadsMutex};
+		for (const auto &thread : s_threads) {
+			out << (comma ? ",\n" : "\n")
+			    << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+			    << "\"tid\":" << thread.ID << ",\"args\":{\"name\":\"";
+			writeEscaped(out, thread.name);
+			out << "\"}}";
+			comma = true;
+		}
+	}
+
+	for (uint64_t i = first; i < last; ++i) {
+		const auto &event = s_events[i % s_events.size()];
+		if (event.sequence.load(std::memory_order_acquire) != i + 1) {
+			// overwritten or still being written.
+			continue;
+		}
+		out << (comma ? ",\n" : "\n") << "{\"name\":\""
+		    << stageName(event.stage) << "\",\"cat\":\""
+		    << categoryName(event.stage) << "\",\"pid\":1,\"tid\":"
+		    << event.thread << ",\"ts\":";
+		writeMicroseconds(out, event.begin);
+		if (event.duration > 0) {
+			out << ",\"ph\":\"X\",\"dur\":";
+			writeMicroseconds(out, event.duration);
+		} else {
+			out << ",\"ph\":\"i\",\"s\":\"t\"";
+		}
+		out << ",\"args\":{\"layer\":" << event.layer
+		    << ",\"pts\":" << event.PTS;
+		if (event.runningTime >= 0) {
+			out << ",\"running_time\":" << event.runningTime;
+		}
+		out << "}}";
+		comma = true;
+	}
+	out << "\n]}\n";
+}
+
+std::vector<StageLatency> stageLatencies(
+    std::chrono::nanoseconds since, std::chrono::nanoseconds until
+) {
+	struct Accumulator {
+		StageLatency latency;
+		int64_t      sum = 0;
+
+		void add(int64_t from, int64_t to) {
+			sum += to - from;
+			++latency.Samples;
+			latency.Max =
+			    std::max(latency.Max, std::chrono::nanoseconds{to - from});
+		}
+	};
+
+	std::vector<Accumulator> res = {
+	    {.latency = {.From = Stage::DecodeOut, .To = Stage::ProxyPush}},
+	    {.latency = {.From = Stage::ProxyPush, .To = Stage::MixerAggregate}},
+	    {.latency = {.From = Stage::MixerAggregate, .To = Stage::SampleOut}},
+	};
+
+	auto add = [&](Accumulator &acc, int64_t from, int64_t to) {
+		if (to >= from && to >= since.count() && to < until.count()) {
+			acc.add(from, to);
+		}
+	};
+
+	// begin of the events, by (layer, PTS) or by output PTS.
+	std::map<std::pair<int, int64_t>, int64_t> decoded;
+	std::vector<std::pair<int64_t, int64_t>>   pushed;
+	std::map<int64_t, int64_t>                 aggregated;
+
+	uint64_t last  = s_next.load();
+	uint64_t first = last - std::min<uint64_t>(last, s_events.size());
+	for (uint64_t i = first; i < last; ++i) {
+		const auto &slot = s_events[i % s_events.size()];
+		if (slot.sequence.load(std::memory_order_acquire) != i + 1) {
+			continue;
+		}
+		Event event;
+		event.begin       = slot.begin;
+		event.PTS         = slot.PTS;
+		event.runningTime = slot.runningTime;
+		event.layer       = slot.layer;
+		event.stage       = slot.stage;
+		if (slot.sequence.load(std::memory_order_acquire) != i + 1) {
+			// overwritten while being read.
+			continue;
+		}
+
+		switch (event.stage) {
+		case Stage::DecodeOut:
+			decoded[{event.layer, event.PTS}] = event.begin;
+			break;
+		case Stage::ProxyPush:
+			if (auto it = decoded.find({event.layer, event.PTS});
+			    it != decoded.end()) {
+				add(res[0], it->second, event.begin);
+				decoded.erase(it);
+			}
+			if (event.runningTime >= 0) {
+				pushed.push_back({event.runningTime, event.begin});
+			}
+			break;
+		case Stage::MixerAggregate:
+			aggregated.emplace(event.PTS, event.begin);
+			break;
+		case Stage::SampleOut:
+			if (auto it = aggregated.find(event.PTS); it != aggregated.end()) {
+				add(res[2], it->second, event.begin);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	for (const auto &[runningTime, begin] : pushed) {
+		auto it = aggregated.lower_bound(runningTime);
+		if (it != aggregated.end()) {
+			add(res[1], begin, it->second);
+		}
+	}
+
+	std::vector<StageLatency> latencies;
+	for (auto &acc : res) {
+		if (auto samples = int64_t(acc.latency.Samples); samples > 0) {
+			acc.latency.Mean = std::chrono::nanoseconds{acc.sum / samples};
+		}
+		latencies.push_back(acc.latency);
+	}
+	return latencies;
+}
+
+} // namespace trace
+} // namespace yams
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace yams {
+namespace trace {
+
+/// Points of the frame path that can be recorded.
+enum class Stage : uint8_t {
+	// a decoded or generated buffer leaves a MediaPipeline.
+	DecodeOut = 0,
+	// a buffer is pushed by a proxysrc into the mixer.
+	ProxyPush,
+	// the mixer outputs an aggregated frame.
+	MixerAggregate,
+	// the appsink callback, from pull to emission.
+	SampleOut,
+	// a frame is queued to the GUI thread, or received by it.
+	Handoff,
+	// VideoOutput::paintGL().
+	Paint,
+	// waiting on the GstGLSyncMeta of the displayed frame.
+	GLSyncWait,
+	// end of paintGL() to QOpenGLWindow::frameSwapped().
+	Swap,
+};
+
+/// Name of the stage as it appears in the trace.
+const char *stageName(Stage stage);
+
+struct Options {
+	// Chrome trace file written by stop(), nothing is written when empty.
+	std::string Path;
+	// Number of events kept, older events are overwritten.
+	size_t Capacity = 1 << 16;
+};
+
+/// Starts recording events in a preallocated ring buffer. Any previous
+/// recording is discarded. Must be called before any pipeline is built, as
+/// probes are only installed when tracing is enabled.
+///
+/// @throws cpptrace::invalid_argument if Options::Capacity is 0.
+void start(Options options);
+
+/// Stops recording and writes the recorded events to Options::Path. Must be
+/// called once the pipelines stopped streaming, as recorders are not waited
+/// for.
+void stop();
+
+/// Starts recording to the file given by the YAMS_TRACE environment
+/// variable, if set. Returns true if tracing was started.
+bool startFromEnvironment();
+
+/// Whether events are currently recorded. Cheap enough to be checked on
+/// every buffer.
+bool enabled() noexcept;
+
+/// Timestamp used by all events.
+std::chrono::nanoseconds now() noexcept;
+
+/// Records an event. A zero duration records an instant event. layer is -1
+/// for events on the output, and pts is -1 when not relevant. runningTime is
+/// the output running time of an input buffer, -1 when unknown.
+void record(
+    Stage                    stage,
+    std::chrono::nanoseconds begin,
+    std::chrono::nanoseconds duration,
+    int                      layer       = -1,
+    int64_t                  pts         = -1,
+    int64_t                  runningTime = -1
+) noexcept;
+
+/// Records an instant event at now().
+inline void mark(
+    Stage stage, int layer = -1, int64_t pts = -1, int64_t runningTime = -1
+) noexcept {
+	if (enabled() == false) {
+		return;
+	}
+	record(stage, now(), std::chrono::nanoseconds{0}, layer, pts, runningTime);
+}
+
+/// Delay between two consecutive stages of the frame path.
+struct StageLatency {
+	Stage                    From, To;
+	size_t                   Samples = 0;
+	std::chrono::nanoseconds Mean{0}, Max{0};
+};
+
+/// Delays from decode to proxysrc, proxysrc to mixer and mixer to appsink,
+/// in that order, computed from the events held in the ring buffer whose
+/// later stage was recorded in [since, until).
+///
+/// A decoded buffer is matched with its push by layer and PTS, a pushed
+/// buffer with the first aggregate whose PTS is at or after its running
+/// time, and an aggregate with the sample of the same PTS.
+std::vector<StageLatency> stageLatencies(
+    std::chrono::nanoseconds since = std::chrono::nanoseconds{0},
+    std::chrono::nanoseconds until = std::chrono::nanoseconds::max()
+);
+
+/// Writes the events currently held in the ring buffer, oldest first, in the
+/// Chrome trace event JSON format. The output can be opened with
+/// ui.perfetto.dev or chrome://tracing.
+void writeChromeTrace(std::ostream &out);
+
+/// RAII span, records the duration of its scope.
+///
+/// Example usage:
+/// @code
+/// {
+/// 	trace::Span span{trace::Stage::Paint};
+/// 	span.setPTS(frame->PTS().count());
+/// 	// ...
+/// }
+/// @endcode
+class Span {
+public:
+	inline Span(Stage stage, int layer = -1, int64_t pts = -1) noexcept
+	    : d_stage{stage}
+	    , d_layer{layer}
+	    , d_pts{pts}
+	    , d_begin{enabled() ? now() : std::chrono::nanoseconds::min()} {}
+
+	inline ~Span() {
+		if (d_begin == std::chrono::nanoseconds::min()) {
+			return;
+		}
+		record(d_stage, d_begin, now() - d_begin, d_layer, d_pts);
+	}
+
+	Span(const Span &)            = delete;
+	Span(Span &&)                 = delete;
+	Span &operator=(const Span &) = delete;
+	Span &operator=(Span &&)      = delete;
+
+	inline void setPTS(int64_t pts) noexcept {
+		d_pts = pts;
+	}
+
+private:
+	Stage                    d_stage;
+	int                      d_layer;
+	int64_t                  d_pts;
+	std::chrono::nanoseconds d_begin;
+};
+
+} // namespace trace
+} // namespace yams
@@ -0,0 +1,157 @@
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+#include <cpptrace/exceptions.hpp>
+
+#include "Trace.hpp"
+
+namespace yams {
+namespace trace {
+
+class TraceTest : public ::testing::Test {
+protected:
+	void TearDown() override {
+		stop();
+	}
+
+	static std::string chromeTrace() {
+		std::ostringstream out;
+		writeChromeTrace(out);
+		return out.str();
+	}
+
+	static size_t count(const std::string &str, const std::string &pattern) {
+		size_t res = 0;
+		for (auto pos = str.find(pattern); pos != std::string::npos;
+		     pos      = str.find(pattern, pos + 1)) {
+			++res;
+		}
+		return res;
+	}
+};
+
+TEST_F(TraceTest, DisabledByDefault) {
+	EXPECT_FALSE(enabled());
+	EXPECT_THROW(start({.Capacity = 0}), cpptrace::invalid_argument);
+	EXPECT_FALSE(enabled());
+}
+
+TEST_F(TraceTest, RecordsSpansAndInstants) {
+	using namespace std::chrono_literals;
+	start({.Capacity = 16});
+	ASSERT_TRUE(enabled());
+	record(Stage::Paint, 1500ns, 2001ns, -1, 42);
+	mark(Stage::DecodeOut, 1, 33);
+
+	auto res = chromeTrace();
+	EXPECT_NE(
+	    res.find("{\"name\":\"paint\",\"cat\":\"output\",\"pid\":1,\"tid\":"),
+	    std::string::npos
+	) << res;
+	EXPECT_NE(
+	    res.find("\"ts\":1.500,\"ph\":\"X\",\"dur\":2.001,"
+	             "\"args\":{\"layer\":-1,\"pts\":42}}"),
+	    std::string::npos
+	) << res;
+	EXPECT_NE(
+	    res.find("{\"name\":\"decode-out\",\"cat\":\"input\""),
+	    std::string::npos
+	) << res;
+	EXPECT_NE(
+	    res.find("\"ph\":\"i\",\"s\":\"t\",\"args\":{\"layer\":1,\"pts\":33}}"),
+	    std::string::npos
+	) << res;
+	EXPECT_NE(res.find("\"thread_name\""), std::string::npos) << res;
+}
+
+TEST_F(TraceTest, KeepsLatestEvents) {
+	using namespace std::chrono_literals;
+	start({.Capacity = 4});
+	for (int i = 0; i < 10; ++i) {
+		record(Stage::Swap, 1us, 1us, -1, 100 + i);
+	}
+	auto res = chromeTrace();
+	EXPECT_EQ(count(res, "\"name\":\"swap\""), 4) << res;
+	EXPECT_EQ(res.find("\"pts\":105}"), std::string::npos) << res;
+	for (int i = 6; i < 10; ++i) {
+		EXPECT_NE(
+		    res.find("\"pts\":" + std::to_string(100 + i) + "}"),
+		    std::string::npos
+		) << res;
+	}
+}
+
+TEST_F(TraceTest, SpansAreNotRecordedWhenDisabled) {
+	start({.Capacity = 4});
+	stop();
+	{
+		Span span{Stage::Paint};
+	}
+	start({.Capacity = 4});
+	EXPECT_EQ(count(chromeTrace(), "\"name\":\"paint\""), 0);
+	{
+		Span span{Stage::Paint, 0, 12};
+	}
+	EXPECT_EQ(count(chromeTrace(), "\"name\":\"paint\""), 1);
+}
+
+TEST_F(TraceTest, StageLatenciesPairEvents) {
+	using namespace std::chrono_literals;
+	using std::chrono::nanoseconds;
+	start({.Capacity = 32});
+	for (int i = 0; i < 2; ++i) {
+		int64_t base = i * 100000;
+		// layer 0 plays media PTS 1000 + i at running time 20000 + base.
+		record(Stage::DecodeOut, nanoseconds(base), 0ns, 0, 1000 + i);
+		record(
+		    Stage::ProxyPush,
+		    nanoseconds(base + 1000 * (i + 1)),
+		    0ns,
+		    0,
+		    1000 + i,
+		    20000 + base
+		);
+		record(Stage::MixerAggregate, nanoseconds(base + 10000), 0ns, -1, base);
+		record(
+		    Stage::MixerAggregate,
+		    nanoseconds(base + 30000),
+		    0ns,
+		    -1,
+		    base + 33333
+		);
+		record(
+		    Stage::SampleOut,
+		    nanoseconds(base + 34000),
+		    500ns,
+		    -1,
+		    base + 33333
+		);
+	}
+
+	auto res = stageLatencies();
+	ASSERT_EQ(res.size(), 3);
+	EXPECT_EQ(res[0].From, Stage::DecodeOut);
+	EXPECT_EQ(res[0].To, Stage::ProxyPush);
+	EXPECT_EQ(res[0].Samples, 2);
+	EXPECT_EQ(res[0].Mean, 1500ns);
+	EXPECT_EQ(res[0].Max, 2000ns);
+	EXPECT_EQ(res[1].To, Stage::MixerAggregate);
+	EXPECT_EQ(res[1].Samples, 2);
+	EXPECT_EQ(res[1].Mean, 28500ns);
+	EXPECT_EQ(res[1].Max, 29000ns);
+	EXPECT_EQ(res[2].To, Stage::SampleOut);
+	EXPECT_EQ(res[2].Samples, 2);
+	EXPECT_EQ(res[2].Mean, 4000ns);
+
+	res = stageLatencies(50us);
+	EXPECT_EQ(res[0].Samples, 1);
+	EXPECT_EQ(res[0].Mean, 2000ns);
+	EXPECT_EQ(res[2].Samples, 1);
+	res = stageLatencies(0ns, 50us);
+	EXPECT_EQ(res[0].Samples, 1);
+	EXPECT_EQ(res[0].Mean, 1000ns);
+}
+
+} // namespace trace
+} // namespace yams
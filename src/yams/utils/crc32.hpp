@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace yams {
+namespace details {
+constexpr std::array<uint32_t, 256> crc32Table() {
+	std::array<uint32_t, 256> table{};
+	for (uint32_t i = 0; i < 256; ++i) {
+		uint32_t c = i;
+		for (int k = 0; k < 8; ++k) {
+			c = (c & 1) ? 0xedb88320U ^ (c >> 1) : c >> 1;
+		}
+		table[i] = c;
+	}
+	return table;
+}
+
+inline constexpr auto CRC32Table = crc32Table();
+} // namespace details
+
+// CRC-32 (IEEE 802.3, as zlib's crc32()). Pass the previous result as crc to
+// checksum non contiguous data, e.g. the rows of a padded frame.
+constexpr uint32_t
+crc32(const uint8_t *data, size_t size, uint32_t crc = 0) noexcept {
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i) {
+		crc = details::CRC32Table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+} // namespace yams
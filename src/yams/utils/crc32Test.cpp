@@ -0,0 +1,26 @@
+#include "crc32.hpp"
+#include <gtest/gtest.h>
+
+#include <string_view>
+
+namespace yams {
+class CRC32Test : public ::testing::Test {};
+
+static uint32_t checksum(std::string_view data, uint32_t crc = 0) {
+	return crc32((const uint8_t *)data.data(), data.size(), crc);
+}
+
+TEST_F(CRC32Test, KnownValues) {
+	EXPECT_EQ(checksum(""), 0x00000000U);
+	EXPECT_EQ(checksum("123456789"), 0xcbf43926U);
+	EXPECT_EQ(
+	    checksum("The quick brown fox jumps over the lazy dog"),
+	    0x414fa339U
+	);
+}
+
+TEST_F(CRC32Test, Incremental) {
+	EXPECT_EQ(checksum("6789", checksum("12345")), checksum("123456789"));
+}
+
+} // namespace yams
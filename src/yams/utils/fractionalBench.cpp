@@ -0,0 +1,47 @@
+#include "fractional.hpp"
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+namespace yams {
+
+namespace {
+// Refresh rates reported by QScreen::refreshRate() on displays we meet.
+constexpr double refreshRates[] = {
+    23.976,
+    24.0,
+    25.0,
+    29.97,
+    30.0,
+    48.0,
+    50.0,
+    59.94,
+    60.0,
+    72.0,
+    75.0,
+    90.0,
+    100.0,
+    119.88,
+    120.0,
+    144.0,
+    165.0,
+    240.0,
+};
+
+constexpr int refreshRatesCount =
+    sizeof(refreshRates) / sizeof(refreshRates[0]);
+} // namespace
+
+static void BM_BuildFraction(benchmark::State &state) {
+	double rate = refreshRates[state.range(0)];
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(rate);
+		auto res = build_fraction(rate);
+		benchmark::DoNotOptimize(res);
+	}
+	state.SetLabel(std::to_string(rate));
+}
+
+BENCHMARK(BM_BuildFraction)->DenseRange(0, refreshRatesCount - 1);
+
+} // namespace yams